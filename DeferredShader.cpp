@@ -2,6 +2,7 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include <random>
+#include <algorithm>
 #include "DeferredShader.hpp"
 #include <GL/glew.h>
 #include "GLShader.hpp"
@@ -9,6 +10,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <fstream>
+#include <cstddef>
+#include <cstring>
 #include "GLMatrix.hpp"
 
 #include "stb_image_write.hpp"
@@ -16,12 +20,13 @@
 
 using opengl::GL;
 
-bool DeferredShader::Init(int w, int h)
+bool DeferredShader::Init(int w, int h, bool feedback)
 {
 	_w = w;
 	_h = h;
+	_feedback = feedback;
 
-	if (!InitGBuffer() || !InitShaders()) {
+	if (!InitGBuffer() || (_feedback && !InitFeedback()) || !InitShaders()) {
 		return false;
 	}
 	InitLights(RAND_SEED);
@@ -59,6 +64,15 @@ bool DeferredShader::InitGBuffer()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, _diffuseSpecBuffer, 0);
 
+	if (_feedback) {
+		glGenTextures(1, &_feedbackBuffer);
+		glBindTexture(GL_TEXTURE_2D, _feedbackBuffer);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, _w, _h, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, _feedbackBuffer, 0);
+	}
+
 	glBindTexture(GL_TEXTURE_2D, _depthBuffer);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, _w, _h, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -70,8 +84,8 @@ bool DeferredShader::InitGBuffer()
 	glTexParameteri (GL_TEXTURE_2D, GL_DEPTH_TEXTURE_MODE, GL_INTENSITY);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthBuffer, 0);
 
-	const GLuint attachmentsArray[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-	glDrawBuffers(3, attachmentsArray);
+	const GLuint attachmentsArray[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+	glDrawBuffers(_feedback ? 4 : 3, attachmentsArray);
 
 	// Check framebuffer
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -82,72 +96,148 @@ bool DeferredShader::InitGBuffer()
 	return true;
 }
 
+bool DeferredShader::InitFeedback()
+{
+	_feedbackW = std::max(1, _w / FEEDBACK_SCALE);
+	_feedbackH = std::max(1, _h / FEEDBACK_SCALE);
+
+	glGenFramebuffers(1, &_feedbackFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, _feedbackFBO);
+	glGenTextures(1, &_feedbackTexture);
+	glBindTexture(GL_TEXTURE_2D, _feedbackTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, _feedbackW, _feedbackH, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _feedbackTexture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Feedback framebuffer is incomplete." << std::endl;
+		return false;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(FEEDBACK_FRAMES, _feedbackPBOs);
+	for (unsigned int i = 0; i < FEEDBACK_FRAMES; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, _feedbackPBOs[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, _feedbackW * _feedbackH * sizeof(GLuint), NULL, GL_STREAM_READ);
+		_feedbackFences[i] = nullptr;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+// std140 mirrors of the Transforms block in pass1_gbuffer.vert and the Light struct in pass2_deferred.frag,
+// compared with what the programs report in InitShaders()
+struct TransformData
+{
+	glm::mat4 model;
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 normal[3]; // mat3 columns are vec4 aligned
+};
+static_assert(offsetof(TransformData, view) == 64 && offsetof(TransformData, normal) == 192 && sizeof(TransformData) == 240,
+	"TransformData doesn't follow std140");
+
+struct LightData
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float attenuation;
+};
+static_assert(offsetof(LightData, radius) == 12 && offsetof(LightData, color) == 16 && sizeof(LightData) == 32,
+	"LightData doesn't follow std140");
+
+// uniforms set every frame, hashed at compile time instead of looked up by name
+static constexpr uint32_t CAM_POSITION = opengl::UniformId("CamPosition");
+static constexpr uint32_t NEAR_PLANE = opengl::UniformId("NearPlane");
+static constexpr uint32_t FAR_PLANE = opengl::UniformId("FarPlane");
+static constexpr uint32_t OBJECT_COLOR = opengl::UniformId("ObjectColor");
+
+// "#define NAME true" lines for each feature, pass1_gbuffer.frag defaults the others to false
+static std::string GBufferDefines(unsigned int features)
+{
+	const char *names[] = { "HAS_DIFFUSE", "HAS_SPECULAR", "HAS_NORMAL", "PACKED_SPECULAR", "WRITE_FEEDBACK" };
+	std::string defines;
+	for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (features & (1u << i)) {
+			defines += std::string("#define ") + names[i] + " true\n";
+		}
+	}
+	return defines;
+}
+
 bool DeferredShader::InitShaders()
 {
-	if (!_shaderGBuffer.Create(PASS1_VS, PASS1_FS)) {
+	// everything is submitted before anything is waited on, so the programs compile side by side.
+	// The G-buffer combinations scenes usually have are started here too, others compile when first drawn.
+	const unsigned int gbufferFeatures[] = { 0, HAS_DIFFUSE, HAS_DIFFUSE | HAS_SPECULAR, HAS_DIFFUSE | HAS_SPECULAR | HAS_NORMAL,
+		HAS_DIFFUSE | PACKED_SPECULAR, HAS_DIFFUSE | PACKED_SPECULAR | HAS_NORMAL };
+	for (unsigned int features : gbufferFeatures) {
+		if (!_shaderGBuffer[features].CreateAsync(PASS1_VS, PASS1_FS, GBufferDefines(features | (_feedback ? (unsigned int)WRITE_FEEDBACK : 0u)))) {
+			return false;
+		}
+	}
+	if (!_shaderLights.CreateAsync(PASS3_VS, PASS3_FS)) {
 		return false;
 	}
-	if (!_shaderGBuffer_DN.Create(PASS1_VS, PASS1_DN_FS)) {
+	// the screen space passes share one vertex stage, only their fragment stages are swapped in (BindScreenPass())
+	if (!_screenVertex.CreateSeparableAsync(opengl::ShaderType::VERTEX, PASS2_VS)) {
 		return false;
 	}
-	if (!_shaderGBuffer_D.Create(PASS1_VS, PASS1_D_FS)) {
+	if (!_shaderDeferred.CreateSeparableAsync(opengl::ShaderType::FRAGMENT, PASS2_FS, "#define NUM_LIGHTS " + std::to_string(NUM_LIGHTS) + "\n")) {
 		return false;
 	}
-	if (!_shaderGBuffer.Create(PASS1_VS, PASS1_FS)) {
+	if (!_shaderPosition.CreateSeparableAsync(opengl::ShaderType::FRAGMENT, POSITION_FS)) {
 		return false;
 	}
-	if (!_shaderDeferred.Create(PASS2_VS, PASS2_FS)) {
+	if (!_shaderNormal.CreateSeparableAsync(opengl::ShaderType::FRAGMENT, NORMAL_FS)) {
 		return false;
 	}
-	if (!_shaderLights.Create(PASS3_VS, PASS3_FS)) {
+	if (!_shaderDiffuse.CreateSeparableAsync(opengl::ShaderType::FRAGMENT, DIFFUSE_FS)) {
 		return false;
 	}
-	if (!_shaderPosition.Create(PASS2_VS, POSITION_FS)) {
+	if (!_shaderSpecular.CreateSeparableAsync(opengl::ShaderType::FRAGMENT, SPECULAR_FS)) {
 		return false;
 	}
-	if (!_shaderNormal.Create(PASS2_VS, NORMAL_FS)) {
+	if (!_shaderDepth.CreateSeparableAsync(opengl::ShaderType::FRAGMENT, DEPTH_FS)) {
 		return false;
 	}
-	if (!_shaderDiffuse.Create(PASS2_VS, DIFFUSE_FS)) {
+
+	// the G-buffer programs other than the base one (whose Transforms block is reflected below) and the buffer
+	// views are polled with IsReady() when they're first needed (GBufferShader(), Pass2_BufferMode()), the frame
+	// goes on without them while they link
+	if (!_screenVertex.Wait() || !_shaderDeferred.Wait() || !_shaderLights.Wait()) {
 		return false;
 	}
-	if (!_shaderSpecular.Create(PASS2_VS, SPECULAR_FS)) {
+	_screenPipeline.Create();
+	_screenPipeline.UseStages(GL_VERTEX_SHADER_BIT, _screenVertex);
+	_screenPipeline.UseStages(GL_FRAGMENT_SHADER_BIT, _shaderDeferred);
+	if (!_screenPipeline.Validate()) {
+		std::cout << "Screen space pipeline: " << _screenPipeline.GetInfoLog() << std::endl;
 		return false;
 	}
-	if (!_shaderDepth.Create(PASS2_VS, DEPTH_FS)) {
+
+	opengl::GLProgram &gbuffer = _shaderGBuffer[0];
+	if (!gbuffer.Wait() || !_transforms.Create(gbuffer, "Transforms", TRANSFORMS_BINDING)
+		|| !_transforms.Verify("ModelMatrix", offsetof(TransformData, model))
+		|| !_transforms.Verify("ViewMatrix", offsetof(TransformData, view))
+		|| !_transforms.Verify("ProjectionMatrix", offsetof(TransformData, projection))
+		|| !_transforms.Verify("NormalMatrix", offsetof(TransformData, normal))) {
+		return false;
+	}
+	if (!_lights.Create(_shaderDeferred, "Lights", LIGHTS_BINDING)
+		|| !_lights.Verify("lights[0].Position", offsetof(LightData, position))
+		|| !_lights.Verify("lights[0].Radius", offsetof(LightData, radius))
+		|| !_lights.Verify("lights[0].Color", offsetof(LightData, color))
+		|| !_lights.Verify("lights[0].Attenuation", offsetof(LightData, attenuation))
+		|| !_lights.Verify("lights[1].Position", sizeof(LightData))) {
 		return false;
 	}
 
-	_shaderDeferred.Bind();
 	_shaderDeferred.GetUniform("PositionBuffer").Set(0);
 	_shaderDeferred.GetUniform("NormalBuffer").Set(1);
 	_shaderDeferred.GetUniform("DiffuseSpecBuffer").Set(2);
 
-	_shaderDiffuse.Bind();
-	_shaderDiffuse.GetUniform("PositionBuffer").Set(0);
-	_shaderDiffuse.GetUniform("NormalBuffer").Set(1);
-	_shaderDiffuse.GetUniform("DiffuseSpecBuffer").Set(2);
-
-	_shaderNormal.Bind();
-	_shaderNormal.GetUniform("PositionBuffer").Set(0);
-	_shaderNormal.GetUniform("NormalBuffer").Set(1);
-	_shaderNormal.GetUniform("DiffuseSpecBuffer").Set(2);
-
-	_shaderPosition.Bind();
-	_shaderPosition.GetUniform("PositionBuffer").Set(0);
-	_shaderPosition.GetUniform("NormalBuffer").Set(1);
-	_shaderPosition.GetUniform("DiffuseSpecBuffer").Set(2);
-
-	_shaderSpecular.Bind();
-	_shaderSpecular.GetUniform("PositionBuffer").Set(0);
-	_shaderSpecular.GetUniform("NormalBuffer").Set(1);
-	_shaderSpecular.GetUniform("DiffuseSpecBuffer").Set(2);
-
-	_shaderDepth.Bind();
-	_shaderDepth.GetUniform("DepthBuffer").Set(3);
-	//_shaderDepth.GetUniform("NearPlane").Set(_nearPlane);
-	//_shaderDepth.GetUniform("FarPlane").Set(_farPlane);
-
 	return _shaderLights.GetProgram().Validate();
 }
 
@@ -196,6 +286,7 @@ void DeferredShader::SetPerspective(float nearPlane, float farPlane)
 
 void DeferredShader::Render(float ticks, const opengl::GLModel &model1, const opengl::GLModel &model2, const glm::vec3 &camPosition)
 {
+	UpdateCaptures();
 	if (_isRotating) {
 		_rotationAngle += ROTATION_CONSTANT;
 	}
@@ -229,55 +320,166 @@ void DeferredShader::Render(float ticks, const opengl::GLModel &model1, const op
 	}
 }
 
+glm::mat4 DeferredShader::Placement1() const
+{
+	glm::mat4 placement = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	placement = glm::translate(placement, glm::vec3(0.0f, -WORLD_SCALE / 2.0f, 0.0f));
+	return glm::scale(placement, glm::vec3(3 * WORLD_SCALE));
+}
+
+glm::mat4 DeferredShader::Placement2() const
+{
+	glm::mat4 placement = glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	placement = glm::translate(placement, glm::vec3(0.0f, -WORLD_SCALE / 2.0f, 0.0f));
+	return glm::scale(placement, glm::vec3(0.4f * WORLD_SCALE));
+}
+
+void DeferredShader::GetShaderFiles(std::vector<std::string> &files) const
+{
+	const char *sources[] = { PASS1_VS, PASS1_FS, PASS2_VS, PASS2_FS, PASS3_VS, PASS3_FS,
+		POSITION_FS, NORMAL_FS, DIFFUSE_FS, SPECULAR_FS, DEPTH_FS };
+	for (const char *source : sources) {
+		files.push_back(source);
+		const std::string module = opengl::GLProgram::ModulePath(source);
+		if (std::ifstream(module)) {
+			files.push_back(module);
+		}
+	}
+}
+
 void DeferredShader::Pass1_GBuffer(const opengl::GLModel &model1, const opengl::GLModel &model2)
 {
 	glBindFramebuffer(GL_FRAMEBUFFER, _gBuffer);
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (_feedback) {
+		// integer attachments aren't covered by the float clear color
+		const GLuint noFeedback[4] = { 0, 0, 0, 0 };
+		glClearBufferuiv(GL_COLOR, 3, noFeedback);
+	}
 
 	GL.Identity();
-	GL.RotateDeg(90.0f, 0.0f, 1.0f, 0.0f);
-	GL.Translate(0.0f, -WORLD_SCALE / 2.0f, 0.0f);
-	GL.Scale(3*WORLD_SCALE);
+	GL.Mult(Placement1());
 	GL.Scale(model1.GetScaleFactor());
 	GL.BuildNormalMatrix();
+	UploadTransforms();
 	DrawModel(model1);
 
 	GL.Identity();
-	GL.RotateDeg(45.0f, 0.0f, 1.0f, 0.0f);
-	GL.Translate(0.0f, -WORLD_SCALE / 2.0f, 0.0f);
-	GL.Scale(0.4f * WORLD_SCALE);
+	GL.Mult(Placement2());
 	GL.Scale(model2.GetScaleFactor());
 	GL.BuildNormalMatrix();
-	_shaderGBuffer.Bind();
-	GL.Bind();
-	model2.Draw(_shaderGBuffer.Id());
+	UploadTransforms();
+	opengl::GLProgram &shader = GBufferShader(0);
+	shader.Bind();
+	model2.Draw(shader);
 
+	if (_feedback) {
+		RequestFeedback();
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void DeferredShader::DrawModel(const opengl::GLModel &model) const
+void DeferredShader::RequestFeedback()
+{
+	if (_feedbackFences[_feedbackWrite] != nullptr) {
+		return; // every PBO is still waiting to be read, skip this frame
+	}
+	// nearest downsampling keeps the ids intact
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _gBuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT3);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _feedbackFBO);
+	glBlitFramebuffer(0, 0, _w, _h, 0, 0, _feedbackW, _feedbackH, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	// reads into the PBO asynchronously, ReadFeedback() maps it once the fence has passed
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _feedbackFBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _feedbackPBOs[_feedbackWrite]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, _feedbackW, _feedbackH, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	_feedbackFences[_feedbackWrite] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_feedbackWrite = (_feedbackWrite + 1) % FEEDBACK_FRAMES;
+	glBindFramebuffer(GL_FRAMEBUFFER, _gBuffer);
+}
+
+bool DeferredShader::ReadFeedback(std::vector<unsigned int> &feedback, int &w, int &h)
+{
+	GLsync &fence = _feedbackFences[_feedbackRead];
+	if (fence == nullptr || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+	w = _feedbackW;
+	h = _feedbackH;
+	feedback.resize(w * h);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _feedbackPBOs[_feedbackRead]);
+	const GLuint *data = (const GLuint *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, w * h * sizeof(GLuint), GL_MAP_READ_BIT);
+	bool mapped = data != nullptr;
+	if (mapped) {
+		std::copy(data, data + w * h, feedback.begin());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	_feedbackRead = (_feedbackRead + 1) % FEEDBACK_FRAMES;
+	return mapped;
+}
+
+opengl::GLProgram &DeferredShader::GBufferShader(unsigned int features)
+{
+	auto found = _shaderGBuffer.find(features);
+	if (found == _shaderGBuffer.end()) {
+		found = _shaderGBuffer.emplace(features, opengl::GLProgram()).first;
+		found->second.CreateAsync(PASS1_VS, PASS1_FS, GBufferDefines(features | (_feedback ? (unsigned int)WRITE_FEEDBACK : 0u)));
+	}
+	if (found->second.IsPending()) {
+		if (!found->second.IsReady()) {
+			// drawn untextured by the base program (linked in InitShaders()) until this one has linked
+			return _shaderGBuffer[0];
+		}
+		if (found->second.Wait()) {
+			_transforms.Attach(found->second);
+		}
+	}
+	// a variant that failed to link (Wait() printed why) draws with the base program instead of not at all
+	return found->second.Id() != 0 ? found->second : _shaderGBuffer[0];
+}
+
+void DeferredShader::UploadTransforms()
+{
+	TransformData transforms;
+	transforms.model = GL.ModelMatrix();
+	transforms.view = GL.ViewMatrix();
+	transforms.projection = GL.ProjMatrix();
+	const glm::mat3 &normal = GL.NormalMatrix();
+	for (int i = 0; i < 3; i++) {
+		transforms.normal[i] = glm::vec4(normal[i], 0.0f);
+	}
+	_transforms.SetData(&transforms, sizeof(transforms));
+	_transforms.Upload();
+}
+
+void DeferredShader::DrawModel(const opengl::GLModel &model)
 {
 	const std::vector<opengl::GLMesh> &meshes = model.GetMeshes();
 	for (auto iter = meshes.begin(); iter != meshes.end(); iter++) {
-		bool hasDiffuse = iter->HasTextureMap(opengl::TextureType::Diffuse);
-		//bool hasSpecular = iter->HasTextureMap(opengl::TextureType::Specular);
-		bool hasNormal = iter->HasTextureMap(opengl::TextureType::Normal);
-		if (hasNormal) {
-			_shaderGBuffer_DN.Bind();
-			GL.Bind();
-			iter->Draw(_shaderGBuffer_DN.Id());
+		unsigned int features = 0;
+		if (iter->HasTextureMap(opengl::TextureType::Diffuse)) {
+			features |= HAS_DIFFUSE;
+		}
+		if (iter->HasTextureMap(opengl::TextureType::DiffuseSpecular)) {
+			features |= HAS_DIFFUSE | PACKED_SPECULAR;
 		}
-		else if (hasDiffuse) {
-			_shaderGBuffer_D.Bind();
-			GL.Bind();
-			iter->Draw(_shaderGBuffer_D.Id());
+		if (iter->HasTextureMap(opengl::TextureType::Specular)) {
+			features |= HAS_SPECULAR;
 		}
-		else {
-			_shaderGBuffer.Bind();
-			GL.Bind();
-			iter->Draw(_shaderGBuffer.Id());
+		if (iter->HasTextureMap(opengl::TextureType::Normal)) {
+			features |= HAS_NORMAL;
 		}
+		opengl::GLProgram &shader = GBufferShader(features);
+		shader.Bind();
+		iter->Draw(shader);
 	}
 }
 
@@ -285,14 +487,14 @@ void DeferredShader::Pass2_DeferredShading(const glm::vec3 &camPosition)
 {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	_shaderDeferred.Bind();
+	BindScreenPass(_shaderDeferred);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, _positionBuffer);
 	glActiveTexture(GL_TEXTURE0 + 1);
 	glBindTexture(GL_TEXTURE_2D, _normalBuffer);
 	glActiveTexture(GL_TEXTURE0 + 2);
 	glBindTexture(GL_TEXTURE_2D, _diffuseSpecBuffer);
-	_shaderDeferred.GetUniform("CamPosition").Set(camPosition);
+	_shaderDeferred.GetUniform(CAM_POSITION).Set(camPosition);
 
 	if (_isRotating)
 		SetLights();
@@ -307,10 +509,28 @@ void DeferredShader::Pass2_DeferredShading(const glm::vec3 &camPosition)
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void DeferredShader::BindScreenPass(const opengl::GLProgram &fragment)
+{
+	_screenPipeline.UseStages(GL_FRAGMENT_SHADER_BIT, fragment);
+	_screenPipeline.Bind();
+}
+
 void DeferredShader::Pass2_BufferMode(opengl::GLProgram &shaderProg)
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	shaderProg.Bind();
+	if (shaderProg.IsPending()) {
+		// it has been linking since InitShaders(), the view stays blank until it's done instead of stalling the frame
+		if (!shaderProg.IsReady() || !shaderProg.Wait()) {
+			return;
+		}
+		shaderProg.GetUniform("PositionBuffer").Set(0);
+		shaderProg.GetUniform("NormalBuffer").Set(1);
+		shaderProg.GetUniform("DiffuseSpecBuffer").Set(2);
+	}
+	if (shaderProg.Id() == 0) {
+		return;
+	}
+	BindScreenPass(shaderProg);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, _positionBuffer);
 	glActiveTexture(GL_TEXTURE1);
@@ -327,9 +547,18 @@ void DeferredShader::Pass2_DepthMode()
 {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	_shaderDepth.Bind();
-	_shaderDepth.GetUniform("NearPlane").Set(_nearPlane);
-	_shaderDepth.GetUniform("FarPlane").Set(_farPlane);
+	if (_shaderDepth.IsPending()) {
+		if (!_shaderDepth.IsReady() || !_shaderDepth.Wait()) {
+			return;
+		}
+		_shaderDepth.GetUniform("DepthBuffer").Set(3);
+	}
+	if (_shaderDepth.Id() == 0) {
+		return;
+	}
+	BindScreenPass(_shaderDepth);
+	_shaderDepth.GetUniform(NEAR_PLANE).Set(_nearPlane);
+	_shaderDepth.GetUniform(FAR_PLANE).Set(_farPlane);
 	glActiveTexture(GL_TEXTURE3);
 	glBindTexture(GL_TEXTURE_2D, _depthBuffer);
 
@@ -340,16 +569,17 @@ void DeferredShader::Pass2_DepthMode()
 
 void DeferredShader::SetLights()
 {
-	_shaderDeferred.Bind();
+	std::vector<LightData> lights(_lightPositions.size());
+	glm::mat4 rotMatrix;
+	rotMatrix = glm::rotate(rotMatrix, _rotationAngle, glm::vec3(0.0, 1.0, 0.0));
 	for (unsigned int i = 0; i < _lightPositions.size(); i++) {
-		glm::mat4 rotMatrix;
-		rotMatrix = glm::rotate(rotMatrix, _rotationAngle, glm::vec3(0.0, 1.0, 0.0));
-		glm::vec3 pos = rotMatrix * glm::vec4(_lightPositions[i], 1.0f);
-		_shaderDeferred.GetUniform("lights[" + std::to_string(i) + "].Position").Set(pos);
-		_shaderDeferred.GetUniform("lights[" + std::to_string(i) + "].Color").Set(_lightColors[i]);
-		_shaderDeferred.GetUniform("lights[" + std::to_string(i) + "].Radius").Set(LIGHT_RADIUS);
-		_shaderDeferred.GetUniform("lights[" + std::to_string(i) + "].Attenuation").Set(ATTENUATION);
+		lights[i].position = glm::vec3(rotMatrix * glm::vec4(_lightPositions[i], 1.0f));
+		lights[i].radius = LIGHT_RADIUS;
+		lights[i].color = _lightColors[i];
+		lights[i].attenuation = ATTENUATION;
 	}
+	_lights.SetData(lights.data(), lights.size() * sizeof(LightData));
+	_lights.Upload();
 }
 
 void DeferredShader::Pass3_Lights()
@@ -365,7 +595,7 @@ void DeferredShader::Pass3_Lights()
 		GL.Translate(pos);
 		GL.Scale(LIGHT_SCALE);
 		GL.BindModelMatrix();
-		_shaderLights.Get("ObjectColor").Set(_lightColors[i]);
+		_shaderLights.Get(OBJECT_COLOR).Set(_lightColors[i]);
 		glBindVertexArray(_cubeVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 		glBindVertexArray(0);
@@ -461,21 +691,16 @@ void DeferredShader::InitCube()
 }
 
 
-void flip_image(unsigned char *image_data, int w, int h, int comp)
+// copies the rows in reverse, GL reads images bottom up
+void flip_image(const unsigned char *image_data, unsigned char *flipped, int w, int h, int comp)
 {
-	// invert image vertically
-	for (int x = 0; x < w * comp; x++) {
-		for (int y = 0; y < h / 2; y++) {
-			int index = x + y * w * comp;
-			int swap_index = x + (h - y - 1) * w * comp;
-			char tmp = image_data[index];
-			image_data[index] = image_data[swap_index];
-			image_data[swap_index] = tmp;
-		}
+	size_t row = (size_t)w * comp;
+	for (int y = 0; y < h; y++) {
+		std::memcpy(flipped + y * row, image_data + (h - y - 1) * row, row);
 	}
 }
 
-void get_albedo_specular(unsigned char *image_data, int w, int h, unsigned char *albedo, unsigned char *specular)
+void get_albedo_specular(const unsigned char *image_data, int w, int h, unsigned char *albedo, unsigned char *specular)
 {
 	for (int i = 0; i < w * h; ++i) {
 		albedo[i * 3] = image_data[i * 4];
@@ -485,69 +710,191 @@ void get_albedo_specular(unsigned char *image_data, int w, int h, unsigned char
 	}
 }
 
-void DeferredShader::SaveFile(int w, int h) const
+// images of a capture in the order they're packed into its PBO, the depth floats first so they stay aligned
+enum CaptureImage
+{
+	CAPTURE_DEPTH = 0,
+	CAPTURE_DIFFUSE_SPEC,
+	CAPTURE_POSITION,
+	CAPTURE_NORMAL,
+	CAPTURE_FINAL,
+	CAPTURE_IMAGES,
+};
+static const size_t CAPTURE_PIXEL_BYTES[CAPTURE_IMAGES] = { sizeof(float), 4, 3, 3, 3 };
+
+// where an image starts in the PBO, CAPTURE_IMAGES gives the size of the whole capture
+static size_t CaptureOffset(CaptureImage image, int w, int h)
 {
-	unsigned char *image_data = new unsigned char[w * h * 4];
-	unsigned char *albedo = new unsigned char[w * h * 3];
-	unsigned char *specular = new unsigned char[w * h];
-	float *depth = new float[w * h];
+	size_t offset = 0;
+	for (int i = 0; i < image; i++) {
+		offset += CAPTURE_PIXEL_BYTES[i] * w * h;
+	}
+	return offset;
+}
 
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, _gBuffer);
+// Encodes a mapped capture as JPGs, on the capture writer's thread.
+static void WriteCapture(const unsigned char *data, int w, int h, float nearPlane, float farPlane, int quality)
+{
+	size_t pixels = (size_t)w * h;
+	std::vector<unsigned char> image(pixels * 4), depthImage(pixels), albedo(pixels * 3), specular(pixels);
 
 	// position
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, image_data);
-	flip_image(image_data, w, h, 3);
-	stbi_write_jpg("attachment_position.jpg", w, h, 3, image_data, JPG_QUALITY);
+	flip_image(data + CaptureOffset(CAPTURE_POSITION, w, h), image.data(), w, h, 3);
+	stbi_write_jpg("attachment_position.jpg", w, h, 3, image.data(), quality);
 
 	// normal
-	glReadBuffer(GL_COLOR_ATTACHMENT1);
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, image_data);
-	flip_image(image_data, w, h, 3);
-	stbi_write_jpg("attachment_normal.jpg", w, h, 3, image_data, JPG_QUALITY);
+	flip_image(data + CaptureOffset(CAPTURE_NORMAL, w, h), image.data(), w, h, 3);
+	stbi_write_jpg("attachment_normal.jpg", w, h, 3, image.data(), quality);
 
 	// albedo/specular
-	glReadBuffer(GL_COLOR_ATTACHMENT2);
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-	glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-	flip_image(image_data, w, h, 4);
-	get_albedo_specular(image_data, w, h, albedo, specular);
-	stbi_write_jpg("attachment_albedo.jpg", w, h, 3, albedo, JPG_QUALITY); // albedo
-	stbi_write_jpg("attachment_specular.jpg", w, h, 1, specular, JPG_QUALITY); // specular
+	flip_image(data + CaptureOffset(CAPTURE_DIFFUSE_SPEC, w, h), image.data(), w, h, 4);
+	get_albedo_specular(image.data(), w, h, albedo.data(), specular.data());
+	stbi_write_jpg("attachment_albedo.jpg", w, h, 3, albedo.data(), quality); // albedo
+	stbi_write_jpg("attachment_specular.jpg", w, h, 1, specular.data(), quality); // specular
 
 	// depth
-	glReadBuffer(GL_DEPTH_ATTACHMENT);
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-	glReadPixels(0, 0, w, h, GL_DEPTH_COMPONENT, GL_FLOAT, depth);
+	const float *depth = (const float *)(data + CaptureOffset(CAPTURE_DEPTH, w, h));
 	// convert from float to byte (32bit to 8bit)
-	for (int i = 0; i < w * h; ++i) 
+	for (size_t i = 0; i < pixels; ++i)
 	{
 		// Linearize
-		depth[i] = 2.0f * _nearPlane / (_farPlane + _nearPlane - depth[i] * (_farPlane - _nearPlane));
+		float z = 2.0f * nearPlane / (farPlane + nearPlane - depth[i] * (farPlane - nearPlane));
 		//convert float to single 256bit color
-		int tmp = int(255 * depth[i]);
-		// invert greyscale: white is near, black is far
-		//tmp = abs(tmp - 255);
-		image_data[i] = std::min(std::max(tmp, 0), 255);
+		int tmp = int(255 * z);
+		depthImage[i] = (unsigned char)std::min(std::max(tmp, 0), 255);
 	}
-
-	flip_image(image_data, w, h, 1);
-	stbi_write_jpg("attachment_depth.jpg", w, h, 1, image_data, JPG_QUALITY);
+	flip_image(depthImage.data(), image.data(), w, h, 1);
+	stbi_write_jpg("attachment_depth.jpg", w, h, 1, image.data(), quality);
 
 	// final image
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glReadBuffer(GL_BACK);
+	flip_image(data + CaptureOffset(CAPTURE_FINAL, w, h), image.data(), w, h, 3);
+	stbi_write_jpg("attachment_final.jpg", w, h, 3, image.data(), quality);
+}
+
+void DeferredShader::SaveFile(int w, int h)
+{
+	Capture &capture = _captures[_captureWrite];
+	if (capture.fence != nullptr || capture.mapped != nullptr) {
+		return; // every capture is still being read back or written, skip this frame
+	}
+	if (capture.pbo == 0) {
+		glGenBuffers(1, &capture.pbo);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+	size_t size = CaptureOffset(CAPTURE_IMAGES, w, h);
+	if (capture.size != size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		capture.size = size;
+	}
+	capture.w = w;
+	capture.h = h;
+	capture.nearPlane = _nearPlane;
+	capture.farPlane = _farPlane;
+
+	// the reads only queue copies into the PBO, UpdateCaptures() maps it once the fence has passed
 	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, image_data);
-	flip_image(image_data, w, h, 3);
-	stbi_write_jpg("attachment_final.jpg", w, h, 3, image_data, JPG_QUALITY);
-
-	delete[] albedo;
-	delete[] specular;
-	delete[] image_data;
-	delete[] depth;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _gBuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, (void*)CaptureOffset(CAPTURE_POSITION, w, h));
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, (void*)CaptureOffset(CAPTURE_NORMAL, w, h));
+	glReadBuffer(GL_COLOR_ATTACHMENT2);
+	glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (void*)CaptureOffset(CAPTURE_DIFFUSE_SPEC, w, h));
+	glReadPixels(0, 0, w, h, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)CaptureOffset(CAPTURE_DEPTH, w, h));
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, (void*)CaptureOffset(CAPTURE_FINAL, w, h));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_captureWrite = (_captureWrite + 1) % CAPTURE_FRAMES;
+}
+
+void DeferredShader::UpdateCaptures()
+{
+	for (Capture &capture : _captures) {
+		if (capture.fence != nullptr && glClientWaitSync(capture.fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+			glDeleteSync(capture.fence);
+			capture.fence = nullptr;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+			capture.mapped = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture.size, GL_MAP_READ_BIT);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			if (capture.mapped != nullptr) {
+				// encoded straight from the mapping, which stays mapped until the writer is done with it
+				capture.written = false;
+				Capture *mapped = &capture;
+				int quality = JPG_QUALITY;
+				_captureWriter.Submit([mapped, quality]() {
+					WriteCapture(mapped->mapped, mapped->w, mapped->h, mapped->nearPlane, mapped->farPlane, quality);
+					mapped->written = true;
+				});
+			}
+		}
+		else if (capture.mapped != nullptr && capture.written) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			capture.mapped = nullptr;
+		}
+	}
+}
+
+DeferredShader::~DeferredShader()
+{
+	Shutdown();
+}
+
+void DeferredShader::Shutdown()
+{
+	// finish the readbacks already queued so a capture taken right before quitting is still written
+	for (Capture &capture : _captures) {
+		if (capture.fence != nullptr) {
+			glClientWaitSync(capture.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+	}
+	UpdateCaptures();
+	// the writer encodes straight from the mappings, they can only be unmapped once it's done
+	_captureWriter.Wait();
+	for (Capture &capture : _captures) {
+		if (capture.fence != nullptr) {
+			glDeleteSync(capture.fence);
+			capture.fence = nullptr;
+		}
+		if (capture.mapped != nullptr) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			capture.mapped = nullptr;
+		}
+		if (capture.pbo != 0) {
+			glDeleteBuffers(1, &capture.pbo);
+			capture.pbo = 0;
+			capture.size = 0;
+		}
+	}
+
+	// the feedback readbacks are dropped, the streamer has nothing left to load
+	for (unsigned int i = 0; i < FEEDBACK_FRAMES; i++) {
+		if (_feedbackFences[i] != nullptr) {
+			glClientWaitSync(_feedbackFences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(_feedbackFences[i]);
+			_feedbackFences[i] = nullptr;
+		}
+	}
+	if (_feedbackPBOs[0] != 0) {
+		glDeleteBuffers(FEEDBACK_FRAMES, _feedbackPBOs);
+		std::fill(_feedbackPBOs, _feedbackPBOs + FEEDBACK_FRAMES, 0u);
+	}
+	if (_feedbackFBO != 0) {
+		glDeleteFramebuffers(1, &_feedbackFBO);
+		_feedbackFBO = 0;
+	}
+	if (_feedbackTexture != 0) {
+		glDeleteTextures(1, &_feedbackTexture);
+		_feedbackTexture = 0;
+	}
+	if (_screenPipeline.Id() != 0) {
+		_screenPipeline.Destroy();
+	}
 }
 
 void DeferredShader::ToggleRotation()
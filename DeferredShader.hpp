@@ -8,9 +8,15 @@
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <atomic>
 #include "GLProgram.hpp"
+#include "GLProgramPipeline.hpp"
+#include "GLUniformBlock.hpp"
 #include "GLModel.hpp"
 #include "MyShader.hpp"
+#include "ThreadPool.hpp"
 
 enum DeferredBuffer
 {
@@ -27,16 +33,34 @@ class DeferredShader
 {
 public:
 	DeferredShader() {}
-	bool Init(int w, int h);
+	~DeferredShader();
+	// With feedback the G-buffer also records which textures are sampled at what level of detail, for
+	// texture streaming. Without it that attachment, its readback and the shader output are left out.
+	bool Init(int w, int h, bool feedback);
+	// Writes the captures still in flight and deletes the capture and feedback readback objects and the screen
+	// space pipeline. Call it while the GL context is current, the destructor only repeats it for a renderer that
+	// was never shut down.
+	void Shutdown();
 	void Render(float ticks, const opengl::GLModel &model1, const opengl::GLModel &model2, const glm::vec3 &camPosition);
-	void SaveFile(int w, int h) const;
+	// Queues a readback of the G-buffer attachments and the back buffer without waiting for the GPU.
+	// The JPGs are written on another thread a frame or two later, captures are skipped while CAPTURE_FRAMES are in flight.
+	void SaveFile(int w, int h);
 	void ToggleRotation();
 	void SetDrawMode(DeferredBuffer mode);
 	void SetPerspective(float nearPlane, float farPlane);
 	void RandomizeLights(unsigned int seed);
+	// Copies the oldest finished readback of the texture streaming feedback (see opengl::GLTextureStreamer).
+	// Returns false while none is ready, the readback lags a frame or two behind rendering, and always without feedback.
+	bool ReadFeedback(std::vector<unsigned int> &feedback, int &w, int &h);
+	// Where each model is drawn, before the model's own GetScaleFactor() is applied.
+	glm::mat4 Placement1() const;
+	glm::mat4 Placement2() const;
+	// Source files and SPIR-V modules of every program Init() creates, for packing them into a GLAssetPack.
+	void GetShaderFiles(std::vector<std::string> &files) const;
 
 private:
 	bool InitGBuffer();
+	bool InitFeedback();
 	bool InitShaders();
 	void InitQuad();
 	void InitCube();
@@ -44,13 +68,57 @@ private:
 	void Pass1_GBuffer(const opengl::GLModel &model1, const opengl::GLModel &model2);
 	void Pass2_DeferredShading(const glm::vec3 &camPosition);
 	void Pass3_Lights();
+	void RequestFeedback();
+	// Hands the captures the GPU has finished to _captureWriter and recycles the ones it has written.
+	void UpdateCaptures();
+	// Binds the pipeline of the shared fullscreen vertex stage and a fragment stage.
+	void BindScreenPass(const opengl::GLProgram &fragment);
 	void Pass2_BufferMode(opengl::GLProgram &shaderProg);
 	void Pass2_DepthMode();
 	void SetLights();
-	void DrawModel(const opengl::GLModel &model) const;
+	void DrawModel(const opengl::GLModel &model);
+
+	// Material features the G-buffer shader is specialized for, by name in pass1_gbuffer.frag
+	enum GBufferFeature : unsigned int
+	{
+		HAS_DIFFUSE = 1,
+		HAS_SPECULAR = 2,
+		HAS_NORMAL = 4,
+		PACKED_SPECULAR = 8, // TextureType::DiffuseSpecular, specular in the diffuse alpha
+		WRITE_FEEDBACK = 16, // added to every program when Init() was asked for feedback, not part of the map key
+	};
+	// The G-buffer program for a combination of features, compiled the first time one is drawn with it.
+	// Returns the base program while the one asked for is still linking, and from then on if it failed to.
+	opengl::GLProgram &GBufferShader(unsigned int features);
+	// Copies the GL matrices into the Transforms block every G-buffer program reads.
+	void UploadTransforms();
 
 	int _w, _h;
-	GLuint _gBuffer, _positionBuffer, _normalBuffer, _diffuseSpecBuffer, _depthBuffer;
+	GLuint _gBuffer, _positionBuffer, _normalBuffer, _diffuseSpecBuffer, _depthBuffer, _feedbackBuffer;
+	// the feedback attachment is downsampled into _feedbackTexture and read back through a ring of PBOs
+	static const unsigned int FEEDBACK_FRAMES = 3;
+	GLuint _feedbackFBO = 0, _feedbackTexture = 0;
+	GLuint _feedbackPBOs[FEEDBACK_FRAMES] = {};
+	GLsync _feedbackFences[FEEDBACK_FRAMES] = {};
+	bool _feedback = false;
+	unsigned int _feedbackWrite = 0;
+	unsigned int _feedbackRead = 0;
+	int _feedbackW, _feedbackH;
+	// each capture is read into a PBO behind a fence, then stays mapped while _captureWriter encodes it
+	static const unsigned int CAPTURE_FRAMES = 3;
+	struct Capture
+	{
+		GLuint pbo = 0;
+		size_t size = 0;
+		GLsync fence = nullptr;
+		const unsigned char *mapped = nullptr;
+		std::atomic<bool> written{ false };
+		int w, h;
+		float nearPlane, farPlane;
+	};
+	Capture _captures[CAPTURE_FRAMES];
+	unsigned int _captureWrite = 0;
+	opengl::ThreadPool _captureWriter{ 1 }; // declared after _captures, its tasks finish before they're destroyed
 	GLuint _quadVAO, _quadVBO, _cubeVAO, _cubeVBO, _floorVAO, _floorVBO;
 	//GLuint _rboDepth;
 	static const GLuint _attachments[3];
@@ -58,15 +126,21 @@ private:
 	std::vector<glm::vec3> _lightColors;
 
 	GLuint _model1, _model2, _view1, _norm1, _view2, _proj1, _proj2;
-	MyShader _shaderGBuffer, _shaderGBuffer_DN, _shaderGBuffer_D, _shaderLights;
+	std::unordered_map<unsigned int, opengl::GLProgram> _shaderGBuffer; // by features
+	// blocks shared by the programs declaring them, written with one buffer update each
+	opengl::GLUniformBlock _transforms, _lights;
+	const GLuint TRANSFORMS_BINDING = 0;
+	const GLuint LIGHTS_BINDING = 1;
+	MyShader _shaderLights;
+	// fragment stages of the screen space passes, combined with _screenVertex in _screenPipeline
+	opengl::GLProgram _screenVertex;
+	opengl::GLProgramPipeline _screenPipeline;
 	opengl::GLProgram _shaderDeferred;
 	opengl::GLProgram _shaderPosition, _shaderNormal, _shaderDiffuse, _shaderSpecular, _shaderDepth;
 	const float WORLD_SCALE = 6.0f;
 	const float LIGHT_SCALE = WORLD_SCALE * 0.002f;
 	const char *PASS1_VS = "pass1_gbuffer.vert";
 	const char *PASS1_FS = "pass1_gbuffer.frag";
-	const char *PASS1_DN_FS = "pass1_gbuffer_dn.frag";
-	const char *PASS1_D_FS = "pass1_gbuffer_d.frag";
 
 	const char *PASS2_VS = "pass2_deferred.vert";
 	const char *PASS2_FS = "pass2_deferred.frag";
@@ -86,8 +160,9 @@ private:
 	float _farPlane = 1000.0f;
 
 	const int JPG_QUALITY = 85;
+	const int FEEDBACK_SCALE = 8; // feedback is read back at 1/FEEDBACK_SCALE of the screen size
 	const int RAND_SEED = 1512972091;
-	const unsigned int NUM_LIGHTS = 140;
+	const unsigned int NUM_LIGHTS = 140; // at most 150, the size of the Lights block in the SPIR-V module
 	const float ATTENUATION = 7.0f;
 	const float LIGHT_RADIUS = 4.0f;
 };
@@ -0,0 +1,165 @@
+#include "GLArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace opengl {
+
+static const size_t MIN_BLOCK_SIZE = 1 << 20;
+
+GLArena::~GLArena()
+{
+	Release();
+}
+
+GLArena::Marker GLArena::Mark() const
+{
+	Marker marker;
+	marker.block = _current;
+	marker.used = _blocks.empty() ? 0 : _blocks[_current].used;
+	marker.total = _used;
+	return marker;
+}
+
+void GLArena::Rewind(const Marker &marker)
+{
+	if (_blocks.empty()) {
+		return;
+	}
+	for (size_t i = marker.block + 1; i <= _current; i++) {
+		_blocks[i].used = 0;
+	}
+	_current = marker.block;
+	_blocks[_current].used = marker.used;
+	_used = marker.total;
+}
+
+void GLArena::Reset()
+{
+	if (_blocks.size() > 1) {
+		size_t size = 0;
+		for (size_t i = 0; i < _blocks.size(); i++) {
+			size += _blocks[i].size;
+		}
+		Release();
+		_AddBlock(size);
+	}
+	else if (!_blocks.empty()) {
+		_blocks[0].used = 0;
+	}
+	_current = 0;
+	_used = 0;
+}
+
+void GLArena::Release()
+{
+	for (size_t i = 0; i < _blocks.size(); i++) {
+		::operator delete(_blocks[i].data);
+	}
+	_blocks.clear();
+	_current = 0;
+	_used = 0;
+}
+
+size_t GLArena::Allocations() const
+{
+	return _allocations;
+}
+
+size_t GLArena::HeapAllocations() const
+{
+	return _heapAllocations;
+}
+
+size_t GLArena::PeakBytes() const
+{
+	return _peak;
+}
+
+void *GLArena::_Allocate(size_t bytes, size_t alignment)
+{
+	_allocations++;
+	for (;;) {
+		if (_current < _blocks.size()) {
+			Block &block = _blocks[_current];
+			uintptr_t base = (uintptr_t)block.data;
+			size_t offset = (size_t)(((base + block.used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+			if (offset + bytes <= block.size) {
+				_used += offset + bytes - block.used;
+				_peak = std::max(_peak, _used);
+				block.used = offset + bytes;
+				return block.data + offset;
+			}
+			// the tail of this block stays unused until a rewind, try the next one
+			if (_current + 1 < _blocks.size()) {
+				_current++;
+				continue;
+			}
+		}
+		// blocks double so a growing user needs few of them
+		_AddBlock(std::max(bytes + alignment, std::max(MIN_BLOCK_SIZE, _blocks.empty() ? 0 : _blocks.back().size * 2)));
+		_current = _blocks.size() - 1;
+	}
+}
+
+void GLArena::_AddBlock(size_t size)
+{
+	Block block;
+	// operator new is aligned for any fundamental type
+	block.data = (unsigned char *)::operator new(size);
+	block.size = size;
+	block.used = 0;
+	_blocks.push_back(block);
+	_heapAllocations++;
+}
+
+GLArena &GLArenaPool::Acquire()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_free.empty()) {
+		_arenas.push_back(std::unique_ptr<GLArena>(new GLArena()));
+		return *_arenas.back();
+	}
+	GLArena *arena = _free.back();
+	_free.pop_back();
+	return *arena;
+}
+
+void GLArenaPool::Release(GLArena &arena)
+{
+	arena.Reset();
+	std::lock_guard<std::mutex> lock(_mutex);
+	_free.push_back(&arena);
+}
+
+size_t GLArenaPool::Allocations() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t total = 0;
+	for (size_t i = 0; i < _arenas.size(); i++) {
+		total += _arenas[i]->Allocations();
+	}
+	return total;
+}
+
+size_t GLArenaPool::HeapAllocations() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t total = 0;
+	for (size_t i = 0; i < _arenas.size(); i++) {
+		total += _arenas[i]->HeapAllocations();
+	}
+	return total;
+}
+
+size_t GLArenaPool::PeakBytes() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t total = 0;
+	for (size_t i = 0; i < _arenas.size(); i++) {
+		total += _arenas[i]->PeakBytes();
+	}
+	return total;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef GLARENA_HPP
+#define GLARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace opengl {
+
+// Bump allocator for short lived load temporaries. Allocations come out of a few large blocks and
+// are all freed at once by Reset(), which keeps the memory, so processing one mesh after another
+// stops going to the heap once the blocks are big enough. Only for trivially destructible types.
+class GLArena
+{
+public:
+	// Position to rewind to, everything allocated after it is freed.
+	struct Marker
+	{
+		size_t block, used, total;
+	};
+
+	GLArena() : _current(0), _used(0), _peak(0), _allocations(0), _heapAllocations(0) {}
+	~GLArena();
+	// Uninitialized storage for count objects.
+	template<typename T>
+	T *Allocate(size_t count)
+	{
+		return (T *)_Allocate(count * sizeof(T), alignof(T));
+	}
+	template<typename T>
+	T *Allocate(size_t count, const T &value)
+	{
+		T *data = Allocate<T>(count);
+		for (size_t i = 0; i < count; i++) {
+			new (data + i) T(value);
+		}
+		return data;
+	}
+	Marker Mark() const;
+	// Frees what was allocated since the marker was taken, keeping the blocks for what comes next.
+	void Rewind(const Marker &marker);
+	// Frees everything handed out. Several blocks are merged into one that fits them all, so the
+	// next user of the same size is served from a single block.
+	void Reset();
+	// Returns the blocks to the heap.
+	void Release();
+	size_t Allocations() const; // requests served
+	size_t HeapAllocations() const; // blocks taken from the heap
+	size_t PeakBytes() const; // most bytes in use between two resets
+
+private:
+	GLArena(const GLArena &) = delete;
+	GLArena &operator=(const GLArena &) = delete;
+	void *_Allocate(size_t bytes, size_t alignment);
+	void _AddBlock(size_t size);
+
+	struct Block
+	{
+		unsigned char *data;
+		size_t size, used;
+	};
+	std::vector<Block> _blocks;
+	size_t _current; // block allocations come from, the ones after it are empty
+	size_t _used, _peak;
+	size_t _allocations, _heapAllocations;
+};
+
+// One arena per concurrent user. Arenas are handed back reset and reused by the next user,
+// so a whole load runs on as many arenas as it had meshes in flight.
+class GLArenaPool
+{
+public:
+	GLArenaPool() {}
+	GLArena &Acquire();
+	void Release(GLArena &arena);
+	// Totals over every arena in the pool.
+	size_t Allocations() const;
+	size_t HeapAllocations() const;
+	size_t PeakBytes() const; // sum of the arenas' peaks, they may be in use at the same time
+
+private:
+	GLArenaPool(const GLArenaPool &) = delete;
+	GLArenaPool &operator=(const GLArenaPool &) = delete;
+
+	std::vector<std::unique_ptr<GLArena>> _arenas;
+	std::vector<GLArena *> _free;
+	mutable std::mutex _mutex;
+};
+
+} // namespace opengl
+#endif // GLARENA_HPP
\ No newline at end of file
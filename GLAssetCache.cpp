@@ -0,0 +1,317 @@
+#include "GLAssetCache.hpp"
+#include "GLMeshCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <utime.h>
+#include <errno.h>
+#endif
+
+namespace opengl {
+
+static const char *TEMP_SUFFIX = ".tmp";
+
+#ifdef _WIN32
+
+static bool MakeDirectory(const std::string &path)
+{
+	return CreateDirectoryA(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+// calls visit with the name, size and modification time of every file in the directory
+static void ListFiles(const std::string &directory, const std::function<void(const std::string &, uint64_t, uint64_t)> &visit)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	do {
+		if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+			uint64_t size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+			uint64_t time = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+			visit(data.cFileName, size, time);
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+}
+
+static bool RenameOver(const std::string &from, const std::string &to)
+{
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+// bumps the modification time so the next run's index sees the entry as recently used
+static void TouchFile(const std::string &path)
+{
+	HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(file, NULL, NULL, &now);
+	CloseHandle(file);
+}
+
+#else
+
+static bool MakeDirectory(const std::string &path)
+{
+	return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+static void ListFiles(const std::string &directory, const std::function<void(const std::string &, uint64_t, uint64_t)> &visit)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (dir == nullptr) {
+		return;
+	}
+	while (dirent *item = readdir(dir)) {
+		struct stat info;
+		if (stat((directory + '/' + item->d_name).c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+			visit(item->d_name, (uint64_t)info.st_size, (uint64_t)info.st_mtime);
+		}
+	}
+	closedir(dir);
+}
+
+static bool RenameOver(const std::string &from, const std::string &to)
+{
+	return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+static void TouchFile(const std::string &path)
+{
+	utime(path.c_str(), NULL);
+}
+
+#endif
+
+GLAssetCache::GLAssetCache()
+	: _capacity(0), _open(false), _bytes(0), _clock(0), _sessionStart(0), _tempFiles(0)
+{
+	std::memset(_stats, 0, sizeof(_stats));
+}
+
+bool GLAssetCache::Open(const std::string &directory, uint64_t capacity)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_open = false;
+	_entries.clear();
+	_bytes = 0;
+	std::memset(_stats, 0, sizeof(_stats));
+	if (!MakeDirectory(directory)) {
+		return false;
+	}
+	_directory = directory;
+	_capacity = capacity;
+
+	struct Found
+	{
+		std::string name;
+		Entry entry;
+		uint64_t time;
+	};
+	std::vector<Found> found;
+	std::vector<std::string> torn;
+	ListFiles(directory, [&found, &torn](const std::string &name, uint64_t size, uint64_t time) {
+		if (name.find(TEMP_SUFFIX) != std::string::npos) {
+			torn.push_back(name); // left behind by a run that didn't get to Commit()
+			return;
+		}
+		for (int i = 0; i < (int)Category::Count; i++) {
+			const std::string ext = _Extension((Category)i);
+			if (name.size() == 16 + ext.size() && name.compare(16, ext.size(), ext) == 0) {
+				Found file;
+				file.name = name;
+				file.entry.category = (Category)i;
+				file.entry.size = size;
+				file.time = time;
+				found.push_back(file);
+			}
+		}
+	});
+	for (unsigned int i = 0; i < torn.size(); i++) {
+		std::remove((directory + '/' + torn[i]).c_str());
+	}
+	std::sort(found.begin(), found.end(), [](const Found &a, const Found &b) { return a.time < b.time; });
+	for (unsigned int i = 0; i < found.size(); i++) {
+		found[i].entry.lastUsed = i;
+		_entries[found[i].name] = found[i].entry;
+		_bytes += found[i].entry.size;
+		_stats[(int)found[i].entry.category].bytes += found[i].entry.size;
+	}
+	_clock = found.size();
+	_sessionStart = _clock;
+	_open = true;
+	_Evict();
+	return true;
+}
+
+bool GLAssetCache::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _open;
+}
+
+uint64_t GLAssetCache::Key(Category category, uint64_t sourceHash, std::initializer_list<uint64_t> parameters)
+{
+	uint32_t tag = (uint32_t)category;
+	uint64_t key = GLMeshCache::Hash(&tag, sizeof(tag));
+	key = GLMeshCache::Hash(&sourceHash, sizeof(sourceHash), key);
+	for (uint64_t parameter : parameters) {
+		key = GLMeshCache::Hash(&parameter, sizeof(parameter), key);
+	}
+	return key;
+}
+
+std::string GLAssetCache::Path(Category category, uint64_t key) const
+{
+	return _directory + '/' + _Name(category, key);
+}
+
+bool GLAssetCache::Find(Category category, uint64_t key, std::string &path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	path = Path(category, key);
+	auto found = _entries.find(_Name(category, key));
+	if (found == _entries.end()) {
+		_stats[(int)category].misses++;
+		return false;
+	}
+	found->second.lastUsed = _clock++;
+	_stats[(int)category].hits++;
+	TouchFile(path);
+	return true;
+}
+
+void GLAssetCache::Discard(Category category, uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto found = _entries.find(_Name(category, key));
+	if (found == _entries.end()) {
+		return;
+	}
+	const std::string path = Path(category, key);
+	std::remove(path.c_str());
+	_bytes -= found->second.size;
+	_stats[(int)category].bytes -= found->second.size;
+	_stats[(int)category].hits--;
+	_stats[(int)category].misses++;
+	_entries.erase(found);
+}
+
+std::string GLAssetCache::TempPath(Category category, uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return Path(category, key) + TEMP_SUFFIX + std::to_string(_tempFiles++);
+}
+
+bool GLAssetCache::CommitFile(const std::string &tempPath, const std::string &path)
+{
+	if (!RenameOver(tempPath, path)) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool GLAssetCache::Commit(Category category, uint64_t key, const std::string &tempPath)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const std::string path = Path(category, key);
+	std::ifstream file(tempPath, std::ios::binary | std::ios::ate);
+	uint64_t size = file ? (uint64_t)file.tellg() : 0;
+	file.close();
+	if (size == 0 || !RenameOver(tempPath, path)) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	const std::string name = _Name(category, key);
+	auto found = _entries.find(name);
+	if (found != _entries.end()) {
+		// another thread finished the same entry first
+		_bytes -= found->second.size;
+		_stats[(int)found->second.category].bytes -= found->second.size;
+	}
+	Entry &entry = _entries[name];
+	entry.category = category;
+	entry.size = size;
+	entry.lastUsed = _clock++;
+	_bytes += size;
+	_stats[(int)category].bytes += size;
+	_stats[(int)category].writes++;
+	_Evict();
+	return true;
+}
+
+GLAssetCache::Stats GLAssetCache::GetStats(Category category) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats[(int)category];
+}
+
+void GLAssetCache::PrintStats() const
+{
+	const char *names[] = { "meshes", "textures", "program binaries" };
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (int i = 0; i < (int)Category::Count; i++) {
+		const Stats &stats = _stats[i];
+		std::cout << "Asset cache " << names[i] << ": " << stats.hits << " hits, " << stats.misses << " misses, " << stats.writes << " writes, "
+			<< stats.evictions << " evictions, " << stats.bytes / (1024.0 * 1024.0) << " MB" << std::endl;
+	}
+}
+
+std::string GLAssetCache::_Name(Category category, uint64_t key)
+{
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return name + std::string(_Extension(category));
+}
+
+const char *GLAssetCache::_Extension(Category category)
+{
+	switch (category) {
+	case Category::Mesh:
+		return ".meshcache";
+	case Category::Texture:
+		return ".dds";
+	default:
+		return ".progbin";
+	}
+}
+
+void GLAssetCache::_Evict()
+{
+	while (_bytes > _capacity) {
+		auto oldest = _entries.end();
+		for (auto iter = _entries.begin(); iter != _entries.end(); iter++) {
+			if (iter->second.lastUsed < _sessionStart && (oldest == _entries.end() || iter->second.lastUsed < oldest->second.lastUsed)) {
+				oldest = iter;
+			}
+		}
+		if (oldest == _entries.end()) {
+			return; // everything left is in use by this run
+		}
+		std::remove((_directory + '/' + oldest->first).c_str());
+		_bytes -= oldest->second.size;
+		_stats[(int)oldest->second.category].bytes -= oldest->second.size;
+		_stats[(int)oldest->second.category].evictions++;
+		_entries.erase(oldest);
+	}
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef GLASSETCACHE_HPP
+#define GLASSETCACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <initializer_list>
+#include <mutex>
+
+namespace opengl {
+
+// One directory of processed assets shared by every kind of cache (meshes, BC textures, program binaries).
+//
+// Entries are named after a key hashed from the source's contents and everything that changes the output
+// (see Key()), so a changed source or option simply misses and the stale entry ages out. New entries are
+// written to a temporary file and renamed into place, a crash never leaves a torn entry behind. When the
+// directory grows past its capacity the least recently used entries are deleted, except the ones used
+// since Open() which may still be mapped or streamed from. Every method is thread safe.
+class GLAssetCache
+{
+public:
+	enum class Category
+	{
+		Mesh = 0,
+		Texture,
+		ProgramBinary,
+		Count,
+	};
+
+	struct Stats
+	{
+		unsigned int hits, misses, writes, evictions;
+		uint64_t bytes; // on disk right now
+	};
+
+	GLAssetCache();
+	// Creates the directory if needed and indexes the entries already in it, oldest first by modification time.
+	bool Open(const std::string &directory, uint64_t capacity);
+	bool IsOpen() const;
+	// Combines the source's content hash with the processing parameters.
+	static uint64_t Key(Category category, uint64_t sourceHash, std::initializer_list<uint64_t> parameters);
+	std::string Path(Category category, uint64_t key) const;
+	// Counts a hit and marks the entry used if it exists, counts a miss otherwise.
+	bool Find(Category category, uint64_t key, std::string &path);
+	// Deletes an entry Find() returned that turned out unreadable, turning its hit into a miss.
+	void Discard(Category category, uint64_t key);
+	// A file to write a new entry to, unique per call. Hand it to Commit() once it's complete.
+	std::string TempPath(Category category, uint64_t key);
+	// Renames the temporary file over the entry and evicts entries while over capacity. Deletes it on failure.
+	bool Commit(Category category, uint64_t key, const std::string &tempPath);
+	// Renames a complete temporary file over path in one step, so a reader sees either the old file or the new one.
+	// For files kept outside the cache, e.g. sidecars next to a model. Deletes the temporary file on failure.
+	static bool CommitFile(const std::string &tempPath, const std::string &path);
+	Stats GetStats(Category category) const;
+	void PrintStats() const;
+
+private:
+	GLAssetCache(const GLAssetCache &) = delete;
+	GLAssetCache &operator=(const GLAssetCache &) = delete;
+
+	struct Entry
+	{
+		Category category;
+		uint64_t size;
+		uint64_t lastUsed; // ordinal, entries at or above _sessionStart were used by this run
+	};
+
+	static const char *_Extension(Category category);
+	// 16 hex digits of the key and the category's extension
+	static std::string _Name(Category category, uint64_t key);
+	void _Evict();
+
+	std::string _directory;
+	uint64_t _capacity;
+	bool _open;
+	std::unordered_map<std::string, Entry> _entries; // by file name
+	uint64_t _bytes;
+	uint64_t _clock;
+	uint64_t _sessionStart;
+	unsigned int _tempFiles;
+	Stats _stats[(int)Category::Count];
+	mutable std::mutex _mutex;
+};
+
+} // namespace opengl
+#endif // GLASSETCACHE_HPP
\ No newline at end of file
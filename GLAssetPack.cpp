@@ -0,0 +1,256 @@
+#include "GLAssetPack.hpp"
+#include "GLMeshCache.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace opengl {
+
+static uint64_t NameHash(const std::string &normalized)
+{
+	uint64_t hash = GLMeshCache::Hash(normalized.data(), normalized.size());
+	return hash != 0 ? hash : 1; // zero marks empty slots
+}
+
+static void Align(std::ofstream &file, uint64_t alignment)
+{
+	const char padding[GLAssetPack::DATA_ALIGNMENT] = { 0 };
+	uint64_t position = (uint64_t)file.tellp();
+	file.write(padding, ((position + alignment - 1) & ~(alignment - 1)) - position);
+}
+
+bool GLAssetPack::Open(const std::string &packPath)
+{
+	Close();
+	if (!_file.Open(packPath) || _file.Size() < sizeof(Header)) {
+		Close();
+		return false;
+	}
+	const Header *header = (const Header *)_file.Data();
+	uint64_t size = _file.Size();
+	bool valid = header->magic == MAGIC
+		&& header->version == VERSION
+		&& header->numSlots != 0 && (header->numSlots & (header->numSlots - 1)) == 0
+		&& header->slotOffset % sizeof(uint64_t) == 0
+		&& header->slotOffset + (uint64_t)header->numSlots * sizeof(Slot) <= size
+		&& header->nameOffset + header->nameBytes <= size;
+	if (!valid) {
+		Close();
+		return false;
+	}
+	const Slot *slots = (const Slot *)(_file.Data() + header->slotOffset);
+	for (unsigned int i = 0; i < header->numSlots; i++) {
+		if (slots[i].hash != 0 && (slots[i].offset + slots[i].size > header->slotOffset
+			|| (uint64_t)slots[i].nameOffset + slots[i].nameLength > header->nameBytes
+			|| (uint64_t)slots[i].sourceOffset + slots[i].sourceLength > header->nameBytes)) {
+			Close();
+			return false;
+		}
+	}
+	_header = header;
+	_slots = slots;
+	_names = (const char *)_file.Data() + header->nameOffset;
+
+	// one stat per source here keeps every Find() inside the mapping
+	_stale.assign(header->numSlots, 0);
+	for (unsigned int i = 0; i < header->numSlots; i++) {
+		if (slots[i].hash == 0 || slots[i].sourceStamp == 0) {
+			continue;
+		}
+		std::vector<std::string> sources;
+		std::string source;
+		for (uint32_t j = 0; j <= slots[i].sourceLength; j++) {
+			char c = j < slots[i].sourceLength ? _names[slots[i].sourceOffset + j] : '\n';
+			if (c != '\n') {
+				source += c;
+			}
+			else if (!source.empty()) {
+				sources.push_back(source);
+				source.clear();
+			}
+		}
+		// without its sources the pack holds the only copy, which is used as it is
+		uint64_t stamp = SourceStamp(sources);
+		if (stamp != 0 && stamp != slots[i].sourceStamp) {
+			_stale[i] = 1;
+			_numStale++;
+		}
+	}
+	if (_numStale > 0) {
+		std::cout << "Asset pack " << packPath << ": " << _numStale << " entries are older than their files, which are read instead. Delete the pack to rebuild it." << std::endl;
+	}
+	return true;
+}
+
+void GLAssetPack::Close()
+{
+	_file.Close();
+	_header = nullptr;
+	_slots = nullptr;
+	_names = nullptr;
+	_stale.clear();
+	_numStale = 0;
+}
+
+bool GLAssetPack::IsOpen() const
+{
+	return _header != nullptr;
+}
+
+unsigned int GLAssetPack::NumEntries() const
+{
+	return _header ? _header->numEntries : 0;
+}
+
+unsigned int GLAssetPack::NumStale() const
+{
+	return _numStale;
+}
+
+bool GLAssetPack::Find(const std::string &name, const unsigned char *&data, size_t &size) const
+{
+	if (_header == nullptr) {
+		return false;
+	}
+	const std::string key = Normalize(name);
+	const uint64_t hash = NameHash(key);
+	const uint32_t mask = _header->numSlots - 1;
+	// linear probing, the table is never full so an empty slot ends every search
+	for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask) {
+		const Slot &slot = _slots[i];
+		if (slot.hash == 0) {
+			return false;
+		}
+		if (slot.hash == hash && slot.nameLength == key.size() && std::memcmp(_names + slot.nameOffset, key.data(), key.size()) == 0) {
+			if (_stale[i]) {
+				return false;
+			}
+			data = _file.Data() + slot.offset;
+			size = (size_t)slot.size;
+			return true;
+		}
+	}
+}
+
+std::string GLAssetPack::Normalize(const std::string &name)
+{
+	std::string normalized = name;
+	for (size_t i = 0; i < normalized.size(); i++) {
+		normalized[i] = normalized[i] == '\\' ? '/' : (char)std::tolower((unsigned char)normalized[i]);
+	}
+	return normalized;
+}
+
+uint64_t GLAssetPack::SourceStamp(const std::vector<std::string> &files)
+{
+	uint64_t stamp = GLMeshCache::Hash(nullptr, 0);
+	for (unsigned int i = 0; i < files.size(); i++) {
+		struct stat info;
+		if (stat(files[i].c_str(), &info) != 0) {
+			return 0;
+		}
+		const uint64_t values[2] = { (uint64_t)info.st_size, (uint64_t)info.st_mtime };
+		stamp = GLMeshCache::Hash(values, sizeof(values), stamp);
+	}
+	return stamp != 0 ? stamp : 1;
+}
+
+void GLAssetPackWriter::AddFile(const std::string &path)
+{
+	AddFile(path, path);
+}
+
+void GLAssetPackWriter::AddFile(const std::string &name, const std::string &path)
+{
+	AddFile(name, path, std::vector<std::string>(1, path));
+}
+
+void GLAssetPackWriter::AddFile(const std::string &name, const std::string &path, const std::vector<std::string> &sources)
+{
+	File file;
+	file.name = name;
+	file.path = path;
+	file.sources = sources;
+	_files.push_back(file);
+}
+
+bool GLAssetPackWriter::Write(const std::string &packPath) const
+{
+	std::ofstream file(packPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	// a zeroed header keeps a half written pack from ever being opened
+	GLAssetPack::Header header;
+	std::memset(&header, 0, sizeof(header));
+	file.write((const char *)&header, sizeof(header));
+
+	std::vector<GLAssetPack::Slot> entries;
+	std::string names;
+	std::unordered_set<std::string> added;
+	std::vector<char> buffer(1 << 20);
+	for (unsigned int i = 0; i < _files.size(); i++) {
+		const std::string name = GLAssetPack::Normalize(_files[i].name);
+		if (!added.insert(name).second) {
+			continue;
+		}
+		std::ifstream input(_files[i].path, std::ios::in | std::ios::binary);
+		if (!input) {
+			// the asset is still read from its own file then
+			std::cout << "Asset pack skips missing file: " << _files[i].path << std::endl;
+			continue;
+		}
+		Align(file, GLAssetPack::DATA_ALIGNMENT);
+		GLAssetPack::Slot entry;
+		entry.hash = NameHash(name);
+		entry.offset = (uint64_t)file.tellp();
+		entry.nameOffset = (uint32_t)names.size();
+		entry.nameLength = (uint32_t)name.size();
+		while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0) {
+			file.write(buffer.data(), input.gcount());
+		}
+		entry.size = (uint64_t)file.tellp() - entry.offset;
+		names += name;
+		entry.sourceStamp = GLAssetPack::SourceStamp(_files[i].sources);
+		entry.sourceOffset = (uint32_t)names.size();
+		for (unsigned int j = 0; j < _files[i].sources.size(); j++) {
+			names += _files[i].sources[j] + '\n';
+		}
+		entry.sourceLength = (uint32_t)names.size() - entry.sourceOffset;
+		entries.push_back(entry);
+	}
+
+	uint32_t numSlots = 2;
+	while (numSlots < entries.size() * 2) {
+		numSlots *= 2;
+	}
+	std::vector<GLAssetPack::Slot> slots(numSlots);
+	std::memset(slots.data(), 0, slots.size() * sizeof(GLAssetPack::Slot));
+	for (unsigned int i = 0; i < entries.size(); i++) {
+		uint32_t slot = (uint32_t)entries[i].hash & (numSlots - 1);
+		while (slots[slot].hash != 0) {
+			slot = (slot + 1) & (numSlots - 1);
+		}
+		slots[slot] = entries[i];
+	}
+	Align(file, GLAssetPack::DATA_ALIGNMENT);
+	header.magic = GLAssetPack::MAGIC;
+	header.version = GLAssetPack::VERSION;
+	header.numEntries = (uint32_t)entries.size();
+	header.numSlots = numSlots;
+	header.slotOffset = (uint64_t)file.tellp();
+	file.write((const char *)slots.data(), slots.size() * sizeof(GLAssetPack::Slot));
+	header.nameOffset = (uint64_t)file.tellp();
+	header.nameBytes = names.size();
+	file.write(names.data(), names.size());
+	file.seekp(0);
+	file.write((const char *)&header, sizeof(header));
+	return file.good();
+}
+
+} // namespace opengl
\ No newline at end of file
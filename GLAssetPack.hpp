@@ -0,0 +1,96 @@
+#pragma once
+#ifndef GLASSETPACK_HPP
+#define GLASSETPACK_HPP
+
+#include "GLMappedFile.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace opengl {
+
+// One mapped file holding the assets of a scene: mesh caches, compressed texture caches and shader sources.
+// Assets are found by the path they're known by (a cache's sidecar name, a shader's file), through a hash table stored in the file,
+// so opening the pack is the only file access and every lookup points straight into the mapping.
+// Names are compared case insensitively with '/' and '\\' treated alike.
+// Every entry records the size and modification time of the files it was made from. Open() compares them with the
+// files on disk once, entries whose files have changed since are left out so those assets are read from their files again.
+//
+// Layout: Header | entry data (each DATA_ALIGNMENT aligned) | Slot[numSlots] | names
+class GLAssetPack
+{
+public:
+	static const uint32_t MAGIC = 0x50415344; // "DSAP"
+	static const uint32_t VERSION = 2;
+	static const uint64_t DATA_ALIGNMENT = 16;
+
+	struct Header
+	{
+		uint32_t magic; // zero until the file is complete
+		uint32_t version;
+		uint32_t numEntries;
+		uint32_t numSlots; // power of two, at most half full
+		uint64_t slotOffset;
+		uint64_t nameOffset, nameBytes;
+	};
+
+	struct Slot
+	{
+		uint64_t hash; // zero for an empty slot
+		uint64_t offset, size;
+		uint32_t nameOffset, nameLength; // relative to the names
+		uint64_t sourceStamp; // SourceStamp() of the sources when packed, zero if one of them was missing
+		uint32_t sourceOffset, sourceLength; // the source files, '\n' separated in the names
+	};
+
+	GLAssetPack() : _header(nullptr), _slots(nullptr), _names(nullptr), _numStale(0) {}
+	bool Open(const std::string &packPath);
+	void Close();
+	bool IsOpen() const;
+	unsigned int NumEntries() const;
+	// Entries Open() left out because their sources changed after the pack was written.
+	unsigned int NumStale() const;
+	// Points data at the asset's bytes in the mapping, valid until Close(). Safe to call from any thread.
+	bool Find(const std::string &name, const unsigned char *&data, size_t &size) const;
+	// Lower case with '/' separators, the form names are stored and hashed in.
+	static std::string Normalize(const std::string &name);
+	// Hash of the size and modification time of each file, zero if one can't be found.
+	static uint64_t SourceStamp(const std::vector<std::string> &files);
+
+private:
+	GLMappedFile _file;
+	const Header *_header;
+	const Slot *_slots;
+	const char *_names;
+	std::vector<unsigned char> _stale; // by slot
+	unsigned int _numStale;
+};
+
+
+// Copies files into a new pack. Nothing is read until Write(), which streams them in one at a time.
+class GLAssetPackWriter
+{
+public:
+	GLAssetPackWriter() {}
+	// Adds the file at path under its own name. Adding a name twice keeps the first.
+	void AddFile(const std::string &path);
+	// Adds the file at path under another name, e.g. a shared cache entry under the path it's looked up by.
+	// The entry goes stale when one of sources changes, by default when the file itself does.
+	void AddFile(const std::string &name, const std::string &path);
+	void AddFile(const std::string &name, const std::string &path, const std::vector<std::string> &sources);
+	bool Write(const std::string &packPath) const;
+
+private:
+	struct File
+	{
+		std::string name, path;
+		std::vector<std::string> sources;
+	};
+	std::vector<File> _files;
+};
+
+} // namespace opengl
+#endif // GLASSETPACK_HPP
\ No newline at end of file
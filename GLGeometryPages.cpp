@@ -0,0 +1,267 @@
+#include "GLGeometryPages.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <float.h>
+
+namespace opengl {
+
+static const uint64_t PAGE_ALIGNMENT = 16;
+
+bool GLGeometryPages::Open(const std::string &pagePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options)
+{
+	Close();
+	std::ifstream file(pagePath, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file) {
+		return false;
+	}
+	uint64_t size = (uint64_t)file.tellg();
+	file.seekg(0);
+	if (size < sizeof(Header) || !file.read((char *)&_header, sizeof(Header))) {
+		return false;
+	}
+	bool valid = _header.magic == MAGIC
+		&& _header.version == VERSION
+		&& _header.vertexSize == sizeof(GLVertex)
+		&& _header.sourceHash == sourceHash
+		&& _header.importFlags == importFlags
+		&& _header.options == options
+		&& _header.tocOffset + (uint64_t)_header.numMeshes * sizeof(MeshEntry) + (uint64_t)_header.numPages * sizeof(PageEntry) <= size;
+	if (!valid) {
+		return false;
+	}
+	_meshes.resize(_header.numMeshes);
+	_pages.resize(_header.numPages);
+	file.seekg(_header.tocOffset);
+	if (!_meshes.empty()) {
+		file.read((char *)&_meshes[0], _meshes.size() * sizeof(MeshEntry));
+	}
+	if (!_pages.empty()) {
+		file.read((char *)&_pages[0], _pages.size() * sizeof(PageEntry));
+	}
+	if (!file) {
+		Close();
+		return false;
+	}
+	for (unsigned int i = 0; i < _meshes.size(); i++) {
+		if ((uint64_t)_meshes[i].firstPage + _meshes[i].numPages > _pages.size()) {
+			Close();
+			return false;
+		}
+	}
+	for (unsigned int i = 0; i < _pages.size(); i++) {
+		const PageEntry &page = _pages[i];
+		if (page.mesh >= _meshes.size() || page.numIndices > 3 * MAX_PAGE_TRIANGLES || page.numVertices > page.numIndices
+			|| page.offset + PageBytes(page) > _header.tocOffset) {
+			Close();
+			return false;
+		}
+	}
+	_path = pagePath;
+	_valid = true;
+	return true;
+}
+
+void GLGeometryPages::Close()
+{
+	_path.clear();
+	_meshes.clear();
+	_pages.clear();
+	_valid = false;
+}
+
+bool GLGeometryPages::IsOpen() const
+{
+	return _valid;
+}
+
+unsigned int GLGeometryPages::NumMeshes() const
+{
+	return (unsigned int)_meshes.size();
+}
+
+unsigned int GLGeometryPages::NumPages() const
+{
+	return (unsigned int)_pages.size();
+}
+
+const GLGeometryPages::MeshEntry &GLGeometryPages::GetMesh(unsigned int index) const
+{
+	return _meshes[index];
+}
+
+const GLGeometryPages::PageEntry &GLGeometryPages::GetPage(unsigned int index) const
+{
+	return _pages[index];
+}
+
+void GLGeometryPages::GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const
+{
+	minbb = glm::vec3(_header.minbb[0], _header.minbb[1], _header.minbb[2]);
+	maxbb = glm::vec3(_header.maxbb[0], _header.maxbb[1], _header.maxbb[2]);
+}
+
+size_t GLGeometryPages::PageBytes(const PageEntry &page)
+{
+	return page.numVertices * sizeof(GLVertex) + page.numIndices * sizeof(GLushort);
+}
+
+const std::string &GLGeometryPages::Path() const
+{
+	return _path;
+}
+
+bool GLGeometryPages::ReadPage(const std::string &pagePath, const PageEntry &page, std::vector<unsigned char> &data)
+{
+	std::ifstream file(pagePath, std::ios::in | std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	data.resize(PageBytes(page));
+	file.seekg(page.offset);
+	return (bool)file.read((char *)data.data(), data.size());
+}
+
+bool GLGeometryPageWriter::Begin(const std::string &pagePath)
+{
+	_meshes.clear();
+	_pages.clear();
+	_failed = false;
+	_file.open(pagePath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!_file) {
+		return false;
+	}
+	// a zeroed header keeps a half written file from ever being opened
+	GLGeometryPages::Header header;
+	std::memset(&header, 0, sizeof(header));
+	_file.write((const char *)&header, sizeof(header));
+	return _file.good();
+}
+
+void GLGeometryPageWriter::AddMesh(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices,
+	const std::vector<glm::vec3> &instances)
+{
+	GLGeometryPages::MeshEntry entry;
+	entry.firstPage = (uint32_t)_pages.size();
+	size_t numTriangles = numIndices / 3;
+	std::vector<uint32_t> triangles(numTriangles);
+	std::vector<glm::vec3> centroids(numTriangles);
+	size_t kept = 0;
+	for (size_t i = 0; i < numTriangles; i++) {
+		const GLuint *tri = indices + 3 * i;
+		if (tri[0] >= numVertices || tri[1] >= numVertices || tri[2] >= numVertices) {
+			continue;
+		}
+		triangles[kept] = (uint32_t)i;
+		centroids[i] = (vertices[tri[0]].Position + vertices[tri[1]].Position + vertices[tri[2]].Position) / 3.0f;
+		kept++;
+	}
+	_remap.assign(numVertices, UINT32_MAX);
+	for (size_t i = 0; i < std::max<size_t>(instances.size(), 1) && kept > 0; i++) {
+		_offset = instances.empty() ? glm::vec3(0.0f) : instances[i];
+		_Split(vertices, indices, triangles.data(), centroids.data(), 0, kept);
+	}
+	entry.numPages = (uint32_t)_pages.size() - entry.firstPage;
+	_meshes.push_back(entry);
+	std::vector<uint32_t>().swap(_remap);
+}
+
+void GLGeometryPageWriter::_Split(const GLVertex *vertices, const GLuint *indices, uint32_t *triangles, const glm::vec3 *centroids, size_t first, size_t last)
+{
+	if (last - first <= GLGeometryPages::MAX_PAGE_TRIANGLES) {
+		_WritePage(vertices, indices, triangles + first, last - first);
+		return;
+	}
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (size_t i = first; i < last; i++) {
+		lo = glm::min(lo, centroids[triangles[i]]);
+		hi = glm::max(hi, centroids[triangles[i]]);
+	}
+	glm::vec3 extent = hi - lo;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	size_t middle = first + (last - first) / 2;
+	std::nth_element(triangles + first, triangles + middle, triangles + last, [centroids, axis](uint32_t a, uint32_t b) {
+		return centroids[a][axis] < centroids[b][axis];
+	});
+	_Split(vertices, indices, triangles, centroids, first, middle);
+	_Split(vertices, indices, triangles, centroids, middle, last);
+}
+
+void GLGeometryPageWriter::_WritePage(const GLVertex *vertices, const GLuint *indices, const uint32_t *triangles, size_t numTriangles)
+{
+	_pageVertices.clear();
+	_pageIndices.clear();
+	glm::vec3 minbb(FLT_MAX), maxbb(-FLT_MAX);
+	for (size_t i = 0; i < numTriangles; i++) {
+		for (int j = 0; j < 3; j++) {
+			GLuint index = indices[3 * triangles[i] + j];
+			if (_remap[index] == UINT32_MAX) {
+				_remap[index] = (uint32_t)_pageVertices.size();
+				_pageVertices.push_back(vertices[index]);
+				_pageVertices.back().Position += _offset;
+				minbb = glm::min(minbb, _pageVertices.back().Position);
+				maxbb = glm::max(maxbb, _pageVertices.back().Position);
+			}
+			_pageIndices.push_back((GLushort)_remap[index]);
+		}
+	}
+	// the remap is shared by the whole mesh, only reset what this page used
+	for (size_t i = 0; i < numTriangles; i++) {
+		for (int j = 0; j < 3; j++) {
+			_remap[indices[3 * triangles[i] + j]] = UINT32_MAX;
+		}
+	}
+
+	const char padding[PAGE_ALIGNMENT] = { 0 };
+	uint64_t position = (uint64_t)_file.tellp();
+	uint64_t offset = (position + PAGE_ALIGNMENT - 1) & ~(PAGE_ALIGNMENT - 1);
+	_file.write(padding, offset - position);
+	GLGeometryPages::PageEntry page;
+	page.mesh = (uint32_t)_meshes.size();
+	page.numVertices = (uint32_t)_pageVertices.size();
+	page.numIndices = (uint32_t)_pageIndices.size();
+	page.reserved = 0;
+	page.offset = offset;
+	for (int i = 0; i < 3; i++) {
+		page.minbb[i] = minbb[i];
+		page.maxbb[i] = maxbb[i];
+	}
+	_file.write((const char *)_pageVertices.data(), _pageVertices.size() * sizeof(GLVertex));
+	_file.write((const char *)_pageIndices.data(), _pageIndices.size() * sizeof(GLushort));
+	_failed |= !_file.good();
+	_pages.push_back(page);
+}
+
+bool GLGeometryPageWriter::End(uint64_t sourceHash, unsigned int importFlags, unsigned int options, const glm::vec3 &minbb, const glm::vec3 &maxbb)
+{
+	GLGeometryPages::Header header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = GLGeometryPages::MAGIC;
+	header.version = GLGeometryPages::VERSION;
+	header.vertexSize = sizeof(GLVertex);
+	header.importFlags = importFlags;
+	header.sourceHash = sourceHash;
+	header.options = options;
+	header.numMeshes = (uint32_t)_meshes.size();
+	header.numPages = (uint32_t)_pages.size();
+	header.tocOffset = (uint64_t)_file.tellp();
+	for (int i = 0; i < 3; i++) {
+		header.minbb[i] = minbb[i];
+		header.maxbb[i] = maxbb[i];
+	}
+	if (!_meshes.empty()) {
+		_file.write((const char *)&_meshes[0], _meshes.size() * sizeof(GLGeometryPages::MeshEntry));
+	}
+	if (!_pages.empty()) {
+		_file.write((const char *)&_pages[0], _pages.size() * sizeof(GLGeometryPages::PageEntry));
+	}
+	_file.seekp(0);
+	_file.write((const char *)&header, sizeof(header));
+	bool ok = !_failed && _file.good();
+	_file.close();
+	_meshes.clear();
+	_pages.clear();
+	return ok;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+#ifndef GLGEOMETRYPAGES_HPP
+#define GLGEOMETRYPAGES_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLMesh.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace opengl {
+
+// Geometry of a model split into spatially compact pages that can be read on their own.
+// Every mesh is cut into pages of at most MAX_PAGE_TRIANGLES triangles, so a page's vertices
+// always fit 16-bit indices. Only the header and the table of contents stay in memory.
+//
+// Layout: Header | page data (GLVertex[numVertices], GLushort[numIndices], aligned) | MeshEntry[numMeshes] | PageEntry[numPages]
+class GLGeometryPages
+{
+public:
+	static const uint32_t MAGIC = 0x50475344; // "DSGP"
+	static const uint32_t VERSION = 2;
+	static const uint32_t MAX_PAGE_TRIANGLES = 16384;
+
+	struct Header
+	{
+		uint32_t magic; // zero until the file is complete
+		uint32_t version;
+		uint32_t vertexSize; // sizeof(GLVertex) when the pages were written
+		uint32_t importFlags;
+		uint64_t sourceHash; // content hash of the source model
+		uint32_t options;
+		uint32_t numMeshes;
+		uint32_t numPages;
+		uint32_t reserved;
+		uint64_t tocOffset;
+		float minbb[3], maxbb[3];
+	};
+
+	struct MeshEntry
+	{
+		uint32_t firstPage, numPages;
+	};
+
+	struct PageEntry
+	{
+		uint32_t mesh;
+		uint32_t numVertices, numIndices;
+		uint32_t reserved;
+		uint64_t offset; // vertices, followed by the indices
+		float minbb[3], maxbb[3];
+	};
+
+	GLGeometryPages() : _valid(false) {}
+	// Reads the table of contents and checks that the pages were built from the same source and options.
+	bool Open(const std::string &pagePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options);
+	void Close();
+	bool IsOpen() const;
+	unsigned int NumMeshes() const;
+	unsigned int NumPages() const;
+	const MeshEntry &GetMesh(unsigned int index) const;
+	const PageEntry &GetPage(unsigned int index) const;
+	void GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const;
+	static size_t PageBytes(const PageEntry &page);
+	const std::string &Path() const;
+	// Reads a page's vertices followed by its indices. Opens the file itself so any thread can call it.
+	static bool ReadPage(const std::string &pagePath, const PageEntry &page, std::vector<unsigned char> &data);
+
+private:
+	std::string _path;
+	Header _header;
+	std::vector<MeshEntry> _meshes;
+	std::vector<PageEntry> _pages;
+	bool _valid;
+};
+
+
+// Cuts meshes into pages and writes them out as they are added, so only one mesh's
+// bookkeeping is in memory at a time. The header is written last.
+class GLGeometryPageWriter
+{
+public:
+	GLGeometryPageWriter() : _offset(0.0f), _failed(false) {}
+	bool Begin(const std::string &pagePath);
+	// Instanced meshes are paged once per translation, pages have no instancing.
+	void AddMesh(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices,
+		const std::vector<glm::vec3> &instances = std::vector<glm::vec3>());
+	bool End(uint64_t sourceHash, unsigned int importFlags, unsigned int options, const glm::vec3 &minbb, const glm::vec3 &maxbb);
+
+private:
+	// splits triangles [first, last) at the median centroid of their longest axis until they fit a page.
+	void _Split(const GLVertex *vertices, const GLuint *indices, uint32_t *triangles, const glm::vec3 *centroids, size_t first, size_t last);
+	void _WritePage(const GLVertex *vertices, const GLuint *indices, const uint32_t *triangles, size_t numTriangles);
+
+	std::ofstream _file;
+	std::vector<GLGeometryPages::MeshEntry> _meshes;
+	std::vector<GLGeometryPages::PageEntry> _pages;
+	std::vector<uint32_t> _remap; // source vertex -> page vertex, UINT32_MAX when unused
+	std::vector<GLVertex> _pageVertices;
+	std::vector<GLushort> _pageIndices;
+	glm::vec3 _offset; // translation of the instance being paged
+	bool _failed;
+};
+
+} // namespace opengl
+#endif // GLGEOMETRYPAGES_HPP
\ No newline at end of file
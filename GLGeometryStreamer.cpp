@@ -0,0 +1,359 @@
+#include "GLGeometryStreamer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <float.h>
+#include <iostream>
+#include <iterator>
+
+namespace opengl {
+
+static constexpr uint32_t FEEDBACK_ID = UniformId("FeedbackId");
+
+// Returns false when the box's corners all lie outside the same frustum plane. nearest is the
+// smallest view depth (clip w) of any corner in front of the camera.
+static bool InFrustum(const glm::mat4 &transform, const float *minbb, const float *maxbb, float &nearest)
+{
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	nearest = FLT_MAX;
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 p = transform * glm::vec4(i & 1 ? maxbb[0] : minbb[0], i & 2 ? maxbb[1] : minbb[1], i & 4 ? maxbb[2] : minbb[2], 1.0f);
+		outside[0] += p.x < -p.w;
+		outside[1] += p.x > p.w;
+		outside[2] += p.y < -p.w;
+		outside[3] += p.y > p.w;
+		outside[4] += p.z < -p.w;
+		outside[5] += p.z > p.w;
+		nearest = std::min(nearest, std::max(p.w, 0.0f));
+	}
+	return std::find(outside, outside + 6, 8) == outside + 6;
+}
+
+// first fit from a free list of offset -> count
+static bool AllocateRange(std::map<size_t, size_t> &free, size_t count, size_t &offset)
+{
+	for (auto iter = free.begin(); iter != free.end(); iter++) {
+		if (iter->second >= count) {
+			offset = iter->first;
+			size_t rest = iter->second - count;
+			free.erase(iter);
+			if (rest > 0) {
+				free[offset + count] = rest;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+static void ReleaseRange(std::map<size_t, size_t> &free, size_t offset, size_t count)
+{
+	auto next = free.lower_bound(offset);
+	if (next != free.end() && offset + count == next->first) {
+		count += next->second;
+		next = free.erase(next);
+	}
+	if (next != free.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			prev->second += count;
+			return;
+		}
+	}
+	free[offset] = count;
+}
+
+static GLuint CreatePool(size_t size)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+GLGeometryStreamer::GLGeometryStreamer(ThreadPool &pool)
+	: _pool(pool), _vbo(0), _ebo(0), _maxVertices(0), _maxIndices(0), _residentBytes(0), _residentPages(0),
+	_frame(1), _generation(0), _fullFrame(0), _pendingLoads(0)
+{
+}
+
+GLGeometryStreamer::~GLGeometryStreamer()
+{
+	// loads still in flight hold on to this
+	_loads.Wait();
+	Close();
+}
+
+bool GLGeometryStreamer::Open(const std::string &pagePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options, size_t budget)
+{
+	Close();
+	if (!_pages.Open(pagePath, sourceHash, importFlags, options)) {
+		return false;
+	}
+	// split the budget the way the pages split their bytes, but always leave room for the largest page
+	size_t totalVertices = 0, totalIndices = 0, largestVertices = 0, largestIndices = 0;
+	for (unsigned int i = 0; i < _pages.NumPages(); i++) {
+		const GLGeometryPages::PageEntry &page = _pages.GetPage(i);
+		totalVertices += page.numVertices;
+		totalIndices += page.numIndices;
+		largestVertices = std::max<size_t>(largestVertices, page.numVertices);
+		largestIndices = std::max<size_t>(largestIndices, page.numIndices);
+	}
+	double vertexBytes = (double)totalVertices * sizeof(GLVertex);
+	double vertexShare = vertexBytes / std::max(1.0, vertexBytes + (double)totalIndices * sizeof(GLushort));
+	_maxVertices = std::min(totalVertices, (size_t)(budget * vertexShare / sizeof(GLVertex)));
+	_maxIndices = std::min(totalIndices, (size_t)(budget * (1.0 - vertexShare) / sizeof(GLushort)));
+	_maxVertices = std::max(std::max<size_t>(_maxVertices, largestVertices), (size_t)1);
+	_maxIndices = std::max(std::max<size_t>(_maxIndices, largestIndices), (size_t)1);
+
+	_vbo = CreatePool(_maxVertices * sizeof(GLVertex));
+	_ebo = CreatePool(_maxIndices * sizeof(GLushort));
+	_poolMesh.Load(_vbo, _ebo, 0, std::vector<GLTexture>());
+	_freeVertices[0] = _maxVertices;
+	_freeIndices[0] = _maxIndices;
+	Page page;
+	page.resident = false;
+	page.loading = false;
+	page.firstVertex = 0;
+	page.firstIndex = 0;
+	page.lastSeen = 0;
+	page.distance = 0.0f;
+	_state.assign(_pages.NumPages(), page);
+	_meshes.resize(_pages.NumMeshes());
+	for (unsigned int i = 0; i < _meshes.size(); i++) {
+		_meshes[i].feedbackId = 0;
+	}
+	_frame = 1;
+	_fullFrame = 0;
+	std::cout << "Streaming " << pagePath << ": " << _pages.NumPages() << " pages, "
+		<< (totalVertices * sizeof(GLVertex) + totalIndices * sizeof(GLushort)) / (1024.0 * 1024.0) << " MB through a "
+		<< (_maxVertices * sizeof(GLVertex) + _maxIndices * sizeof(GLushort)) / (1024.0 * 1024.0) << " MB pool" << std::endl;
+	return true;
+}
+
+void GLGeometryStreamer::Close()
+{
+	if (_vbo != 0) {
+		_poolMesh.Unload();
+		_poolMesh = GLMesh();
+		_vbo = 0;
+		_ebo = 0;
+	}
+	// reads that are still in flight are dropped when they finish
+	_generation++;
+	_pages.Close();
+	_state.clear();
+	_meshes.clear();
+	_freeVertices.clear();
+	_freeIndices.clear();
+	_residentBytes = 0;
+	_residentPages = 0;
+}
+
+unsigned int GLGeometryStreamer::NumMeshes() const
+{
+	return _pages.NumMeshes();
+}
+
+void GLGeometryStreamer::GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const
+{
+	_pages.GetAABB(minbb, maxbb);
+}
+
+void GLGeometryStreamer::SetMesh(unsigned int mesh, const std::vector<GLTexture> &textures, unsigned int feedbackId)
+{
+	if (mesh < _meshes.size()) {
+		_meshes[mesh].textures = textures;
+		_meshes[mesh].feedbackId = feedbackId;
+	}
+}
+
+void GLGeometryStreamer::Draw(const GLProgram &program, const glm::mat4 &viewProjModel)
+{
+	if (!_pages.IsOpen()) {
+		return;
+	}
+	glBindVertexArray(_poolMesh.Id());
+	for (unsigned int i = 0; i < _pages.NumMeshes(); i++) {
+		const GLGeometryPages::MeshEntry &mesh = _pages.GetMesh(i);
+		bool bound = false;
+		for (unsigned int j = mesh.firstPage; j < mesh.firstPage + mesh.numPages; j++) {
+			const GLGeometryPages::PageEntry &entry = _pages.GetPage(j);
+			Page &page = _state[j];
+			float distance;
+			if (!InFrustum(viewProjModel, entry.minbb, entry.maxbb, distance)) {
+				continue;
+			}
+			// a page seen by several draws in a frame keeps the nearest distance
+			page.distance = page.lastSeen == _frame ? std::min(page.distance, distance) : distance;
+			page.lastSeen = _frame;
+			if (!page.resident) {
+				continue;
+			}
+			if (!bound) {
+				GLMesh::BindTextures(program, _meshes[i].textures);
+				glUniform1ui(program.GetUniformLocation(FEEDBACK_ID), _meshes[i].feedbackId);
+				bound = true;
+			}
+			glDrawElementsBaseVertex(GL_TRIANGLES, entry.numIndices, GL_UNSIGNED_SHORT, (void*)(page.firstIndex * sizeof(GLushort)), (GLint)page.firstVertex);
+		}
+		if (bound) {
+			GLMesh::UnbindTextures(_meshes[i].textures);
+		}
+	}
+	glBindVertexArray(0);
+}
+
+void GLGeometryStreamer::Update(float budgetMs)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Ms;
+	Clock::time_point start = Clock::now();
+	for (;;) {
+		Load load;
+		{
+			std::lock_guard<std::mutex> lock(_finishedMutex);
+			if (_finished.empty()) {
+				break;
+			}
+			load = std::move(_finished.front());
+			_finished.pop_front();
+		}
+		_pendingLoads--;
+		_Apply(load);
+		if (Ms(Clock::now() - start).count() >= budgetMs) {
+			break;
+		}
+	}
+	if (!_pages.IsOpen()) {
+		return;
+	}
+
+	// the pages the last frame was missing, nearest first
+	if (_fullFrame == 0 || _frame - _fullFrame >= RETRY_AFTER_FULL_FRAMES) {
+		std::vector<unsigned int> requests;
+		for (unsigned int i = 0; i < _state.size(); i++) {
+			const Page &page = _state[i];
+			if (page.lastSeen == _frame && !page.resident && !page.loading) {
+				requests.push_back(i);
+			}
+		}
+		std::sort(requests.begin(), requests.end(), [this](unsigned int a, unsigned int b) {
+			return _state[a].distance < _state[b].distance;
+		});
+		for (unsigned int i = 0; i < requests.size() && _pendingLoads < MAX_PENDING_LOADS; i++) {
+			_QueueLoad(requests[i]);
+		}
+	}
+	_frame++;
+}
+
+size_t GLGeometryStreamer::ResidentBytes() const
+{
+	return _residentBytes;
+}
+
+unsigned int GLGeometryStreamer::NumResidentPages() const
+{
+	return _residentPages;
+}
+
+void GLGeometryStreamer::_QueueLoad(unsigned int index)
+{
+	_pendingLoads++;
+	_state[index].loading = true;
+	const std::string path = _pages.Path();
+	const GLGeometryPages::PageEntry entry = _pages.GetPage(index);
+	uint64_t generation = _generation;
+	_pool.Submit(_loads, [this, path, entry, index, generation] {
+		Load load;
+		load.page = index;
+		load.generation = generation;
+		load.ok = GLGeometryPages::ReadPage(path, entry, load.data);
+		std::lock_guard<std::mutex> lock(_finishedMutex);
+		_finished.push_back(std::move(load));
+	});
+}
+
+void GLGeometryStreamer::_Apply(const Load &load)
+{
+	if (load.generation != _generation) {
+		return; // closed while reading
+	}
+	Page &page = _state[load.page];
+	page.loading = false;
+	if (!load.ok) {
+		std::cout << "Failed to read geometry page " << load.page << std::endl;
+		return;
+	}
+	if (!_Allocate(load.page)) {
+		_fullFrame = _frame;
+		return;
+	}
+	const GLGeometryPages::PageEntry &entry = _pages.GetPage(load.page);
+	size_t vertexBytes = entry.numVertices * sizeof(GLVertex);
+	// bound through GL_COPY_WRITE_BUFFER so the vertex array's element binding is left alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _vbo);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, page.firstVertex * sizeof(GLVertex), vertexBytes, load.data.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _ebo);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, page.firstIndex * sizeof(GLushort), entry.numIndices * sizeof(GLushort), load.data.data() + vertexBytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	page.resident = true;
+	_residentBytes += GLGeometryPages::PageBytes(entry);
+	_residentPages++;
+}
+
+bool GLGeometryStreamer::_Allocate(unsigned int index)
+{
+	const GLGeometryPages::PageEntry &entry = _pages.GetPage(index);
+	Page &page = _state[index];
+	std::vector<unsigned int> candidates;
+	bool listed = false;
+	for (unsigned int next = 0;;) {
+		if (AllocateRange(_freeVertices, entry.numVertices, page.firstVertex)) {
+			if (AllocateRange(_freeIndices, entry.numIndices, page.firstIndex)) {
+				return true;
+			}
+			ReleaseRange(_freeVertices, page.firstVertex, entry.numVertices);
+		}
+		if (!listed) {
+			// least recently seen first, the farthest of those first; anything the last frame drew stays
+			for (unsigned int i = 0; i < _state.size(); i++) {
+				if (_state[i].resident && _state[i].lastSeen < _frame) {
+					candidates.push_back(i);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [this](unsigned int a, unsigned int b) {
+				if (_state[a].lastSeen != _state[b].lastSeen) {
+					return _state[a].lastSeen < _state[b].lastSeen;
+				}
+				return _state[a].distance > _state[b].distance;
+			});
+			listed = true;
+		}
+		if (next == candidates.size()) {
+			return false;
+		}
+		_Evict(candidates[next++]);
+	}
+}
+
+void GLGeometryStreamer::_Evict(unsigned int index)
+{
+	const GLGeometryPages::PageEntry &entry = _pages.GetPage(index);
+	Page &page = _state[index];
+	ReleaseRange(_freeVertices, page.firstVertex, entry.numVertices);
+	ReleaseRange(_freeIndices, page.firstIndex, entry.numIndices);
+	page.resident = false;
+	_residentBytes -= GLGeometryPages::PageBytes(entry);
+	_residentPages--;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef GLGEOMETRYSTREAMER_HPP
+#define GLGEOMETRYSTREAMER_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLMesh.hpp"
+#include "GLGeometryPages.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace opengl {
+
+// Draws a model whose geometry is only ever partly in memory, from a GLGeometryPages file.
+//
+// Draw() culls every page against the frustum and remembers the visible ones with their distance.
+// Update() reads the nearest missing pages on the pool and copies them into one vertex and one index
+// buffer of a fixed size, evicting the least recently seen pages when those are full. GPU memory is
+// the budget given to Open(), CPU memory the page table plus the few pages in flight, whatever the
+// size of the model. Only call it on the GL thread.
+class GLGeometryStreamer
+{
+public:
+	explicit GLGeometryStreamer(ThreadPool &pool);
+	~GLGeometryStreamer();
+	// Opens a page file and splits budget bytes between the vertex and the index pool.
+	bool Open(const std::string &pagePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options, size_t budget);
+	void Close();
+	unsigned int NumMeshes() const;
+	void GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const;
+	// Textures and feedback id the pages of a mesh are drawn with.
+	void SetMesh(unsigned int mesh, const std::vector<GLTexture> &textures, unsigned int feedbackId);
+	// Draws the resident pages inside the frustum of viewProjModel (projection * view * model).
+	void Draw(const GLProgram &program, const glm::mat4 &viewProjModel);
+	// Copies finished reads into the pools for at most budgetMs, then queues reads for the pages the last Draw() missed.
+	void Update(float budgetMs);
+	size_t ResidentBytes() const;
+	unsigned int NumResidentPages() const;
+
+private:
+	GLGeometryStreamer(const GLGeometryStreamer &) = delete;
+	GLGeometryStreamer &operator=(const GLGeometryStreamer &) = delete;
+
+	struct Page
+	{
+		bool resident, loading;
+		size_t firstVertex, firstIndex; // in the pools while resident
+		uint64_t lastSeen; // frame the page was last inside the frustum
+		float distance; // view depth of its nearest corner then
+	};
+	struct Mesh
+	{
+		std::vector<GLTexture> textures;
+		unsigned int feedbackId;
+	};
+	struct Load
+	{
+		unsigned int page;
+		uint64_t generation; // tells loads from a previous Open() apart
+		std::vector<unsigned char> data;
+		bool ok;
+	};
+
+	const unsigned int MAX_PENDING_LOADS = 8;
+	const uint64_t RETRY_AFTER_FULL_FRAMES = 30; // stop reading pages for a while when the visible ones don't fit
+
+	void _QueueLoad(unsigned int index);
+	void _Apply(const Load &load);
+	// evicts the least recently seen pages that weren't drawn last frame until the pools have room
+	// for the page; false if they don't even then.
+	bool _Allocate(unsigned int index);
+	void _Evict(unsigned int index);
+
+	ThreadPool &_pool;
+	TaskGroup _loads; // the reads this streamer queued on the shared pool
+	GLGeometryPages _pages;
+	std::vector<Page> _state; // by page
+	std::vector<Mesh> _meshes;
+	GLMesh _poolMesh; // owns the pool buffers, drawn through its vertex array only
+	GLuint _vbo, _ebo;
+	size_t _maxVertices, _maxIndices; // pool capacities
+	std::map<size_t, size_t> _freeVertices, _freeIndices; // offset -> count, merged on release
+	size_t _residentBytes;
+	unsigned int _residentPages;
+	uint64_t _frame;
+	uint64_t _generation;
+	uint64_t _fullFrame; // last frame a page didn't fit
+	unsigned int _pendingLoads;
+	std::deque<Load> _finished;
+	std::mutex _finishedMutex;
+};
+
+} // namespace opengl
+#endif // GLGEOMETRYSTREAMER_HPP
\ No newline at end of file
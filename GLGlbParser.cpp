@@ -0,0 +1,492 @@
+#include "GLGlbParser.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace opengl {
+
+static const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+static const uint32_t GLB_VERSION = 2;
+static const uint32_t CHUNK_JSON = 0x4E4F534A;
+static const uint32_t CHUNK_BIN = 0x004E4942;
+static const int MAX_JSON_DEPTH = 64;
+
+// just enough JSON for a glTF header
+struct JsonValue
+{
+	enum Type { Null, Bool, Number, String, Array, Object };
+	Type type;
+	double number;
+	std::string string;
+	std::vector<JsonValue> items; // array elements, or object values in the order of keys
+	std::vector<std::string> keys;
+
+	JsonValue() : type(Null), number(0.0) {}
+
+	const JsonValue *Get(const char *key) const
+	{
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (keys[i] == key) {
+				return &items[i];
+			}
+		}
+		return nullptr;
+	}
+
+	const JsonValue *At(int index) const
+	{
+		return type == Array && index >= 0 && (size_t)index < items.size() ? &items[index] : nullptr;
+	}
+
+	double Double(const char *key, double fallback) const
+	{
+		const JsonValue *value = Get(key);
+		return value != nullptr && value->type == Number ? value->number : fallback;
+	}
+
+	int Int(const char *key, int fallback) const
+	{
+		return (int)Double(key, fallback);
+	}
+
+	size_t Size(const char *key) const
+	{
+		const JsonValue *value = Get(key);
+		return value != nullptr && value->type == Array ? value->items.size() : 0;
+	}
+};
+
+static const char *SkipSpace(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+		p++;
+	}
+	return p;
+}
+
+static void AppendUtf8(std::string &out, unsigned int c)
+{
+	if (c < 0x80) {
+		out += (char)c;
+	}
+	else if (c < 0x800) {
+		out += (char)(0xC0 | (c >> 6));
+		out += (char)(0x80 | (c & 0x3F));
+	}
+	else {
+		out += (char)(0xE0 | (c >> 12));
+		out += (char)(0x80 | ((c >> 6) & 0x3F));
+		out += (char)(0x80 | (c & 0x3F));
+	}
+}
+
+// p points at the opening quote
+static bool ParseString(const char *&p, const char *end, std::string &out)
+{
+	p++;
+	while (p < end && *p != '"') {
+		if (*p != '\\') {
+			out += *p++;
+			continue;
+		}
+		if (++p >= end) {
+			return false;
+		}
+		char c = *p++;
+		switch (c) {
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'u': {
+			if (end - p < 4) {
+				return false;
+			}
+			char hex[5] = { p[0], p[1], p[2], p[3], 0 };
+			// surrogate pairs come out as two separate characters, nothing here needs them
+			AppendUtf8(out, (unsigned int)std::strtoul(hex, nullptr, 16));
+			p += 4;
+			break;
+		}
+		default: out += c; break;
+		}
+	}
+	if (p >= end) {
+		return false;
+	}
+	p++;
+	return true;
+}
+
+static bool ParseValue(const char *&p, const char *end, JsonValue &value, int depth)
+{
+	p = SkipSpace(p, end);
+	if (p >= end || depth > MAX_JSON_DEPTH) {
+		return false;
+	}
+	if (*p == '{' || *p == '[') {
+		bool object = *p == '{';
+		char close = object ? '}' : ']';
+		value.type = object ? JsonValue::Object : JsonValue::Array;
+		p = SkipSpace(p + 1, end);
+		if (p < end && *p == close) {
+			p++;
+			return true;
+		}
+		for (;;) {
+			if (object) {
+				p = SkipSpace(p, end);
+				value.keys.push_back(std::string());
+				if (p >= end || *p != '"' || !ParseString(p, end, value.keys.back())) {
+					return false;
+				}
+				p = SkipSpace(p, end);
+				if (p >= end || *p != ':') {
+					return false;
+				}
+				p++;
+			}
+			value.items.push_back(JsonValue());
+			if (!ParseValue(p, end, value.items.back(), depth + 1)) {
+				return false;
+			}
+			p = SkipSpace(p, end);
+			if (p < end && *p == ',') {
+				p++;
+			}
+			else if (p < end && *p == close) {
+				p++;
+				return true;
+			}
+			else {
+				return false;
+			}
+		}
+	}
+	if (*p == '"') {
+		value.type = JsonValue::String;
+		return ParseString(p, end, value.string);
+	}
+	if (end - p >= 4 && std::memcmp(p, "true", 4) == 0) {
+		value.type = JsonValue::Bool;
+		value.number = 1.0;
+		p += 4;
+		return true;
+	}
+	if (end - p >= 5 && std::memcmp(p, "false", 5) == 0) {
+		value.type = JsonValue::Bool;
+		p += 5;
+		return true;
+	}
+	if (end - p >= 4 && std::memcmp(p, "null", 4) == 0) {
+		p += 4;
+		return true;
+	}
+	// the chunk isn't null terminated, so copy the number out for strtod
+	char number[64];
+	size_t len = 0;
+	while (p + len < end && len < sizeof(number) - 1 && std::strchr("+-0123456789.eE", p[len]) != nullptr) {
+		number[len] = p[len];
+		len++;
+	}
+	if (len == 0) {
+		return false;
+	}
+	number[len] = 0;
+	value.type = JsonValue::Number;
+	value.number = std::strtod(number, nullptr);
+	p += len;
+	return true;
+}
+
+// undoes the percent encoding of relative URIs
+static std::string DecodeUri(const std::string &uri)
+{
+	std::string out;
+	for (size_t i = 0; i < uri.length(); i++) {
+		if (uri[i] == '%' && i + 2 < uri.length()) {
+			char hex[3] = { uri[i + 1], uri[i + 2], 0 };
+			out += (char)std::strtoul(hex, nullptr, 16);
+			i += 2;
+		}
+		else {
+			out += uri[i];
+		}
+	}
+	return out;
+}
+
+static GLint ComponentCount(const std::string &type)
+{
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	return 0;
+}
+
+// glTF uses the GL enums for its component types
+static size_t ComponentBytes(GLenum type)
+{
+	switch (type) {
+	case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+	case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+	case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+	default: return 0;
+	}
+}
+
+// resolves an accessor to a view, offset and format and checks that all count elements lie inside the view
+static bool ReadAccessor(const JsonValue &root, const GLGlbModel &model, int index, GLGlbModel::Attribute &attribute, size_t &count, const JsonValue *&accessor)
+{
+	const JsonValue *accessors = root.Get("accessors");
+	accessor = accessors != nullptr ? accessors->At(index) : nullptr;
+	if (accessor == nullptr || accessor->Get("sparse") != nullptr) {
+		return false;
+	}
+	const JsonValue *type = accessor->Get("type");
+	attribute.view = accessor->Int("bufferView", -1);
+	attribute.offset = (size_t)accessor->Double("byteOffset", 0.0);
+	attribute.size = type != nullptr ? ComponentCount(type->string) : 0;
+	attribute.type = (GLenum)accessor->Int("componentType", 0);
+	const JsonValue *normalized = accessor->Get("normalized");
+	attribute.normalized = normalized != nullptr && normalized->number != 0.0 ? GL_TRUE : GL_FALSE;
+	count = (size_t)accessor->Double("count", 0.0);
+	size_t componentBytes = ComponentBytes(attribute.type);
+	if (attribute.view < 0 || (size_t)attribute.view >= model.views.size() || attribute.size == 0 || componentBytes == 0
+		|| attribute.offset % componentBytes != 0) {
+		return false;
+	}
+	const JsonValue *view = root.Get("bufferViews")->At(attribute.view);
+	attribute.stride = (GLsizei)view->Int("byteStride", 0);
+	size_t elementBytes = attribute.size * componentBytes;
+	size_t stride = attribute.stride != 0 ? (size_t)attribute.stride : elementBytes;
+	return count == 0 || attribute.offset + (count - 1) * stride + elementBytes <= model.views[attribute.view].size;
+}
+
+static bool ReadPrimitive(const JsonValue &root, const unsigned char *data, const JsonValue &primitive, GLGlbModel &model)
+{
+	if (primitive.Int("mode", 4) != 4) {
+		return false;
+	}
+	GLGlbModel::Primitive newPrimitive;
+	newPrimitive.material = primitive.Int("material", -1);
+	if (newPrimitive.material >= (int)model.materials.size()) {
+		return false;
+	}
+	const JsonValue *attributes = primitive.Get("attributes");
+	if (attributes == nullptr) {
+		return false;
+	}
+	const char *names[GLMesh::NUM_ATTRIBUTES - 1] = { "POSITION", "NORMAL", "TEXCOORD_0", "TANGENT" };
+	size_t numVertices = 0;
+	for (unsigned int i = 0; i < GLMesh::NUM_ATTRIBUTES; i++) {
+		GLGlbModel::Attribute &attribute = newPrimitive.attributes[i];
+		attribute.view = -1;
+		if (i == GLMesh::NUM_ATTRIBUTES - 1 || attributes->Get(names[i]) == nullptr) {
+			continue;
+		}
+		size_t count;
+		const JsonValue *accessor;
+		if (!ReadAccessor(root, model, attributes->Int(names[i], -1), attribute, count, accessor)) {
+			return false;
+		}
+		if (i == 0) {
+			const JsonValue *minValue = accessor->Get("min");
+			const JsonValue *maxValue = accessor->Get("max");
+			if (minValue == nullptr || maxValue == nullptr || minValue->items.size() != 3 || maxValue->items.size() != 3) {
+				return false;
+			}
+			for (int j = 0; j < 3; j++) {
+				newPrimitive.minbb[j] = (float)minValue->items[j].number;
+				newPrimitive.maxbb[j] = (float)maxValue->items[j].number;
+			}
+			numVertices = count;
+		}
+		// texture coordinates may be normalized integers, everything else has to be float
+		bool validType = attribute.type == GL_FLOAT
+			|| (i == 2 && attribute.normalized && (attribute.type == GL_UNSIGNED_BYTE || attribute.type == GL_UNSIGNED_SHORT));
+		GLint sizes[GLMesh::NUM_ATTRIBUTES - 1] = { 3, 3, 2, 4 };
+		if (!validType || attribute.size != sizes[i] || count != numVertices) {
+			return false;
+		}
+	}
+	if (newPrimitive.attributes[0].view < 0 || newPrimitive.attributes[1].view < 0) {
+		return false;
+	}
+	if (newPrimitive.material >= 0 && model.materials[newPrimitive.material].normalImage >= 0 && newPrimitive.attributes[3].view < 0) {
+		return false;
+	}
+
+	const JsonValue *accessor;
+	GLGlbModel::Attribute &indices = newPrimitive.indices;
+	if (primitive.Get("indices") == nullptr || !ReadAccessor(root, model, primitive.Int("indices", -1), indices, newPrimitive.numIndices, accessor)
+		|| indices.size != 1 || indices.stride != 0 || indices.type == GL_BYTE || indices.type == GL_SHORT || indices.type == GL_FLOAT) {
+		return false;
+	}
+	// GL doesn't check the indices, so make sure none of them reads past the vertices
+	const unsigned char *src = data + model.views[indices.view].offset + indices.offset;
+	size_t maxIndex = 0;
+	for (size_t i = 0; i < newPrimitive.numIndices; i++) {
+		size_t index;
+		if (indices.type == GL_UNSIGNED_BYTE) {
+			index = src[i];
+		}
+		else if (indices.type == GL_UNSIGNED_SHORT) {
+			index = ((const uint16_t *)src)[i];
+		}
+		else {
+			index = ((const uint32_t *)src)[i];
+		}
+		maxIndex = index > maxIndex ? index : maxIndex;
+	}
+	if (newPrimitive.numIndices > 0 && maxIndex >= numVertices) {
+		return false;
+	}
+	model.primitives.push_back(newPrimitive);
+	return true;
+}
+
+static bool ReadMesh(const JsonValue &root, const unsigned char *data, int index, GLGlbModel &model)
+{
+	const JsonValue *meshes = root.Get("meshes");
+	const JsonValue *mesh = meshes != nullptr ? meshes->At(index) : nullptr;
+	const JsonValue *primitives = mesh != nullptr ? mesh->Get("primitives") : nullptr;
+	if (primitives == nullptr) {
+		return false;
+	}
+	for (size_t i = 0; i < primitives->items.size(); i++) {
+		if (!ReadPrimitive(root, data, primitives->items[i], model)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// depth guards against cycles, a valid hierarchy can't be deeper than the number of nodes
+static bool ReadNode(const JsonValue &root, const unsigned char *data, int index, size_t depth, GLGlbModel &model)
+{
+	const JsonValue *nodes = root.Get("nodes");
+	const JsonValue *node = nodes != nullptr ? nodes->At(index) : nullptr;
+	if (node == nullptr || depth > nodes->items.size()) {
+		return false;
+	}
+	if (node->Get("mesh") != nullptr && !ReadMesh(root, data, node->Int("mesh", -1), model)) {
+		return false;
+	}
+	const JsonValue *children = node->Get("children");
+	for (size_t i = 0; children != nullptr && i < children->items.size(); i++) {
+		if (!ReadNode(root, data, (int)children->items[i].number, depth + 1, model)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// textures only add a sampler on top of an image
+static int TextureImage(const JsonValue &root, const JsonValue *textureInfo)
+{
+	const JsonValue *textures = root.Get("textures");
+	const JsonValue *texture = textureInfo != nullptr && textures != nullptr ? textures->At(textureInfo->Int("index", -1)) : nullptr;
+	int image = texture != nullptr ? texture->Int("source", -1) : -1;
+	return image < (int)root.Size("images") ? image : -1;
+}
+
+bool GLGlbParser::Parse(const unsigned char *data, size_t size, GLGlbModel &model)
+{
+	// 12 byte header, then the JSON chunk and an optional BIN chunk, each behind an 8 byte chunk header
+	uint32_t header[5];
+	if (size < sizeof(header)) {
+		return false;
+	}
+	std::memcpy(header, data, sizeof(header));
+	size_t length = header[2];
+	if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION || length > size || header[4] != CHUNK_JSON || 20 + (size_t)header[3] > length) {
+		return false;
+	}
+	size_t binOffset = 0, binSize = 0;
+	size_t next = (20 + (size_t)header[3] + 3) & ~(size_t)3;
+	if (next + 8 <= length) {
+		uint32_t chunk[2];
+		std::memcpy(chunk, data + next, sizeof(chunk));
+		if (chunk[1] == CHUNK_BIN && next + 8 + chunk[0] <= length) {
+			binOffset = next + 8;
+			binSize = chunk[0];
+		}
+	}
+	JsonValue root;
+	const char *p = (const char *)data + 20;
+	if (!ParseValue(p, p + header[3], root, 0) || root.type != JsonValue::Object || root.Size("extensionsRequired") > 0) {
+		return false;
+	}
+
+	// only the buffer stored in the BIN chunk can be read in place
+	const JsonValue *buffers = root.Get("buffers");
+	for (size_t i = 0; buffers != nullptr && i < buffers->items.size(); i++) {
+		if (buffers->items[i].Get("uri") != nullptr || (size_t)buffers->items[i].Double("byteLength", 0.0) > binSize) {
+			return false;
+		}
+	}
+	const JsonValue *views = root.Get("bufferViews");
+	for (size_t i = 0; views != nullptr && i < views->items.size(); i++) {
+		const JsonValue &view = views->items[i];
+		GLGlbModel::View newView;
+		newView.offset = (size_t)view.Double("byteOffset", 0.0);
+		newView.size = (size_t)view.Double("byteLength", 0.0);
+		if (view.Int("buffer", -1) != 0 || newView.offset + newView.size > binSize) {
+			return false;
+		}
+		newView.offset += binOffset;
+		model.views.push_back(newView);
+	}
+
+	const JsonValue *images = root.Get("images");
+	for (size_t i = 0; images != nullptr && i < images->items.size(); i++) {
+		const JsonValue &image = images->items[i];
+		const JsonValue *uri = image.Get("uri");
+		GLGlbModel::Image newImage;
+		newImage.view = image.Int("bufferView", -1);
+		if (uri != nullptr) {
+			if (uri->string.compare(0, 5, "data:") == 0) {
+				return false;
+			}
+			newImage.uri = DecodeUri(uri->string);
+		}
+		else if (newImage.view < 0 || (size_t)newImage.view >= model.views.size()) {
+			return false;
+		}
+		model.images.push_back(newImage);
+	}
+	const JsonValue *materials = root.Get("materials");
+	for (size_t i = 0; materials != nullptr && i < materials->items.size(); i++) {
+		const JsonValue &material = materials->items[i];
+		const JsonValue *pbr = material.Get("pbrMetallicRoughness");
+		GLGlbModel::Material newMaterial;
+		newMaterial.diffuseImage = TextureImage(root, pbr != nullptr ? pbr->Get("baseColorTexture") : nullptr);
+		newMaterial.normalImage = TextureImage(root, material.Get("normalTexture"));
+		model.materials.push_back(newMaterial);
+	}
+
+	// meshes are visited through the scene like assimp's node walk does, files without one list them directly
+	const JsonValue *scenes = root.Get("scenes");
+	const JsonValue *scene = scenes != nullptr ? scenes->At(root.Int("scene", 0)) : nullptr;
+	if (scene != nullptr) {
+		const JsonValue *nodes = scene->Get("nodes");
+		for (size_t i = 0; nodes != nullptr && i < nodes->items.size(); i++) {
+			if (!ReadNode(root, data, (int)nodes->items[i].number, 0, model)) {
+				return false;
+			}
+		}
+	}
+	else {
+		for (size_t i = 0; i < root.Size("meshes"); i++) {
+			if (!ReadMesh(root, data, (int)i, model)) {
+				return false;
+			}
+		}
+	}
+	return !model.primitives.empty();
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef GLGLBPARSER_HPP
+#define GLGLBPARSER_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLMesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace opengl {
+
+// Layout of a glTF 2.0 binary (.glb). Nothing is copied out of the file: vertex and index data
+// are described by offsets into it, in the component types they are stored with, so the buffer
+// views can be handed to GL as they are.
+struct GLGlbModel
+{
+	struct View
+	{
+		size_t offset, size; // bytes from the start of the file
+	};
+	struct Attribute
+	{
+		int view; // index into views, -1 when the primitive doesn't have the attribute
+		size_t offset; // bytes into the view
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		GLsizei stride; // zero when tightly packed
+	};
+	struct Primitive
+	{
+		// POSITION, NORMAL, TEXCOORD_0 and TANGENT at the GLMesh attribute locations, the bitangent is never set
+		Attribute attributes[GLMesh::NUM_ATTRIBUTES];
+		Attribute indices;
+		size_t numIndices;
+		int material; // index into materials, -1 without one
+		glm::vec3 minbb, maxbb;
+	};
+	struct Material
+	{
+		int diffuseImage, normalImage; // indices into images, -1 without one
+	};
+	// either a file next to the model or a view holding the encoded bytes
+	struct Image
+	{
+		std::string uri;
+		int view;
+	};
+	std::vector<View> views;
+	std::vector<Primitive> primitives; // in scene order, once per node that uses the mesh
+	std::vector<Material> materials;
+	std::vector<Image> images;
+};
+
+// Reads the JSON chunk of a glTF binary. Node transforms are ignored like they are for the other formats.
+class GLGlbParser
+{
+public:
+	// Fails on anything the data can't be used in place for so the caller can fall back to assimp:
+	// required extensions, buffers outside the file, sparse accessors, primitives that aren't
+	// indexed triangles, missing normals, and normal mapped materials without tangents.
+	static bool Parse(const unsigned char *data, size_t size, GLGlbModel &model);
+};
+
+} // namespace opengl
+#endif // GLGLBPARSER_HPP
\ No newline at end of file
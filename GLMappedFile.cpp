@@ -0,0 +1,128 @@
+#include "GLMappedFile.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace opengl {
+
+#ifdef _WIN32
+
+GLMappedFile::GLMappedFile()
+	: _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+{
+}
+
+bool GLMappedFile::Open(const std::string &path)
+{
+	Close();
+	_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mapping == nullptr) {
+		Close();
+		return false;
+	}
+	_data = (const unsigned char *)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (_data == nullptr) {
+		Close();
+		return false;
+	}
+	_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void GLMappedFile::Close()
+{
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping != nullptr) {
+		CloseHandle(_mapping);
+	}
+	if (_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(_file);
+	}
+	_data = nullptr;
+	_size = 0;
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+GLMappedFile::GLMappedFile()
+	: _data(nullptr), _size(0), _fd(-1)
+{
+}
+
+bool GLMappedFile::Open(const std::string &path)
+{
+	Close();
+	_fd = open(path.c_str(), O_RDONLY);
+	if (_fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(_fd, &st) != 0 || st.st_size == 0) {
+		Close();
+		return false;
+	}
+	void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (data == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	_data = (const unsigned char *)data;
+	_size = (size_t)st.st_size;
+	return true;
+}
+
+void GLMappedFile::Close()
+{
+	if (_data != nullptr) {
+		munmap((void *)_data, _size);
+	}
+	if (_fd >= 0) {
+		close(_fd);
+	}
+	_data = nullptr;
+	_size = 0;
+	_fd = -1;
+}
+
+#endif
+
+GLMappedFile::~GLMappedFile()
+{
+	Close();
+}
+
+bool GLMappedFile::IsOpen() const
+{
+	return _data != nullptr;
+}
+
+const unsigned char *GLMappedFile::Data() const
+{
+	return _data;
+}
+
+size_t GLMappedFile::Size() const
+{
+	return _size;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef GLMAPPEDFILE_HPP
+#define GLMAPPEDFILE_HPP
+
+#include <string>
+#include <cstddef>
+
+namespace opengl {
+
+// Read-only view of an entire file mapped into memory.
+// The data stays valid until Close() is called or the object is destroyed.
+class GLMappedFile
+{
+public:
+	GLMappedFile();
+	~GLMappedFile();
+	bool Open(const std::string &path);
+	void Close();
+	bool IsOpen() const;
+	const unsigned char *Data() const;
+	size_t Size() const;
+
+private:
+	GLMappedFile(const GLMappedFile &) = delete;
+	GLMappedFile &operator=(const GLMappedFile &) = delete;
+
+	const unsigned char *_data;
+	size_t _size;
+#ifdef _WIN32
+	void *_file;
+	void *_mapping;
+#else
+	int _fd;
+#endif
+};
+
+} // namespace opengl
+#endif // GLMAPPEDFILE_HPP
\ No newline at end of file
@@ -64,7 +64,7 @@ public:
 	const glm::mat4 &ModelMatrix() const;
 	const glm::mat4 &ViewMatrix() const;
 	const glm::mat4 &ProjMatrix () const;
-	const glm::mat4 &NormalMatrix() const;
+	const glm::mat3 &NormalMatrix() const;
 	glm::vec3 GetPosition() const;
 	glm::vec3 GetDirection() const;
 	void GetCamera(glm::vec3 &position, glm::vec3 &direction) const;
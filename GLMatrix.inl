@@ -62,7 +62,7 @@ inline const glm::mat4 &GLMatrix::ProjMatrix() const
 	return _projMatrix;
 }
 
-inline const glm::mat4 &GLMatrix::NormalMatrix() const
+inline const glm::mat3 &GLMatrix::NormalMatrix() const
 {
 	return _normalMatrix;
 }
@@ -1,33 +1,73 @@
 //SOURCE: https://learnopengl.com/code_viewer_gh.php?code=includes/learnopengl/mesh.h
 
 #include "GLMesh.hpp"
+#include <algorithm>
 
 namespace opengl {
 
-void GLMesh::Draw(GLuint shaderID) const
+// texture_diffuse1 to texture_diffuse4 and so on, the most any G-buffer shader declares
+static const unsigned int MAX_TEXTURES_PER_TYPE = 4;
+static constexpr uint32_t DIFFUSE_IDS[MAX_TEXTURES_PER_TYPE] = {
+	UniformId("texture_diffuse1"), UniformId("texture_diffuse2"), UniformId("texture_diffuse3"), UniformId("texture_diffuse4") };
+static constexpr uint32_t SPECULAR_IDS[MAX_TEXTURES_PER_TYPE] = {
+	UniformId("texture_specular1"), UniformId("texture_specular2"), UniformId("texture_specular3"), UniformId("texture_specular4") };
+static constexpr uint32_t NORMAL_IDS[MAX_TEXTURES_PER_TYPE] = {
+	UniformId("texture_normal1"), UniformId("texture_normal2"), UniformId("texture_normal3"), UniformId("texture_normal4") };
+static constexpr uint32_t FEEDBACK_ID = UniformId("FeedbackId");
+
+void GLMesh::Draw(const GLProgram &program) const
+{
+	BindTextures(program, _textures);
+
+	glUniform1ui(program.GetUniformLocation(FEEDBACK_ID), _feedbackId);
+
+	// draw mesh
+	glBindVertexArray(_vao);
+	if (_numInstances > 1) {
+		glDrawElementsInstanced(GL_TRIANGLES, _numTriangles, _indexType, (void*)_indexOffset, _numInstances);
+	}
+	else {
+		glDrawElements(GL_TRIANGLES, _numTriangles, _indexType, (void*)_indexOffset);
+	}
+	glBindVertexArray(0);
+
+	UnbindTextures(_textures);
+}
+
+void GLMesh::BindTextures(const GLProgram &program, const std::vector<GLTexture> &textures)
 {
 	// bind appropriate textures
 	unsigned int diffuseNr = 1;
 	unsigned int specularNr = 1;
 	unsigned int normalNr = 1;
 	unsigned int heightNr = 1;
-	for (unsigned int i = 0; i < _textures.size(); ++i) {
+	for (unsigned int i = 0; i < textures.size(); ++i) {
 		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
 		// retrieve texture number (the N in diffuse_textureN)
-		std::string name;
-		if (_textures[i].type == TextureType::Diffuse) {
-			name = "texture_diffuse" + std::to_string(diffuseNr);
+		uint32_t id;
+		// packed textures take the diffuse slot, the shader reads the specular intensity from its alpha
+		if (textures[i].type == TextureType::Diffuse || textures[i].type == TextureType::DiffuseSpecular) {
+			if (diffuseNr > MAX_TEXTURES_PER_TYPE) {
+				continue;
+			}
+			id = DIFFUSE_IDS[diffuseNr - 1];
 			diffuseNr++;
 		}
-		else if (_textures[i].type == TextureType::Specular) {
-			name = "texture_specular" + std::to_string(specularNr);
+		else if (textures[i].type == TextureType::Specular) {
+			if (specularNr > MAX_TEXTURES_PER_TYPE) {
+				continue;
+			}
+			id = SPECULAR_IDS[specularNr - 1];
 			specularNr++;
 		}
-		else if (_textures[i].type == TextureType::Normal) {
-			name = "texture_normal" + std::to_string(normalNr);
+		else if (textures[i].type == TextureType::Normal) {
+			if (normalNr > MAX_TEXTURES_PER_TYPE) {
+				continue;
+			}
+			id = NORMAL_IDS[normalNr - 1];
 			normalNr++;
 		}
-		else if (_textures[i].type == TextureType::Height) {
+		else if (textures[i].type == TextureType::Height) {
 			//name = "texture_height" + std::to_string(heightNr);
 			//heightNr++;
 			continue;
@@ -36,19 +76,17 @@ void GLMesh::Draw(GLuint shaderID) const
 			continue; //invalid texture
 		}
 		// now set the sampler to the correct texture unit
-		glUniform1i(glGetUniformLocation(shaderID, name.c_str()), i);
+		glUniform1i(program.GetUniformLocation(id), i);
 		// and finally bind the texture
-		glBindTexture(GL_TEXTURE_2D, _textures[i].id);
+		glBindTexture(GL_TEXTURE_2D, textures[i].id);
 	}
+}
 
-	// draw mesh
-	glBindVertexArray(_vao);
-	glDrawElements(GL_TRIANGLES, _numTriangles, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
-
+void GLMesh::UnbindTextures(const std::vector<GLTexture> &textures)
+{
 	// set everything back to defaults
-	for (unsigned int i = 0; i < _textures.size(); ++i) {
-		glActiveTexture(_textures[i].id);
+	for (unsigned int i = 0; i < textures.size(); ++i) {
+		glActiveTexture(textures[i].id);
 		glBindTexture(GL_TEXTURE_2D, 0); // default black texture
 	}
 	//glActiveTexture(GL_TEXTURE0);
@@ -56,26 +94,74 @@ void GLMesh::Draw(GLuint shaderID) const
 
 void GLMesh::Load(const std::vector<GLVertex> &vertices, const std::vector<GLuint> &indices, const std::vector<GLTexture> &textures)
 {
-	//this->vertices = vertices;
-	//this->indices = indices;
-	_textures = textures;
-	_numTriangles = indices.size();
+	Load(vertices.data(), vertices.size(), indices.data(), indices.size(), textures);
+}
 
-	// create buffers/arrays
-	glGenVertexArrays(1, &_vao);
-	glGenBuffers(1, &_vbo);
-	glGenBuffers(1, &_ebo);
+void GLMesh::Load(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices, const std::vector<GLTexture> &textures)
+{
+	GLuint vbo, ebo;
+	CreateBuffers(vertices, numVertices, indices, numIndices, vbo, ebo);
+	Load(vbo, ebo, numIndices, textures);
+}
+
+void GLMesh::CreateBuffers(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices, GLuint &vbo, GLuint &ebo)
+{
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
 
-	glBindVertexArray(_vao);
 	// load data into vertex buffers
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	// A great thing about structs is that their memory layout is sequential for all its items.
 	// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
 	// again translates to 3/2 floats which translates to a byte array.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLVertex), &vertices[0], GL_STATIC_DRAW);
+	// The geometry never changes after loading, so prefer immutable storage when the driver has it.
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_ARRAY_BUFFER, numVertices * sizeof(GLVertex), vertices, 0);
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(GLVertex), vertices, GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// bound through GL_COPY_WRITE_BUFFER so no vertex array's element binding is touched
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_COPY_WRITE_BUFFER, numIndices * sizeof(GLuint), indices, 0);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, numIndices * sizeof(GLuint), indices, GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+GLuint GLMesh::CreateBuffer(const void *data, size_t size)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, 0);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+void GLMesh::Load(GLuint vbo, GLuint ebo, size_t numIndices, const std::vector<GLTexture> &textures)
+{
+	_textures = textures;
+	_numTriangles = numIndices;
+	_vbo = vbo;
+	_ebo = ebo;
+	_indexType = GL_UNSIGNED_INT;
+	_indexOffset = 0;
 
+	glGenVertexArrays(1, &_vao);
+	glBindVertexArray(_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
 	// set the vertex attribute pointers
 	// vertex Positions
@@ -97,11 +183,57 @@ void GLMesh::Load(const std::vector<GLVertex> &vertices, const std::vector<GLuin
 	glBindVertexArray(0);
 }
 
+void GLMesh::Load(const GLVertexAttribute attributes[NUM_ATTRIBUTES], GLuint ebo, GLenum indexType, size_t indexOffset, size_t numIndices, const std::vector<GLTexture> &textures)
+{
+	_textures = textures;
+	_numTriangles = numIndices;
+	// not ours to delete
+	_vbo = 0;
+	_ebo = 0;
+	_indexType = indexType;
+	_indexOffset = indexOffset;
+
+	glGenVertexArrays(1, &_vao);
+	glBindVertexArray(_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	for (unsigned int i = 0; i < NUM_ATTRIBUTES; i++) {
+		// disabled attributes read the current generic value, (0, 0, 0, 1) unless someone changed it
+		if (attributes[i].buffer != 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, attributes[i].buffer);
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, attributes[i].size, attributes[i].type, attributes[i].normalized, attributes[i].stride, (void*)attributes[i].offset);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GLMesh::SetInstances(const std::vector<glm::vec3> &offsets)
+{
+	glDeleteBuffers(1, &_instanceBuffer);
+	_instanceBuffer = offsets.empty() ? 0 : CreateBuffer(offsets.data(), offsets.size() * sizeof(glm::vec3));
+	_numInstances = std::max<GLsizei>((GLsizei)offsets.size(), 1);
+	glBindVertexArray(_vao);
+	if (_instanceBuffer != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+		glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+		glVertexAttribPointer(INSTANCE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	else {
+		// the disabled attribute reads the generic (0, 0, 0, 1), no offset
+		glDisableVertexAttribArray(INSTANCE_ATTRIBUTE);
+	}
+	glBindVertexArray(0);
+}
+
 void GLMesh::Unload()
 {
 	glDeleteVertexArrays(1, &_vao);
 	glDeleteBuffers(1, &_vbo);
 	glDeleteBuffers(1, &_ebo);
+	glDeleteBuffers(1, &_instanceBuffer);
 	//glDeleteTextures
 }
 
@@ -120,5 +252,10 @@ bool GLMesh::HasTextureMap(TextureType type) const
 	return false;
 }
 
+void GLMesh::SetFeedbackId(unsigned int id)
+{
+	_feedbackId = id;
+}
+
 
 } // namespace opengl
\ No newline at end of file
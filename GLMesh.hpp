@@ -11,6 +11,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "GLProgram.hpp"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -37,6 +39,7 @@ enum class TextureType
 	Specular,
 	Normal,
 	Height,
+	DiffuseSpecular, // diffuse rgb with the specular intensity in alpha
 };
 
 
@@ -44,19 +47,56 @@ struct GLTexture
 {
 	unsigned int id;
 	TextureType type;
-	aiString path;
+	unsigned int handle; // GLTextureRegistry handle, the registry keeps the path
+};
+
+
+// Where one vertex attribute comes from when the data isn't in GLVertex layout (e.g. a glTF accessor).
+struct GLVertexAttribute
+{
+	GLuint buffer; // zero leaves the attribute disabled
+	size_t offset;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
 };
 
 
 class GLMesh 
 {
 public:
-	GLMesh() { }
+	// position, normal, texture coordinates, tangent, bitangent; the pass1_gbuffer.vert locations
+	static const unsigned int NUM_ATTRIBUTES = 5;
+	// per instance translation, location 5 in pass1_gbuffer.vert
+	static const unsigned int INSTANCE_ATTRIBUTE = NUM_ATTRIBUTES;
+
+	GLMesh() : _vao(0), _vbo(0), _ebo(0), _indexType(GL_UNSIGNED_INT), _indexOffset(0), _feedbackId(0), _instanceBuffer(0), _numInstances(1) { }
 	void Load(const std::vector<GLVertex> &vertices, const std::vector<GLuint> &indices, const std::vector<GLTexture> &textures);
+	// Uploads directly from caller owned memory (e.g. a mapped mesh cache).
+	void Load(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices, const std::vector<GLTexture> &textures);
+	// Takes ownership of buffers that were already filled (e.g. on a shared loader context) and builds the vertex array around them.
+	void Load(GLuint vbo, GLuint ebo, size_t numIndices, const std::vector<GLTexture> &textures);
+	// Builds the vertex array around buffers in whatever layout and component types they already have.
+	// The buffers stay owned by the caller, several meshes may share them.
+	void Load(const GLVertexAttribute attributes[NUM_ATTRIBUTES], GLuint ebo, GLenum indexType, size_t indexOffset, size_t numIndices, const std::vector<GLTexture> &textures);
+	// Creates and fills the vertex and index buffers only. Vertex arrays aren't shared between contexts,
+	// so this is the part of Load() that can run on another context.
+	static void CreateBuffers(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices, GLuint &vbo, GLuint &ebo);
+	// Creates an immutable buffer from raw bytes that can be used as vertex or element data.
+	static GLuint CreateBuffer(const void *data, size_t size);
+	// Draws the mesh once per translation with instancing. Call after Load().
+	void SetInstances(const std::vector<glm::vec3> &offsets);
 	void Unload();
-	void Draw(GLuint shaderID) const;
+	// The program must be bound.
+	void Draw(const GLProgram &program) const;
+	// Binds textures to the units and sampler uniforms Draw() uses, for geometry drawn without a GLMesh.
+	static void BindTextures(const GLProgram &program, const std::vector<GLTexture> &textures);
+	static void UnbindTextures(const std::vector<GLTexture> &textures);
 	GLuint Id() const; // vao ID
 	bool HasTextureMap(TextureType type) const;
+	// Written to the G-buffer's feedback target so texture streaming knows what this mesh samples.
+	void SetFeedbackId(unsigned int id);
 
 private:
 	std::vector<GLTexture> _textures;
@@ -64,6 +104,11 @@ private:
 	GLuint _vao;
 	GLuint _vbo;
 	GLuint _ebo;
+	GLenum _indexType;
+	size_t _indexOffset; // bytes into the element buffer
+	unsigned int _feedbackId;
+	GLuint _instanceBuffer;
+	GLsizei _numInstances;
 };
 
 
@@ -0,0 +1,262 @@
+#include "GLMeshCache.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+namespace opengl {
+
+static const uint64_t CACHE_ALIGNMENT = 16;
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+}
+
+uint64_t GLMeshCache::Hash(const void *data, size_t len, uint64_t seed)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	uint64_t hash = seed;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t GLMeshCache::HashFile(const std::string &path)
+{
+	GLMappedFile file;
+	if (!file.Open(path)) {
+		return 0;
+	}
+	return Hash(file.Data(), file.Size());
+}
+
+bool GLMeshCache::Open(const std::string &cachePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options)
+{
+	Close();
+	if (!_file.Open(cachePath) || !Open(_file.Data(), _file.Size(), importFlags, options) || _header->sourceHash != sourceHash) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool GLMeshCache::Open(const unsigned char *data, size_t size, unsigned int importFlags, unsigned int options)
+{
+	_header = nullptr;
+	if (size < sizeof(Header)) {
+		return false;
+	}
+	const Header *header = (const Header *)data;
+	bool valid = header->magic == MAGIC
+		&& header->version == VERSION
+		&& header->vertexSize == sizeof(GLVertex)
+		&& header->importFlags == importFlags
+		&& header->options == options
+		&& sizeof(Header) + (uint64_t)header->numMeshes * sizeof(MeshEntry) + (uint64_t)header->numTextures * sizeof(TextureEntry) <= size
+		&& header->stringBytes <= size && header->stringOffset <= size - header->stringBytes
+		&& header->instanceBytes <= size && header->instanceOffset <= size - header->instanceBytes
+		&& header->vertexBytes <= size && header->vertexOffset <= size - header->vertexBytes
+		&& header->indexBytes <= size && header->indexOffset <= size - header->indexBytes;
+	if (!valid) {
+		return false;
+	}
+	// every range the getters hand out has to lie inside its section, a truncated or corrupt file is rejected here
+	const MeshEntry *meshes = (const MeshEntry *)(data + sizeof(Header));
+	const TextureEntry *textures = (const TextureEntry *)(meshes + header->numMeshes);
+	for (uint32_t i = 0; i < header->numMeshes; i++) {
+		const MeshEntry &mesh = meshes[i];
+		if (((uint64_t)mesh.firstVertex + mesh.numVertices) * sizeof(GLVertex) > header->vertexBytes
+			|| ((uint64_t)mesh.firstIndex + mesh.numIndices) * sizeof(GLuint) > header->indexBytes
+			|| (uint64_t)mesh.firstTexture + mesh.numTextures > header->numTextures
+			|| ((uint64_t)mesh.firstInstance + mesh.numInstances) * sizeof(glm::vec3) > header->instanceBytes) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->numTextures; i++) {
+		if ((uint64_t)textures[i].pathOffset + textures[i].pathLength > header->stringBytes) {
+			return false;
+		}
+	}
+	_data = data;
+	_header = header;
+	_meshes = meshes;
+	_textures = textures;
+	return true;
+}
+
+void GLMeshCache::Close()
+{
+	_file.Close();
+	_data = nullptr;
+	_header = nullptr;
+	_meshes = nullptr;
+	_textures = nullptr;
+}
+
+bool GLMeshCache::IsOpen() const
+{
+	return _header != nullptr;
+}
+
+uint64_t GLMeshCache::SourceHash() const
+{
+	return _header ? _header->sourceHash : 0;
+}
+
+unsigned int GLMeshCache::NumMeshes() const
+{
+	return _header ? _header->numMeshes : 0;
+}
+
+const GLMeshCache::MeshEntry &GLMeshCache::GetMesh(unsigned int index) const
+{
+	return _meshes[index];
+}
+
+const GLVertex *GLMeshCache::GetVertices(const MeshEntry &mesh) const
+{
+	return (const GLVertex *)(_data + _header->vertexOffset) + mesh.firstVertex;
+}
+
+const GLuint *GLMeshCache::GetIndices(const MeshEntry &mesh) const
+{
+	return (const GLuint *)(_data + _header->indexOffset) + mesh.firstIndex;
+}
+
+TextureType GLMeshCache::GetTextureType(const MeshEntry &mesh, unsigned int index) const
+{
+	return (TextureType)_textures[mesh.firstTexture + index].type;
+}
+
+std::string GLMeshCache::GetTexturePath(const MeshEntry &mesh, unsigned int index) const
+{
+	const TextureEntry &tex = _textures[mesh.firstTexture + index];
+	const char *strings = (const char *)_data + _header->stringOffset;
+	return std::string(strings + tex.pathOffset, tex.pathLength);
+}
+
+const glm::vec3 *GLMeshCache::GetInstances(const MeshEntry &mesh) const
+{
+	return (const glm::vec3 *)(_data + _header->instanceOffset) + mesh.firstInstance;
+}
+
+void GLMeshCache::GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const
+{
+	minbb = glm::vec3(_header->minbb[0], _header->minbb[1], _header->minbb[2]);
+	maxbb = glm::vec3(_header->maxbb[0], _header->maxbb[1], _header->maxbb[2]);
+}
+
+void GLMeshCacheWriter::Clear()
+{
+	_meshes.clear();
+	_textures.clear();
+	_strings.clear();
+	_instances.clear();
+	_vertices.clear();
+	_indices.clear();
+}
+
+void GLMeshCacheWriter::AddMesh(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices,
+	const glm::vec3 &minbb, const glm::vec3 &maxbb)
+{
+	GLMeshCache::MeshEntry entry;
+	entry.firstVertex = (uint32_t)_vertices.size();
+	entry.numVertices = (uint32_t)numVertices;
+	entry.firstIndex = (uint32_t)_indices.size();
+	entry.numIndices = (uint32_t)numIndices;
+	entry.firstTexture = (uint32_t)_textures.size();
+	entry.numTextures = 0;
+	entry.firstInstance = (uint32_t)_instances.size();
+	entry.numInstances = 0;
+	for (int i = 0; i < 3; i++) {
+		entry.minbb[i] = minbb[i];
+		entry.maxbb[i] = maxbb[i];
+	}
+	_meshes.push_back(entry);
+	_vertices.insert(_vertices.end(), vertices, vertices + numVertices);
+	_indices.insert(_indices.end(), indices, indices + numIndices);
+}
+
+void GLMeshCacheWriter::AddTexture(TextureType type, const std::string &path)
+{
+	GLMeshCache::TextureEntry tex;
+	tex.type = (uint32_t)type;
+	tex.pathOffset = (uint32_t)_strings.size();
+	tex.pathLength = (uint32_t)path.length();
+	tex.reserved = 0;
+	_strings.append(path);
+	_textures.push_back(tex);
+	_meshes.back().numTextures++;
+}
+
+void GLMeshCacheWriter::AddInstances(const std::vector<glm::vec3> &instances)
+{
+	_instances.insert(_instances.end(), instances.begin(), instances.end());
+	_meshes.back().numInstances += (uint32_t)instances.size();
+}
+
+bool GLMeshCacheWriter::Write(const std::string &cachePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options,
+	const glm::vec3 &minbb, const glm::vec3 &maxbb) const
+{
+	GLMeshCache::Header header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = GLMeshCache::MAGIC;
+	header.version = GLMeshCache::VERSION;
+	header.vertexSize = sizeof(GLVertex);
+	header.importFlags = importFlags;
+	header.sourceHash = sourceHash;
+	header.options = options;
+	header.numMeshes = (uint32_t)_meshes.size();
+	header.numTextures = (uint32_t)_textures.size();
+	header.stringOffset = sizeof(header) + _meshes.size() * sizeof(GLMeshCache::MeshEntry)
+		+ _textures.size() * sizeof(GLMeshCache::TextureEntry);
+	header.stringBytes = _strings.size();
+	header.instanceOffset = AlignOffset(header.stringOffset + header.stringBytes);
+	header.instanceBytes = _instances.size() * sizeof(glm::vec3);
+	header.vertexOffset = AlignOffset(header.instanceOffset + header.instanceBytes);
+	header.vertexBytes = _vertices.size() * sizeof(GLVertex);
+	header.indexOffset = AlignOffset(header.vertexOffset + header.vertexBytes);
+	header.indexBytes = _indices.size() * sizeof(GLuint);
+	for (int i = 0; i < 3; i++) {
+		header.minbb[i] = minbb[i];
+		header.maxbb[i] = maxbb[i];
+	}
+
+	std::ofstream file(cachePath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	const char padding[CACHE_ALIGNMENT] = { 0 };
+	file.write((const char *)&header, sizeof(header));
+	if (!_meshes.empty()) {
+		file.write((const char *)&_meshes[0], _meshes.size() * sizeof(GLMeshCache::MeshEntry));
+	}
+	if (!_textures.empty()) {
+		file.write((const char *)&_textures[0], _textures.size() * sizeof(GLMeshCache::TextureEntry));
+	}
+	file.write(_strings.data(), _strings.size());
+	file.write(padding, header.instanceOffset - (header.stringOffset + header.stringBytes));
+	if (!_instances.empty()) {
+		file.write((const char *)&_instances[0], header.instanceBytes);
+	}
+	file.write(padding, header.vertexOffset - (header.instanceOffset + header.instanceBytes));
+	if (!_vertices.empty()) {
+		file.write((const char *)&_vertices[0], header.vertexBytes);
+	}
+	file.write(padding, header.indexOffset - (header.vertexOffset + header.vertexBytes));
+	if (!_indices.empty()) {
+		file.write((const char *)&_indices[0], header.indexBytes);
+	}
+	// the final flush can still fail, so the result is only known once the file is closed
+	file.close();
+	if (file.fail()) {
+		std::remove(cachePath.c_str());
+		return false;
+	}
+	return true;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+#ifndef GLMESHCACHE_HPP
+#define GLMESHCACHE_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLMesh.hpp"
+#include "GLMappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace opengl {
+
+// Versioned binary image of an imported model. Vertices and indices are stored in the
+// exact layout GLMesh uploads, so a mapped cache can be handed to GL without conversion.
+//
+// Layout: Header | MeshEntry[numMeshes] | TextureEntry[numTextures] | strings | instances | vertices | indices
+class GLMeshCache
+{
+public:
+	static const uint32_t MAGIC = 0x434D5344; // "DSMC"
+	static const uint32_t VERSION = 4;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexSize; // sizeof(GLVertex) when the cache was written
+		uint32_t importFlags; // assimp post-processing flags
+		uint64_t sourceHash; // content hash of the source model
+		uint32_t options; // loader options that change the geometry (flipTextureY)
+		uint32_t numMeshes;
+		uint32_t numTextures;
+		uint32_t reserved;
+		uint64_t stringOffset, stringBytes;
+		uint64_t instanceOffset, instanceBytes; // float[3] translations
+		uint64_t vertexOffset, vertexBytes;
+		uint64_t indexOffset, indexBytes;
+		float minbb[3], maxbb[3];
+	};
+
+	struct MeshEntry
+	{
+		uint32_t firstVertex, numVertices;
+		uint32_t firstIndex, numIndices;
+		uint32_t firstTexture, numTextures;
+		uint32_t firstInstance, numInstances; // no instances for meshes that are drawn once
+		float minbb[3], maxbb[3];
+	};
+
+	struct TextureEntry
+	{
+		uint32_t type; // TextureType
+		uint32_t pathOffset; // relative to the string table
+		uint32_t pathLength;
+		uint32_t reserved;
+	};
+
+	GLMeshCache() : _data(nullptr), _header(nullptr), _meshes(nullptr), _textures(nullptr) {}
+	// Maps the cache and checks that it was built from the same source and options.
+	bool Open(const std::string &cachePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options);
+	// Uses a cache that's already in memory, e.g. in a GLAssetPack, which has to outlive it. The source isn't
+	// checked, whoever put the cache there vouches for it.
+	bool Open(const unsigned char *data, size_t size, unsigned int importFlags, unsigned int options);
+	void Close();
+	bool IsOpen() const;
+	uint64_t SourceHash() const;
+	unsigned int NumMeshes() const;
+	const MeshEntry &GetMesh(unsigned int index) const;
+	const GLVertex *GetVertices(const MeshEntry &mesh) const;
+	const GLuint *GetIndices(const MeshEntry &mesh) const;
+	TextureType GetTextureType(const MeshEntry &mesh, unsigned int index) const;
+	std::string GetTexturePath(const MeshEntry &mesh, unsigned int index) const;
+	const glm::vec3 *GetInstances(const MeshEntry &mesh) const;
+	void GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const;
+
+	// 64-bit FNV-1a. Returns 0 if the file can't be read.
+	static uint64_t HashFile(const std::string &path);
+	static uint64_t Hash(const void *data, size_t len, uint64_t seed = 0xcbf29ce484222325ULL);
+
+private:
+	GLMappedFile _file; // unused when opened from memory
+	const unsigned char *_data;
+	const Header *_header;
+	const MeshEntry *_meshes;
+	const TextureEntry *_textures;
+};
+
+
+// Accumulates processed meshes during an import and writes them out as a GLMeshCache.
+class GLMeshCacheWriter
+{
+public:
+	GLMeshCacheWriter() {}
+	void Clear();
+	void AddMesh(const GLVertex *vertices, size_t numVertices, const GLuint *indices, size_t numIndices,
+		const glm::vec3 &minbb, const glm::vec3 &maxbb);
+	// Adds a texture reference to the most recently added mesh.
+	void AddTexture(TextureType type, const std::string &path);
+	// Sets the instance translations of the most recently added mesh.
+	void AddInstances(const std::vector<glm::vec3> &instances);
+	bool Write(const std::string &cachePath, uint64_t sourceHash, unsigned int importFlags, unsigned int options,
+		const glm::vec3 &minbb, const glm::vec3 &maxbb) const;
+
+private:
+	std::vector<GLMeshCache::MeshEntry> _meshes;
+	std::vector<GLMeshCache::TextureEntry> _textures;
+	std::string _strings;
+	std::vector<glm::vec3> _instances;
+	std::vector<GLVertex> _vertices;
+	std::vector<GLuint> _indices;
+};
+
+} // namespace opengl
+#endif // GLMESHCACHE_HPP
\ No newline at end of file
@@ -0,0 +1,531 @@
+#include "GLMeshProcessor.hpp"
+
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GLMESHPROCESSOR_SSE2
+#endif
+
+namespace opengl {
+
+static const size_t CHUNK_SIZE = 16384; // vertices or triangles per parallel work item
+static const size_t SHARD_SIZE = 8192; // vertices per hash table when looking for duplicates
+static const float TANGENT_SMOOTHING_COS = 0.70710678f; // cos(45 degrees), assimp's AI_CONFIG_PP_CT_MAX_SMOOTHING_ANGLE default
+static const uint32_t CACHE_SIZE = 12; // post transform cache entries, assimp's PP_ICL_PTCACHE_SIZE default
+
+// calls fn(begin, end) for CHUNK_SIZE sized ranges of [0, count) across the pool
+template<typename Fn>
+static void ForChunks(size_t count, ThreadPool &pool, const Fn &fn)
+{
+	size_t chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	pool.ParallelFor(chunks, [count, &fn](size_t chunk) {
+		fn(chunk * CHUNK_SIZE, std::min(count, (chunk + 1) * CHUNK_SIZE));
+	});
+}
+
+static uint64_t HashWords(const void *data, size_t bytes)
+{
+	const uint32_t *words = (const uint32_t *)data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < bytes / 4; i++) {
+		hash = (hash ^ words[i]) * 0x100000001b3ULL;
+	}
+	// the low bits of float words are mostly zero, so finish with a full avalanche before using them
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	return hash ^ (hash >> 33);
+}
+
+// first[i] is the lowest index with the same key as i. Vertices are split into shards by hash
+// so every shard builds its table independently.
+template<typename Hash, typename Equal>
+static uint32_t *FindDuplicates(size_t count, const Hash &hash, const Equal &equal, ThreadPool &pool, GLArena &arena)
+{
+	uint64_t *hashes = arena.Allocate<uint64_t>(count);
+	ForChunks(count, pool, [hashes, &hash](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			hashes[i] = hash(i);
+		}
+	});
+	// small shards keep each table in cache. The table buckets on the low bits, so shard on the high ones.
+	const size_t numShards = std::max<size_t>(pool.NumThreads() * 4, count / SHARD_SIZE);
+	uint32_t *shardStart = arena.Allocate<uint32_t>(numShards + 1, 0);
+	for (size_t i = 0; i < count; i++) {
+		shardStart[(hashes[i] >> 40) % numShards + 1]++;
+	}
+	for (size_t s = 0; s < numShards; s++) {
+		shardStart[s + 1] += shardStart[s];
+	}
+	uint32_t *order = arena.Allocate<uint32_t>(count);
+	uint32_t *fill = arena.Allocate<uint32_t>(numShards);
+	std::copy(shardStart, shardStart + numShards, fill);
+	for (size_t i = 0; i < count; i++) {
+		order[fill[(hashes[i] >> 40) % numShards]++] = (uint32_t)i;
+	}
+	uint32_t *first = arena.Allocate<uint32_t>(count);
+	// open addressing, at most half full. Slots keep the hash so probing doesn't touch the vertices.
+	// The arena isn't thread safe, so every shard's table is carved out of one allocation up front.
+	struct Slot
+	{
+		uint64_t hash;
+		uint32_t index;
+	};
+	const uint32_t EMPTY = 0xFFFFFFFF;
+	size_t *tableStart = arena.Allocate<size_t>(numShards + 1);
+	tableStart[0] = 0;
+	for (size_t shard = 0; shard < numShards; shard++) {
+		size_t size = 16;
+		while (size < 2 * (size_t)(shardStart[shard + 1] - shardStart[shard])) {
+			size *= 2;
+		}
+		tableStart[shard + 1] = tableStart[shard] + size;
+	}
+	Slot *tables = arena.Allocate<Slot>(tableStart[numShards]);
+	pool.ParallelFor(numShards, [&](size_t shard) {
+		Slot *table = tables + tableStart[shard];
+		size_t size = tableStart[shard + 1] - tableStart[shard];
+		std::fill(table, table + size, Slot{ 0, EMPTY });
+		// indices within a shard are increasing, so the first one inserted is the lowest
+		for (uint32_t k = shardStart[shard]; k < shardStart[shard + 1]; k++) {
+			uint32_t i = order[k];
+			uint64_t hash = hashes[i];
+			size_t slot = hash & (size - 1);
+			while (table[slot].index != EMPTY && (table[slot].hash != hash || !equal(table[slot].index, i))) {
+				slot = (slot + 1) & (size - 1);
+			}
+			if (table[slot].index == EMPTY) {
+				table[slot].hash = hash;
+				table[slot].index = i;
+			}
+			first[i] = table[slot].index;
+		}
+	});
+	return first;
+}
+
+#ifdef GLMESHPROCESSOR_SSE2
+static __m128 Load3(const glm::vec3 &v)
+{
+	return _mm_setr_ps(v.x, v.y, v.z, 0.0f);
+}
+
+// zero stays zero instead of turning into NaN
+static __m128 Normalize3(__m128 v)
+{
+	__m128 sq = _mm_mul_ps(v, v);
+	__m128 sum = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 0, 2, 1)));
+	sum = _mm_add_ps(sum, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 1, 0, 2)));
+	__m128 len = _mm_sqrt_ps(sum);
+	__m128 nonzero = _mm_cmpgt_ps(len, _mm_setzero_ps());
+	return _mm_and_ps(_mm_div_ps(v, _mm_or_ps(len, _mm_andnot_ps(nonzero, _mm_set1_ps(1.0f)))), nonzero);
+}
+
+static glm::vec3 Store3(__m128 v)
+{
+	float out[4];
+	_mm_storeu_ps(out, v);
+	return glm::vec3(out[0], out[1], out[2]);
+}
+#endif
+
+static glm::vec3 SafeNormalize(const glm::vec3 &v)
+{
+	float len = glm::length(v);
+	return len > 0.0f ? v / len : glm::vec3(0.0f);
+}
+
+// same per face formula as assimp's CalcTangentSpace, both vectors normalized so every face weighs the same
+static void FaceTangent(const GLVertex &a, const GLVertex &b, const GLVertex &c, glm::vec3 &tangent, glm::vec3 &bitangent)
+{
+	float sx = b.TexCoords.x - a.TexCoords.x, sy = b.TexCoords.y - a.TexCoords.y;
+	float tx = c.TexCoords.x - a.TexCoords.x, ty = c.TexCoords.y - a.TexCoords.y;
+	float dirCorrection = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+	// corners at the same spot in UV space get the default UV direction
+	if (sx * ty == sy * tx) {
+		sx = 0.0f; sy = 1.0f; tx = 1.0f; ty = 0.0f;
+	}
+#ifdef GLMESHPROCESSOR_SSE2
+	__m128 p0 = Load3(a.Position);
+	__m128 v = _mm_sub_ps(Load3(b.Position), p0);
+	__m128 w = _mm_sub_ps(Load3(c.Position), p0);
+	__m128 dir = _mm_set1_ps(dirCorrection);
+	__m128 t = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(w, _mm_set1_ps(sy)), _mm_mul_ps(v, _mm_set1_ps(ty))), dir);
+	__m128 bt = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(w, _mm_set1_ps(sx)), _mm_mul_ps(v, _mm_set1_ps(tx))), dir);
+	tangent = Store3(Normalize3(t));
+	bitangent = Store3(Normalize3(bt));
+#else
+	glm::vec3 v = b.Position - a.Position;
+	glm::vec3 w = c.Position - a.Position;
+	tangent = SafeNormalize((w * sy - v * ty) * dirCorrection);
+	bitangent = SafeNormalize((w * sx - v * tx) * dirCorrection);
+#endif
+}
+
+unsigned int GLMeshProcessor::StepsFromAssimpFlags(unsigned int assimpFlags)
+{
+	unsigned int steps = 0;
+	if (assimpFlags & aiProcess_FindDegenerates) {
+		steps |= REMOVE_DEGENERATES;
+	}
+	// flat normals are treated as smooth ones, welding would merge their corners anyway
+	if (assimpFlags & (aiProcess_GenSmoothNormals | aiProcess_GenNormals)) {
+		steps |= GENERATE_NORMALS;
+	}
+	if (assimpFlags & aiProcess_JoinIdenticalVertices) {
+		steps |= WELD_VERTICES;
+	}
+	if (assimpFlags & aiProcess_CalcTangentSpace) {
+		steps |= GENERATE_TANGENTS;
+	}
+	if (assimpFlags & aiProcess_FindInvalidData) {
+		steps |= REMOVE_INVALID;
+	}
+	if (assimpFlags & aiProcess_ImproveCacheLocality) {
+		steps |= OPTIMIZE_CACHE;
+	}
+	return steps;
+}
+
+unsigned int GLMeshProcessor::ImportFlags(unsigned int assimpFlags)
+{
+	// the structural steps (material and mesh merging, splitting, instancing, validation, bone weights) stay in assimp
+	const unsigned int replaced = aiProcess_FindDegenerates | aiProcess_GenSmoothNormals | aiProcess_GenNormals
+		| aiProcess_JoinIdenticalVertices | aiProcess_CalcTangentSpace | aiProcess_FindInvalidData | aiProcess_ImproveCacheLocality;
+	return (assimpFlags & ~replaced) | aiProcess_Triangulate | aiProcess_SortByPType;
+}
+
+void GLMeshProcessor::Process(std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, unsigned int steps,
+	bool hasNormals, bool hasTexCoords, ThreadPool &pool, GLArena &arena)
+{
+	if (steps & REMOVE_INVALID) {
+		RemoveInvalidData(vertices, hasNormals, hasTexCoords, pool);
+	}
+	if (steps & REMOVE_DEGENERATES) {
+		RemoveDegenerates(vertices, indices, pool, arena);
+	}
+	if ((steps & GENERATE_NORMALS) && !hasNormals) {
+		GenerateNormals(vertices, indices, pool, arena);
+	}
+	if ((steps & GENERATE_TANGENTS) && hasTexCoords) {
+		GenerateTangents(vertices, indices, pool, arena);
+	}
+	if (steps & WELD_VERTICES) {
+		WeldVertices(vertices, indices, pool, arena);
+	}
+	if (steps & OPTIMIZE_CACHE) {
+		OptimizeCache(vertices, indices, arena);
+	}
+}
+
+void GLMeshProcessor::RemoveInvalidData(std::vector<GLVertex> &vertices, bool &hasNormals, bool &hasTexCoords, ThreadPool &pool)
+{
+	if (vertices.empty()) {
+		return;
+	}
+	std::atomic<bool> invalidNormals(false), invalidTexCoords(false), distinctTexCoords(false);
+	const glm::vec2 firstTexCoords = vertices[0].TexCoords;
+	ForChunks(vertices.size(), pool, [&](size_t begin, size_t end) {
+		bool normals = false, texCoords = false, distinct = false;
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3 &n = vertices[i].Normal;
+			const glm::vec2 &uv = vertices[i].TexCoords;
+			normals |= !std::isfinite(n.x) || !std::isfinite(n.y) || !std::isfinite(n.z) || n == glm::vec3(0.0f);
+			texCoords |= !std::isfinite(uv.x) || !std::isfinite(uv.y);
+			distinct |= uv != firstTexCoords;
+		}
+		if (normals) {
+			invalidNormals = true;
+		}
+		if (texCoords) {
+			invalidTexCoords = true;
+		}
+		if (distinct) {
+			distinctTexCoords = true;
+		}
+	});
+	bool clearNormals = hasNormals && invalidNormals;
+	bool clearTexCoords = hasTexCoords && (invalidTexCoords || !distinctTexCoords);
+	if (clearNormals || clearTexCoords) {
+		ForChunks(vertices.size(), pool, [&vertices, clearNormals, clearTexCoords](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				if (clearNormals) {
+					vertices[i].Normal = glm::vec3(0.0f);
+				}
+				if (clearTexCoords) {
+					vertices[i].TexCoords = glm::vec2(0.0f);
+				}
+			}
+		});
+	}
+	hasNormals = hasNormals && !clearNormals;
+	hasTexCoords = hasTexCoords && !clearTexCoords;
+}
+
+size_t GLMeshProcessor::RemoveDegenerates(const std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena)
+{
+	GLArena::Marker marker = arena.Mark();
+	size_t numTriangles = indices.size() / 3;
+	unsigned char *keep = arena.Allocate<unsigned char>(numTriangles);
+	ForChunks(numTriangles, pool, [&vertices, &indices, keep](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			const glm::vec3 &a = vertices[indices[t * 3]].Position;
+			const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 &c = vertices[indices[t * 3 + 2]].Position;
+			keep[t] = a != b && b != c && a != c;
+		}
+	});
+	size_t kept = 0;
+	for (size_t t = 0; t < numTriangles; t++) {
+		if (keep[t]) {
+			indices[kept * 3] = indices[t * 3];
+			indices[kept * 3 + 1] = indices[t * 3 + 1];
+			indices[kept * 3 + 2] = indices[t * 3 + 2];
+			kept++;
+		}
+	}
+	indices.resize(kept * 3);
+	arena.Rewind(marker);
+	return numTriangles - kept;
+}
+
+void GLMeshProcessor::GenerateNormals(std::vector<GLVertex> &vertices, const std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena)
+{
+	GLArena::Marker marker = arena.Mark();
+	// corners aren't shared yet, so smooth over everything at the same position
+	const uint32_t *corner = FindDuplicates(vertices.size(),
+		[&vertices](size_t i) { return HashWords(&vertices[i].Position, sizeof(glm::vec3)); },
+		[&vertices](uint32_t a, uint32_t b) { return vertices[a].Position == vertices[b].Position; },
+		pool, arena);
+	size_t numTriangles = indices.size() / 3;
+	glm::vec3 *faceNormals = arena.Allocate<glm::vec3>(numTriangles);
+	ForChunks(numTriangles, pool, [&vertices, &indices, faceNormals](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			const glm::vec3 &a = vertices[indices[t * 3]].Position;
+			const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 &c = vertices[indices[t * 3 + 2]].Position;
+			faceNormals[t] = SafeNormalize(glm::cross(b - a, c - a));
+		}
+	});
+	glm::vec3 *sums = arena.Allocate<glm::vec3>(vertices.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i < indices.size(); i++) {
+		sums[corner[indices[i]]] += faceNormals[i / 3];
+	}
+	ForChunks(vertices.size(), pool, [&vertices, corner, sums](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			vertices[i].Normal = SafeNormalize(sums[corner[i]]);
+		}
+	});
+	arena.Rewind(marker);
+}
+
+size_t GLMeshProcessor::WeldVertices(std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena)
+{
+	GLArena::Marker marker = arena.Mark();
+	const uint32_t *first = FindDuplicates(vertices.size(),
+		[&vertices](size_t i) { return HashWords(&vertices[i], sizeof(GLVertex)); },
+		[&vertices](uint32_t a, uint32_t b) { return std::memcmp(&vertices[a], &vertices[b], sizeof(GLVertex)) == 0; },
+		pool, arena);
+	// keep the survivors in their original order
+	const uint32_t UNUSED = 0xFFFFFFFF;
+	uint32_t *remap = arena.Allocate<uint32_t>(vertices.size(), UNUSED);
+	for (size_t i = 0; i < indices.size(); i++) {
+		remap[first[indices[i]]] = 0;
+	}
+	uint32_t numVertices = 0;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		if (remap[i] != UNUSED) {
+			remap[i] = numVertices;
+			vertices[numVertices++] = vertices[i];
+		}
+	}
+	ForChunks(indices.size(), pool, [&indices, first, remap](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			indices[i] = remap[first[indices[i]]];
+		}
+	});
+	size_t removed = vertices.size() - numVertices;
+	vertices.resize(numVertices);
+	arena.Rewind(marker);
+	return removed;
+}
+
+void GLMeshProcessor::GenerateTangents(std::vector<GLVertex> &vertices, const std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena)
+{
+	GLArena::Marker marker = arena.Mark();
+	size_t numTriangles = indices.size() / 3;
+	glm::vec3 *faceTangents = arena.Allocate<glm::vec3>(numTriangles);
+	glm::vec3 *faceBitangents = arena.Allocate<glm::vec3>(numTriangles);
+	ForChunks(numTriangles, pool, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			FaceTangent(vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]], faceTangents[t], faceBitangents[t]);
+		}
+	});
+	glm::vec3 *tangents = arena.Allocate<glm::vec3>(vertices.size(), glm::vec3(0.0f));
+	glm::vec3 *bitangents = arena.Allocate<glm::vec3>(vertices.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i < indices.size(); i++) {
+		tangents[indices[i]] += faceTangents[i / 3];
+		bitangents[indices[i]] += faceBitangents[i / 3];
+	}
+	// each vertex's own frame first, orthogonalized in place
+	ForChunks(vertices.size(), pool, [&vertices, tangents, bitangents](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3 &n = vertices[i].Normal;
+			glm::vec3 t = SafeNormalize(tangents[i] - n * glm::dot(n, tangents[i]));
+			if (t == glm::vec3(0.0f)) {
+				// no usable UV gradient, any vector in the tangent plane will do
+				t = SafeNormalize(glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f)));
+			}
+			glm::vec3 b = SafeNormalize(bitangents[i] - n * glm::dot(n, bitangents[i]));
+			if (b == glm::vec3(0.0f)) {
+				b = glm::cross(n, t);
+			}
+			tangents[i] = t;
+			bitangents[i] = b;
+		}
+	});
+	// then averaged with the vertices at the same position that are close enough, so welding can merge them again
+	const uint32_t *corner = FindDuplicates(vertices.size(),
+		[&vertices](size_t i) { return HashWords(&vertices[i].Position, sizeof(glm::vec3)); },
+		[&vertices](uint32_t a, uint32_t b) { return vertices[a].Position == vertices[b].Position; },
+		pool, arena);
+	uint32_t *groupStart = arena.Allocate<uint32_t>(vertices.size() + 1, 0);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		groupStart[corner[i] + 1]++;
+	}
+	for (size_t i = 0; i < vertices.size(); i++) {
+		groupStart[i + 1] += groupStart[i];
+	}
+	uint32_t *members = arena.Allocate<uint32_t>(vertices.size());
+	uint32_t *fill = arena.Allocate<uint32_t>(vertices.size());
+	std::copy(groupStart, groupStart + vertices.size(), fill);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		members[fill[corner[i]]++] = (uint32_t)i;
+	}
+	ForChunks(vertices.size(), pool, [&vertices, tangents, bitangents, corner, groupStart, members](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3 &n = vertices[i].Normal;
+			glm::vec3 t(0.0f), b(0.0f);
+			for (uint32_t k = groupStart[corner[i]]; k < groupStart[corner[i] + 1]; k++) {
+				uint32_t j = members[k];
+				if (j == i || (glm::dot(n, vertices[j].Normal) >= TANGENT_SMOOTHING_COS
+					&& glm::dot(tangents[i], tangents[j]) >= TANGENT_SMOOTHING_COS
+					&& glm::dot(bitangents[i], bitangents[j]) >= TANGENT_SMOOTHING_COS)) {
+					t += tangents[j];
+					b += bitangents[j];
+				}
+			}
+			vertices[i].Tangent = SafeNormalize(t);
+			vertices[i].Bitangent = SafeNormalize(b);
+		}
+	});
+	arena.Rewind(marker);
+}
+
+void GLMeshProcessor::OptimizeCache(std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, GLArena &arena)
+{
+	const size_t numVertices = vertices.size();
+	const size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0) {
+		return;
+	}
+	GLArena::Marker marker = arena.Mark();
+	// the triangles around each vertex
+	uint32_t *adjacencyStart = arena.Allocate<uint32_t>(numVertices + 1, 0);
+	for (size_t i = 0; i < indices.size(); i++) {
+		adjacencyStart[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < numVertices; v++) {
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	}
+	uint32_t *adjacency = arena.Allocate<uint32_t>(indices.size());
+	uint32_t *live = arena.Allocate<uint32_t>(numVertices);
+	std::copy(adjacencyStart, adjacencyStart + numVertices, live);
+	for (size_t i = 0; i < indices.size(); i++) {
+		adjacency[live[indices[i]]++] = (uint32_t)(i / 3);
+	}
+	for (size_t v = 0; v < numVertices; v++) {
+		live[v] = adjacencyStart[v + 1] - adjacencyStart[v]; // triangles not emitted yet
+	}
+	uint32_t *cacheTime = arena.Allocate<uint32_t>(numVertices, 0);
+	unsigned char *emitted = arena.Allocate<unsigned char>(numTriangles, 0);
+	uint32_t *deadEnd = arena.Allocate<uint32_t>(indices.size());
+	uint32_t *candidates = arena.Allocate<uint32_t>(indices.size());
+	GLuint *output = arena.Allocate<GLuint>(indices.size());
+	size_t numDeadEnd = 0, numOutput = 0, cursor = 0;
+	uint32_t time = CACHE_SIZE + 1;
+	const uint32_t NONE = 0xFFFFFFFF;
+	// fan out from one vertex at a time, moving on to the neighbour that is still in the cache and has the fewest triangles left
+	uint32_t fanning = indices[0];
+	while (fanning != NONE) {
+		size_t numCandidates = 0;
+		for (uint32_t k = adjacencyStart[fanning]; k < adjacencyStart[fanning + 1]; k++) {
+			uint32_t t = adjacency[k];
+			if (emitted[t]) {
+				continue;
+			}
+			emitted[t] = 1;
+			for (unsigned int c = 0; c < 3; c++) {
+				uint32_t v = indices[t * 3 + c];
+				output[numOutput++] = v;
+				deadEnd[numDeadEnd++] = v;
+				candidates[numCandidates++] = v;
+				live[v]--;
+				if (time - cacheTime[v] > CACHE_SIZE) {
+					cacheTime[v] = time++;
+				}
+			}
+		}
+		uint32_t next = NONE;
+		int bestPriority = -1;
+		for (size_t k = 0; k < numCandidates; k++) {
+			uint32_t v = candidates[k];
+			if (live[v] == 0) {
+				continue;
+			}
+			int priority = time - cacheTime[v] + 2 * live[v] <= CACHE_SIZE ? (int)(time - cacheTime[v]) : 0;
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = v;
+			}
+		}
+		while (next == NONE && numDeadEnd > 0) {
+			uint32_t v = deadEnd[--numDeadEnd];
+			if (live[v] > 0) {
+				next = v;
+			}
+		}
+		while (next == NONE && cursor < numVertices) {
+			if (live[cursor] > 0) {
+				next = (uint32_t)cursor;
+			}
+			cursor++;
+		}
+		fanning = next;
+	}
+	// number the vertices in the order the triangles fetch them
+	const uint32_t UNUSED = 0xFFFFFFFF;
+	uint32_t *remap = arena.Allocate<uint32_t>(numVertices, UNUSED);
+	GLVertex *ordered = arena.Allocate<GLVertex>(numVertices);
+	uint32_t numUsed = 0;
+	for (size_t i = 0; i < numOutput; i++) {
+		uint32_t v = output[i];
+		if (remap[v] == UNUSED) {
+			remap[v] = numUsed;
+			ordered[numUsed++] = vertices[v];
+		}
+		indices[i] = remap[v];
+	}
+	vertices.assign(ordered, ordered + numUsed);
+	arena.Rewind(marker);
+}
+
+} // namespace opengl
\ No newline at end of file
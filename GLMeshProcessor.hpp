@@ -0,0 +1,52 @@
+#pragma once
+#ifndef GLMESHPROCESSOR_HPP
+#define GLMESHPROCESSOR_HPP
+
+#include "GLArena.hpp"
+#include "GLMesh.hpp"
+#include "ThreadPool.hpp"
+
+#include <vector>
+
+namespace opengl {
+
+// In-house replacement for assimp's per-mesh post-processing steps. Runs on triangle lists in
+// GLVertex layout and splits large meshes across the pool, where assimp works single threaded.
+// Temporaries come from the arena passed in and are given back when each step returns.
+class GLMeshProcessor
+{
+public:
+	static const unsigned int REMOVE_DEGENERATES = 1 << 0; // aiProcess_FindDegenerates
+	static const unsigned int GENERATE_NORMALS = 1 << 1; // aiProcess_GenSmoothNormals, only for meshes without normals
+	static const unsigned int WELD_VERTICES = 1 << 2; // aiProcess_JoinIdenticalVertices
+	static const unsigned int GENERATE_TANGENTS = 1 << 3; // aiProcess_CalcTangentSpace, only for meshes with texture coordinates
+	static const unsigned int REMOVE_INVALID = 1 << 4; // aiProcess_FindInvalidData
+	static const unsigned int OPTIMIZE_CACHE = 1 << 5; // aiProcess_ImproveCacheLocality
+
+	// The steps this class takes over from the given assimp flags.
+	static unsigned int StepsFromAssimpFlags(unsigned int assimpFlags);
+	// What is left for assimp: every requested step this class doesn't take over, plus triangulation and sorting by primitive type.
+	static unsigned int ImportFlags(unsigned int assimpFlags);
+
+	// Runs steps in assimp's order: invalid data, degenerates, normals, tangents, welding, cache order.
+	static void Process(std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, unsigned int steps,
+		bool hasNormals, bool hasTexCoords, ThreadPool &pool, GLArena &arena);
+	// Clears the normals when one of them isn't finite or has zero length, and the texture coordinates when one isn't
+	// finite or all are the same, as assimp drops those channels. hasNormals and hasTexCoords are updated to match.
+	static void RemoveInvalidData(std::vector<GLVertex> &vertices, bool &hasNormals, bool &hasTexCoords, ThreadPool &pool);
+	// Drops triangles that reuse a corner. Returns the number of triangles removed.
+	static size_t RemoveDegenerates(const std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena);
+	// Averages face normals over every corner at the same position.
+	static void GenerateNormals(std::vector<GLVertex> &vertices, const std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena);
+	// Merges bitwise identical vertices and drops unreferenced ones. Returns the number of vertices removed.
+	static size_t WeldVertices(std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena);
+	// Per vertex tangent frame from the first texture coordinate set, orthogonalized against the normal. Like assimp it's
+	// smoothed over the vertices at the same position whose frames are within 45 degrees, so run it before welding.
+	static void GenerateTangents(std::vector<GLVertex> &vertices, const std::vector<GLuint> &indices, ThreadPool &pool, GLArena &arena);
+	// Reorders triangles for the post transform vertex cache (Tipsify, the algorithm assimp uses), then vertices
+	// in the order the triangles first use them.
+	static void OptimizeCache(std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, GLArena &arena);
+};
+
+} // namespace opengl
+#endif // GLMESHPROCESSOR_HPP
\ No newline at end of file
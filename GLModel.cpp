@@ -21,10 +21,13 @@ const std::vector<GLTexture> &GLModel::GetTextures() const
 	return _textures;
 }
 
-void GLModel::Draw(GLuint shaderID) const
+void GLModel::Draw(const GLProgram &program) const
 {
 	for (auto iter = _meshes.begin(); iter != _meshes.end(); iter++) {
-		iter->Draw(shaderID);
+		iter->Draw(program);
+	}
+	if (_geometry != nullptr) {
+		_geometry->Draw(program, GL.ProjMatrix() * GL.ViewMatrix() * GL.ModelMatrix());
 	}
 }
 
@@ -12,6 +12,7 @@
 #include "GLModelLoader.hpp"
 
 #include "GLMesh.hpp"
+#include "GLGeometryStreamer.hpp"
 
 #include <string>
 #include <fstream>
@@ -27,17 +28,20 @@ class GLModelLoader;
 class GLModel
 {
 public:
-	GLModel() {}
+	GLModel() : _geometry(nullptr), _scaleFactor(1.0f), _minbb(0.0f), _maxbb(0.0f) {}
 	std::string Directory() const;
 	const std::vector<GLMesh> &GetMeshes() const;
 	const std::vector<GLTexture> &GetTextures() const;
 	float GetScaleFactor() const;
 	void GetAABB(glm::vec3 &minbb, glm::vec3 &maxbb) const;
-	void Draw(GLuint shaderID) const;
+	// Draws with the current GL matrices, paged models cull and request their pages against them.
+	void Draw(const GLProgram &program) const;
 
 private:
 	std::vector<GLMesh> _meshes;
 	std::vector<GLTexture> _textures;
+	std::vector<GLuint> _buffers; // vertex and index data shared by the meshes, they don't own any
+	GLGeometryStreamer *_geometry; // pages in the geometry of out-of-core models instead of _meshes
 	std::string _directory;
 	float _scaleFactor;
 	glm::vec3 _minbb, _maxbb;
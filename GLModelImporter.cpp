@@ -0,0 +1,805 @@
+#include "GLModelImporter.hpp"
+#include "GLMeshProcessor.hpp"
+#include "GLObjParser.hpp"
+#include "GLGlbParser.hpp"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.hpp"
+#include <float.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <unordered_map>
+
+namespace opengl {
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::duration<double, std::milli> Ms;
+
+static bool HasExtension(const std::string &path, const std::string &ext)
+{
+	if (path.length() < ext.length()) {
+		return false;
+	}
+	for (size_t i = 0; i < ext.length(); i++) {
+		if (std::tolower((unsigned char)path[path.length() - ext.length() + i]) != ext[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static size_t FileSize(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	return file ? (size_t)file.tellg() : 0;
+}
+
+static unsigned char *LoadImage(const ImportedTexture &texture, int *width, int *height, int *components, int desiredComponents)
+{
+	if (texture.encoded != nullptr) {
+		return stbi_load_from_memory(texture.encoded, (int)texture.encodedSize, width, height, components, desiredComponents);
+	}
+	return stbi_load(texture.filename.c_str(), width, height, components, desiredComponents);
+}
+
+// Loads a DiffuseSpecular texture's diffuse image as RGBA and writes the specular map's red channel into
+// its alpha, sampled at the nearest texel when the two sizes differ. Freed with stbi_image_free.
+static unsigned char *LoadPackedImage(const ImportedTexture &texture, int *width, int *height)
+{
+	int components, specWidth, specHeight;
+	unsigned char *rgba = stbi_load(texture.diffuseFilename.c_str(), width, height, &components, 4);
+	if (rgba == nullptr) {
+		return nullptr;
+	}
+	unsigned char *spec = stbi_load(texture.specularFilename.c_str(), &specWidth, &specHeight, &components, 1);
+	if (spec == nullptr) {
+		stbi_image_free(rgba);
+		return nullptr;
+	}
+	for (int y = 0; y < *height; y++) {
+		const unsigned char *specRow = spec + (size_t)(y * specHeight / *height) * specWidth;
+		unsigned char *row = rgba + (size_t)y * *width * 4;
+		for (int x = 0; x < *width; x++) {
+			row[x * 4 + 3] = specRow[x * specWidth / *width];
+		}
+	}
+	stbi_image_free(spec);
+	return rgba;
+}
+
+bool GLModelImporter::Import(const std::string &path, ImportedModel &model, bool flipTextureY, unsigned int assimpFlags)
+{
+	Clock::time_point start = Clock::now();
+	model.path = path;
+	// retrieve the directory path of the filepath
+	model.directory = "";
+	size_t loc = path.find_last_of("/\\");
+	if (loc != std::string::npos) {
+		model.directory = path.substr(0, loc);
+	}
+	model.minbb = glm::vec3(FLT_MAX);
+	model.maxbb = glm::vec3(FLT_MIN);
+	model.scaleFactor = 1.0f;
+
+	// glTF binaries are already laid out for the GPU, there is nothing for the mesh cache to save.
+	// Flipping the texture coordinates or the handedness would mean rewriting the data, those go through assimp.
+	const bool parseGlb = !_assimpPostProcessing && !flipTextureY && HasExtension(path, ".glb")
+		&& (assimpFlags & (aiProcess_MakeLeftHanded | aiProcess_FlipWindingOrder)) == 0;
+	GLArenaPool arenas;
+	if (!(parseGlb && _ImportGlb(model, path)) && !_ImportGeometry(model, path, assimpFlags, flipTextureY, arenas)) {
+		return false;
+	}
+	if (_channelPacking) {
+		_PackMaterials(model);
+	}
+	model.tempAllocations = arenas.Allocations();
+	model.tempHeapAllocations = arenas.HeapAllocations();
+	model.tempPeakBytes = arenas.PeakBytes();
+
+	float tmp = model.maxbb.x - model.minbb.x;
+	tmp = model.maxbb.y - model.minbb.y > tmp ? model.maxbb.y - model.minbb.y : tmp;
+	tmp = model.maxbb.z - model.minbb.z > tmp ? model.maxbb.z - model.minbb.z : tmp;
+	model.scaleFactor = 1.0f / tmp;
+	model.importMs = Ms(Clock::now() - start).count();
+	return true;
+}
+
+void GLModelImporter::SetAssimpPostProcessing(bool enabled)
+{
+	_assimpPostProcessing = enabled;
+}
+
+void GLModelImporter::SetChannelPacking(bool enabled)
+{
+	_channelPacking = enabled;
+}
+
+void GLModelImporter::SetAssetPack(const GLAssetPack *pack)
+{
+	_pack = pack;
+}
+
+void GLModelImporter::SetAssetCache(GLAssetCache *cache)
+{
+	_cache = cache;
+}
+
+void GLModelImporter::DecodeTextures(ImportedModel &model, bool compress)
+{
+	Clock::time_point start = Clock::now();
+	_pool.ParallelFor(model.textures.size(), [this, &model, compress](size_t i) {
+		if (!model.textures[i].skip) {
+			DecodeTexture(model.textures[i], compress);
+		}
+	});
+	model.decodedTextures = 0;
+	for (unsigned int i = 0; i < model.textures.size(); i++) {
+		if (!model.textures[i].skip) {
+			model.decodedTextures++;
+		}
+	}
+	model.decodeMs = Ms(Clock::now() - start).count();
+}
+
+void GLModelImporter::DecodeTexture(ImportedTexture &texture, bool compress)
+{
+	const bool packed = texture.type == TextureType::DiffuseSpecular;
+	if (!compress) {
+		if (packed) {
+			texture.data = LoadPackedImage(texture, &texture.width, &texture.height);
+			texture.components = 4;
+			return;
+		}
+		texture.data = LoadImage(texture, &texture.width, &texture.height, &texture.components, 0);
+		if (_channelPacking && texture.type == TextureType::Normal && texture.data != nullptr && texture.components >= 3) {
+			// z follows from the unit length in the shader, keep x and y like BC5 does
+			size_t count = (size_t)texture.width * texture.height;
+			for (size_t i = 0; i < count; i++) {
+				texture.data[i * 2] = texture.data[i * texture.components];
+				texture.data[i * 2 + 1] = texture.data[i * texture.components + 1];
+			}
+			texture.components = 2;
+		}
+		return;
+	}
+	// the name the cache goes by in an asset pack, and its file when there's no shared cache
+	texture.cacheName = texture.filename + TEXTURE_CACHE_EXT;
+	const unsigned char *packData;
+	size_t packSize;
+	if (_pack != nullptr && _pack->Find(texture.cacheName, packData, packSize) && GLTextureCompressor::Load(packData, packSize, texture.compressed)) {
+		texture.cachePath = texture.cacheName;
+		texture.width = texture.compressed.levels[0].width;
+		texture.height = texture.compressed.levels[0].height;
+		return;
+	}
+	// embedded images have no file of their own, their cache goes next to the model
+	uint64_t sourceHash = texture.encoded != nullptr ? GLMeshCache::Hash(texture.encoded, texture.encodedSize) : GLMeshCache::HashFile(texture.filename);
+	if (packed) {
+		// either source changing invalidates the baked texture
+		uint64_t diffuseHash = GLMeshCache::HashFile(texture.diffuseFilename);
+		uint64_t specularHash = GLMeshCache::HashFile(texture.specularFilename);
+		sourceHash = diffuseHash != 0 && specularHash != 0 ? GLMeshCache::Hash(&specularHash, sizeof(specularHash), diffuseHash) : 0;
+	}
+	if (sourceHash == 0) {
+		return;
+	}
+	// the type picks the block format
+	const uint64_t key = GLAssetCache::Key(GLAssetCache::Category::Texture, sourceHash, { (uint64_t)texture.type });
+	std::string cachePath;
+	bool cached = _FindCache(GLAssetCache::Category::Texture, key, texture.cacheName, cachePath);
+	if (cached && !GLTextureCompressor::Load(cachePath, sourceHash, texture.compressed)) {
+		_DiscardCache(GLAssetCache::Category::Texture, key);
+		cached = false;
+	}
+	if (!cached) {
+		int components;
+		unsigned char *rgba = packed ? LoadPackedImage(texture, &texture.width, &texture.height) : LoadImage(texture, &texture.width, &texture.height, &components, 4);
+		if (rgba == nullptr) {
+			return;
+		}
+		GLTextureCompressor::Format format = GLTextureCompressor::ChooseFormat(texture.type, rgba, texture.width, texture.height);
+		GLTextureCompressor::Compress(rgba, texture.width, texture.height, format, _pool, texture.compressed);
+		stbi_image_free(rgba);
+		const GLCompressedImage &image = texture.compressed;
+		bool saved = _WriteCache(GLAssetCache::Category::Texture, key, cachePath, [sourceHash, &image](const std::string &file) {
+			return GLTextureCompressor::Save(file, sourceHash, image);
+		});
+		if (!saved) {
+			std::cout << "Failed to write texture cache: " << cachePath << std::endl;
+		}
+	}
+	texture.cachePath = cachePath;
+	texture.width = texture.compressed.levels[0].width;
+	texture.height = texture.compressed.levels[0].height;
+}
+
+const unsigned char *GLModelImporter::ImageData(const ImportedTexture &texture, size_t &size)
+{
+	if (!texture.compressed.data.empty()) {
+		size = texture.compressed.data.size();
+		return texture.compressed.data.data();
+	}
+	size = (size_t)texture.width * texture.height * texture.components;
+	return texture.data;
+}
+
+void GLModelImporter::FreeImage(ImportedTexture &texture)
+{
+	stbi_image_free(texture.data);
+	texture.data = nullptr;
+	std::vector<unsigned char>().swap(texture.compressed.data);
+}
+
+bool GLModelImporter::_ImportGeometry(ImportedModel &model, const std::string &path, unsigned int assimpFlags, bool flipTextureY, GLArenaPool &arenas)
+{
+	// try the binary cache first
+	const std::string cacheName = path + MESH_CACHE_EXT;
+	// the OBJ parser doesn't convert handedness, leave those files to assimp
+	const bool parseObj = !_assimpPostProcessing && HasExtension(path, ".obj")
+		&& (assimpFlags & (aiProcess_MakeLeftHanded | aiProcess_FlipWindingOrder)) == 0;
+	const unsigned int options = (flipTextureY ? 1 : 0) | (_assimpPostProcessing ? 2 : 0) | (parseObj ? 4 : 0);
+	model.cacheName = cacheName;
+	model.cacheOptions = options;
+	const unsigned char *packData;
+	size_t packSize;
+	if (_pack != nullptr && _pack->Find(cacheName, packData, packSize) && model.cache.Open(packData, packSize, assimpFlags, options)) {
+		// the pack only finds caches whose model hasn't changed since it was written, the model isn't even opened
+		model.cachePath = cacheName;
+		model.sourceHash = model.cache.SourceHash();
+		_ImportFromCache(model);
+		return true;
+	}
+	uint64_t sourceHash = GLMeshCache::HashFile(path);
+	model.sourceHash = sourceHash;
+	const uint64_t key = GLAssetCache::Key(GLAssetCache::Category::Mesh, sourceHash, { assimpFlags, options, GLMeshCache::VERSION, sizeof(GLVertex) });
+	std::string cachePath;
+	bool cached = sourceHash != 0 && _FindCache(GLAssetCache::Category::Mesh, key, cacheName, cachePath);
+	if (cached && !model.cache.Open(cachePath, sourceHash, assimpFlags, options)) {
+		_DiscardCache(GLAssetCache::Category::Mesh, key);
+		cached = false;
+	}
+	model.cachePath = cachePath;
+	if (cached) {
+		_ImportFromCache(model);
+	}
+	else {
+		bool imported = parseObj ? _ImportObj(model, path, assimpFlags, flipTextureY, arenas) : _ImportAssimp(model, path, assimpFlags, flipTextureY, arenas);
+		if (!imported) {
+			return false;
+		}
+		_FoldInstances(model);
+		for (unsigned int i = 0; i < model.meshes.size(); i++) {
+			model.minbb = glm::min(model.minbb, model.meshes[i].minbb);
+			model.maxbb = glm::max(model.maxbb, model.meshes[i].maxbb);
+		}
+
+		GLMeshCacheWriter writer;
+		for (unsigned int i = 0; i < model.meshes.size(); i++) {
+			const ImportedMesh &mesh = model.meshes[i];
+			writer.AddMesh(mesh.vertices, mesh.numVertices, mesh.indices, mesh.numIndices, mesh.minbb, mesh.maxbb);
+			for (unsigned int j = 0; j < mesh.textures.size(); j++) {
+				const ImportedTexture &texture = model.textures[mesh.textures[j]];
+				writer.AddTexture(texture.type, texture.path);
+			}
+			writer.AddInstances(mesh.instances);
+		}
+		if (sourceHash == 0) {
+			model.cachePath.clear();
+		}
+		else if (!_WriteCache(GLAssetCache::Category::Mesh, key, cachePath, [&](const std::string &file) {
+			return writer.Write(file, sourceHash, assimpFlags, options, model.minbb, model.maxbb);
+		})) {
+			std::cout << "Failed to write mesh cache: " << cachePath << std::endl;
+			model.cachePath.clear();
+		}
+	}
+	return true;
+}
+
+bool GLModelImporter::_FindCache(GLAssetCache::Category category, uint64_t key, const std::string &sidecar, std::string &path)
+{
+	if (_cache != nullptr && _cache->IsOpen()) {
+		return _cache->Find(category, key, path);
+	}
+	// a sidecar file is checked against the source when it's opened
+	path = sidecar;
+	return true;
+}
+
+void GLModelImporter::_DiscardCache(GLAssetCache::Category category, uint64_t key)
+{
+	if (_cache != nullptr && _cache->IsOpen()) {
+		_cache->Discard(category, key);
+	}
+}
+
+bool GLModelImporter::_WriteCache(GLAssetCache::Category category, uint64_t key, const std::string &path, const std::function<bool(const std::string &)> &write)
+{
+	if (_cache == nullptr || !_cache->IsOpen()) {
+		// the sidecar is written next to its final name and renamed over it, so a crash or another reader
+		// never finds half a cache there. The counter keeps concurrent writers of one sidecar apart.
+		static std::atomic<unsigned int> tempFiles(0);
+		const std::string tempPath = path + '.' + std::to_string(tempFiles++) + ".tmp";
+		if (!write(tempPath)) {
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		return GLAssetCache::CommitFile(tempPath, path);
+	}
+	const std::string tempPath = _cache->TempPath(category, key);
+	if (!write(tempPath)) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return _cache->Commit(category, key, tempPath);
+}
+
+void GLModelImporter::_ImportFromCache(ImportedModel &model)
+{
+	const GLMeshCache &cache = model.cache;
+	model.meshes.resize(cache.NumMeshes());
+	for (unsigned int i = 0; i < cache.NumMeshes(); i++) {
+		const GLMeshCache::MeshEntry &entry = cache.GetMesh(i);
+		ImportedMesh &mesh = model.meshes[i];
+		// the mapped vertices are already in GLVertex layout, so they go straight to the GPU
+		mesh.vertices = cache.GetVertices(entry);
+		mesh.numVertices = entry.numVertices;
+		mesh.indices = cache.GetIndices(entry);
+		mesh.numIndices = entry.numIndices;
+		mesh.minbb = glm::vec3(entry.minbb[0], entry.minbb[1], entry.minbb[2]);
+		mesh.maxbb = glm::vec3(entry.maxbb[0], entry.maxbb[1], entry.maxbb[2]);
+		for (unsigned int j = 0; j < entry.numTextures; j++) {
+			mesh.textures.push_back(_AddTexture(model, cache.GetTexturePath(entry, j), cache.GetTextureType(entry, j)));
+		}
+		mesh.instances.assign(cache.GetInstances(entry), cache.GetInstances(entry) + entry.numInstances);
+	}
+	cache.GetAABB(model.minbb, model.maxbb);
+}
+
+void GLModelImporter::_PackMaterials(ImportedModel &model)
+{
+	std::vector<bool> used(model.textures.size(), false);
+	for (unsigned int i = 0; i < model.meshes.size(); i++) {
+		std::vector<unsigned int> &textures = model.meshes[i].textures;
+		int diffuse = -1, specular = -1;
+		for (unsigned int j = 0; j < textures.size(); j++) {
+			TextureType type = model.textures[textures[j]].type;
+			if (type == TextureType::Diffuse && diffuse < 0) {
+				diffuse = (int)j;
+			}
+			else if (type == TextureType::Specular && specular < 0) {
+				specular = (int)j;
+			}
+		}
+		// embedded images have no file for the bake to read
+		if (diffuse >= 0 && specular >= 0 && model.textures[textures[diffuse]].encoded == nullptr && model.textures[textures[specular]].encoded == nullptr) {
+			const ImportedTexture diffuseMap = model.textures[textures[diffuse]];
+			const ImportedTexture &specularMap = model.textures[textures[specular]];
+			const std::string path = diffuseMap.path + '+' + specularMap.path;
+			auto found = model.textureLookup.find(path);
+			if (found == model.textureLookup.end()) {
+				ImportedTexture texture;
+				texture.path = path;
+				// names the baked result, which is also where its cache goes
+				std::string specularName = specularMap.path;
+				std::replace(specularName.begin(), specularName.end(), '/', '_');
+				std::replace(specularName.begin(), specularName.end(), '\\', '_');
+				texture.filename = diffuseMap.filename + '+' + specularName;
+				texture.diffuseFilename = diffuseMap.filename;
+				texture.specularFilename = specularMap.filename;
+				texture.type = TextureType::DiffuseSpecular;
+				model.textures.push_back(texture);
+				used.push_back(false);
+				found = model.textureLookup.emplace(path, (unsigned int)model.textures.size() - 1).first;
+			}
+			textures[diffuse] = found->second;
+			textures.erase(textures.begin() + specular);
+		}
+		for (unsigned int j = 0; j < textures.size(); j++) {
+			used[textures[j]] = true;
+		}
+	}
+
+	// drop the maps that only went into packed textures
+	std::vector<unsigned int> remap(model.textures.size());
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < model.textures.size(); i++) {
+		remap[i] = kept;
+		if (used[i]) {
+			if (kept != i) {
+				model.textures[kept] = model.textures[i];
+			}
+			kept++;
+		}
+	}
+	if (kept == model.textures.size()) {
+		return;
+	}
+	model.textures.resize(kept);
+	model.textureLookup.clear();
+	for (unsigned int i = 0; i < model.textures.size(); i++) {
+		model.textureLookup[model.textures[i].path] = i;
+	}
+	for (unsigned int i = 0; i < model.meshes.size(); i++) {
+		for (unsigned int j = 0; j < model.meshes[i].textures.size(); j++) {
+			model.meshes[i].textures[j] = remap[model.meshes[i].textures[j]];
+		}
+	}
+}
+
+// Whether b is a as it would be after a translation, within tolerance. Positions are compared relative
+// to each mesh's first vertex, everything else has to match as is.
+static bool IsTranslatedCopy(const ImportedMesh &a, const ImportedMesh &b, float tolerance)
+{
+	if (a.numVertices != b.numVertices || a.numIndices != b.numIndices || a.textures != b.textures
+		|| std::memcmp(a.indices, b.indices, a.numIndices * sizeof(GLuint)) != 0) {
+		return false;
+	}
+	const glm::vec3 offset = b.vertices[0].Position - a.vertices[0].Position;
+	for (size_t i = 0; i < a.numVertices; i++) {
+		const GLVertex &va = a.vertices[i], &vb = b.vertices[i];
+		glm::vec3 position = glm::abs(vb.Position - va.Position - offset);
+		glm::vec3 normal = glm::abs(vb.Normal - va.Normal);
+		glm::vec2 texCoords = glm::abs(vb.TexCoords - va.TexCoords);
+		if (glm::max(glm::max(position.x, position.y), position.z) > tolerance
+			|| glm::max(glm::max(normal.x, normal.y), normal.z) > 1e-3f
+			|| glm::max(texCoords.x, texCoords.y) > 1e-4f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void GLModelImporter::_FoldInstances(ImportedModel &model)
+{
+	// OBJ exports bake every copy's transform into its vertices, only translations are recovered. Positions
+	// can't be hashed reliably with rounding noise in them, so meshes are bucketed by topology and compared.
+	const size_t numMeshes = model.meshes.size();
+	std::vector<uint64_t> hashes(numMeshes);
+	_pool.ParallelFor(numMeshes, [&model, &hashes](size_t i) {
+		const ImportedMesh &mesh = model.meshes[i];
+		if (mesh.external) {
+			hashes[i] = 0;
+			return;
+		}
+		uint64_t hash = GLMeshCache::Hash(&mesh.numVertices, sizeof(mesh.numVertices));
+		hash = GLMeshCache::Hash(mesh.textures.data(), mesh.textures.size() * sizeof(unsigned int), hash);
+		hashes[i] = GLMeshCache::Hash(mesh.indices, mesh.numIndices * sizeof(GLuint), hash);
+	});
+	std::unordered_map<uint64_t, std::vector<unsigned int>> buckets;
+	std::vector<unsigned char> folded(numMeshes, 0);
+	unsigned int numFolded = 0, numDropped = 0;
+	for (unsigned int i = 0; i < numMeshes; i++) {
+		ImportedMesh &mesh = model.meshes[i];
+		if (mesh.external || mesh.numVertices == 0) {
+			continue;
+		}
+		glm::vec3 extent = mesh.maxbb - mesh.minbb;
+		float tolerance = std::max(glm::max(glm::max(extent.x, extent.y), extent.z) * 1e-4f, 1e-6f);
+		std::vector<unsigned int> &bucket = buckets[hashes[i]];
+		for (unsigned int j = 0; j < bucket.size() && !folded[i]; j++) {
+			ImportedMesh &original = model.meshes[bucket[j]];
+			if (!IsTranslatedCopy(original, mesh, tolerance)) {
+				continue;
+			}
+			folded[i] = 1;
+			glm::vec3 offset = mesh.vertices[0].Position - original.vertices[0].Position;
+			// a copy in the same place would only be drawn over itself
+			if (glm::max(glm::max(std::abs(offset.x), std::abs(offset.y)), std::abs(offset.z)) <= tolerance) {
+				numDropped++;
+				continue;
+			}
+			if (original.instances.empty()) {
+				original.instances.push_back(glm::vec3(0.0f));
+			}
+			original.instances.push_back(offset);
+			numFolded++;
+		}
+		if (!folded[i]) {
+			bucket.push_back(i);
+		}
+	}
+	if (numFolded == 0 && numDropped == 0) {
+		return;
+	}
+	std::vector<ImportedMesh> meshes;
+	meshes.reserve(numMeshes - numFolded - numDropped);
+	for (unsigned int i = 0; i < numMeshes; i++) {
+		if (folded[i]) {
+			continue;
+		}
+		ImportedMesh &mesh = model.meshes[i];
+		glm::vec3 minbb = mesh.minbb, maxbb = mesh.maxbb;
+		for (unsigned int j = 1; j < mesh.instances.size(); j++) {
+			mesh.minbb = glm::min(mesh.minbb, minbb + mesh.instances[j]);
+			mesh.maxbb = glm::max(mesh.maxbb, maxbb + mesh.instances[j]);
+		}
+		meshes.push_back(std::move(mesh));
+	}
+	// vertices/indices of meshes that kept their storage still point into it after the move
+	model.meshes.swap(meshes);
+	std::cout << "Folded " << numFolded << " translated copies into instances and dropped " << numDropped
+		<< " duplicates, " << model.meshes.size() << " meshes left" << std::endl;
+}
+
+bool GLModelImporter::_ImportAssimp(ImportedModel &model, const std::string &path, unsigned int assimpFlags, bool flipTextureY, GLArenaPool &arenas)
+{
+	// read file via ASSIMP. The expensive per-mesh steps (GLMeshProcessor) run on the pool afterwards,
+	// the structural ones that were asked for still run inside assimp.
+	Clock::time_point start = Clock::now();
+	Assimp::Importer importer;
+	unsigned int steps = _assimpPostProcessing ? 0 : GLMeshProcessor::StepsFromAssimpFlags(assimpFlags);
+	const aiScene *scene = importer.ReadFile(path, _assimpPostProcessing ? assimpFlags : GLMeshProcessor::ImportFlags(assimpFlags));
+	// check for errors
+	if (scene == nullptr || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || scene->mRootNode == nullptr) // if is Not Zero
+	{
+		std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+		return false;
+	}
+	Clock::time_point read = Clock::now();
+	_PrintThroughput(path, "assimp", FileSize(path), Ms(read - start).count());
+	// process ASSIMP's root node recursively
+	std::vector<const aiMesh *> meshes;
+	_ProcessNode(scene, scene->mRootNode, meshes);
+	model.meshes.resize(meshes.size());
+	for (unsigned int i = 0; i < meshes.size(); i++) {
+		_LoadMaterials(model, scene->mMaterials[meshes[i]->mMaterialIndex], model.meshes[i]);
+	}
+	_pool.ParallelFor(meshes.size(), [this, &model, &meshes, steps, flipTextureY, &arenas](size_t i) {
+		_ProcessMesh(model.meshes[i], meshes[i], steps, flipTextureY, arenas);
+	});
+	model.processMs = Ms(Clock::now() - read).count();
+	return true;
+}
+
+bool GLModelImporter::_ImportObj(ImportedModel &model, const std::string &path, unsigned int assimpFlags, bool flipTextureY, GLArenaPool &arenas)
+{
+	GLObjModel obj;
+	if (!GLObjParser::Parse(path, _pool, obj)) {
+		return false;
+	}
+	_PrintThroughput(path, "the OBJ parser", obj.bytes, obj.parseMs);
+	Clock::time_point start = Clock::now();
+	const TextureType slotTypes[4] = { TextureType::Diffuse, TextureType::Specular, TextureType::Normal, TextureType::Height };
+	model.meshes.resize(obj.meshes.size());
+	for (unsigned int i = 0; i < obj.meshes.size(); i++) {
+		if (obj.meshes[i].material >= 0) {
+			const GLObjModel::Material &material = obj.materials[obj.meshes[i].material];
+			for (int slot = 0; slot < 4; slot++) {
+				if (!material.textures[slot].empty()) {
+					model.meshes[i].textures.push_back(_AddTexture(model, material.textures[slot], slotTypes[slot]));
+				}
+			}
+		}
+	}
+	unsigned int steps = GLMeshProcessor::StepsFromAssimpFlags(assimpFlags);
+	bool flipUVs = (assimpFlags & aiProcess_FlipUVs) != 0;
+	_pool.ParallelFor(obj.meshes.size(), [this, &model, &obj, steps, flipUVs, flipTextureY, &arenas](size_t i) {
+		GLObjModel::Mesh &mesh = obj.meshes[i];
+		if (flipUVs) {
+			for (size_t j = 0; j < mesh.vertices.size(); j++) {
+				mesh.vertices[j].TexCoords.y = 1.0f - mesh.vertices[j].TexCoords.y;
+			}
+		}
+		_FinishMesh(model.meshes[i], mesh.vertices, mesh.indices, steps, mesh.hasNormals, mesh.hasTexCoords, flipTextureY, arenas);
+	});
+	model.processMs = Ms(Clock::now() - start).count();
+	return true;
+}
+
+bool GLModelImporter::_ImportGlb(ImportedModel &model, const std::string &path)
+{
+	Clock::time_point start = Clock::now();
+	GLGlbModel glb;
+	if (!model.source.Open(path)) {
+		return false;
+	}
+	if (!GLGlbParser::Parse(model.source.Data(), model.source.Size(), glb)) {
+		std::cout << path << " can't be read in place, falling back to assimp" << std::endl;
+		model.source.Close();
+		return false;
+	}
+	_PrintThroughput(path, "the glTF reader", model.source.Size(), Ms(Clock::now() - start).count());
+
+	// one GL buffer per view the geometry uses, views that only hold images stay on the CPU
+	std::vector<int> viewBuffers(glb.views.size(), -1);
+	auto bufferIndex = [&model, &glb, &viewBuffers](int view) {
+		if (view >= 0 && viewBuffers[view] < 0) {
+			ImportedBuffer buffer;
+			buffer.data = model.source.Data() + glb.views[view].offset;
+			buffer.size = glb.views[view].size;
+			viewBuffers[view] = (int)model.buffers.size();
+			model.buffers.push_back(buffer);
+		}
+		return view >= 0 ? viewBuffers[view] : -1;
+	};
+	std::vector<std::vector<unsigned int>> materialTextures(glb.materials.size());
+	for (unsigned int i = 0; i < glb.materials.size(); i++) {
+		const int images[2] = { glb.materials[i].diffuseImage, glb.materials[i].normalImage };
+		const TextureType types[2] = { TextureType::Diffuse, TextureType::Normal };
+		for (int j = 0; j < 2; j++) {
+			if (images[j] < 0) {
+				continue;
+			}
+			const GLGlbModel::Image &image = glb.images[images[j]];
+			if (image.view < 0) {
+				materialTextures[i].push_back(_AddTexture(model, image.uri, types[j]));
+				continue;
+			}
+			// embedded images are named after the model so the registry and the texture cache can tell them apart
+			const std::string name = "#image" + std::to_string(images[j]);
+			unsigned int index = _AddTexture(model, name, types[j]);
+			ImportedTexture &texture = model.textures[index];
+			texture.filename = path + name;
+			texture.encoded = model.source.Data() + glb.views[image.view].offset;
+			texture.encodedSize = glb.views[image.view].size;
+			materialTextures[i].push_back(index);
+		}
+	}
+
+	model.meshes.resize(glb.primitives.size());
+	for (unsigned int i = 0; i < glb.primitives.size(); i++) {
+		const GLGlbModel::Primitive &primitive = glb.primitives[i];
+		ImportedMesh &mesh = model.meshes[i];
+		mesh.external = true;
+		for (unsigned int j = 0; j < GLMesh::NUM_ATTRIBUTES; j++) {
+			const GLGlbModel::Attribute &attribute = primitive.attributes[j];
+			mesh.attributes[j].buffer = bufferIndex(attribute.view);
+			mesh.attributes[j].offset = attribute.offset;
+			mesh.attributes[j].size = attribute.size;
+			mesh.attributes[j].type = attribute.type;
+			mesh.attributes[j].normalized = attribute.normalized;
+			mesh.attributes[j].stride = attribute.stride;
+		}
+		mesh.indexBuffer = bufferIndex(primitive.indices.view);
+		mesh.indexOffset = primitive.indices.offset;
+		mesh.indexType = primitive.indices.type;
+		mesh.numIndices = primitive.numIndices;
+		if (primitive.material >= 0) {
+			mesh.textures = materialTextures[primitive.material];
+		}
+		mesh.minbb = primitive.minbb;
+		mesh.maxbb = primitive.maxbb;
+		model.minbb = glm::min(model.minbb, mesh.minbb);
+		model.maxbb = glm::max(model.maxbb, mesh.maxbb);
+	}
+	return true;
+}
+
+void GLModelImporter::_PrintThroughput(const std::string &path, const char *reader, size_t bytes, double ms)
+{
+	double mb = bytes / (1024.0 * 1024.0);
+	std::cout << "Read " << path << " with " << reader << ": " << mb << " MB in " << ms << " ms ("
+		<< (ms > 0.0 ? mb * 1000.0 / ms : 0.0) << " MB/s)" << std::endl;
+}
+
+void GLModelImporter::_ProcessNode(const aiScene *scene, const aiNode *node, std::vector<const aiMesh *> &meshes)
+{
+	// collect each mesh located at the current node
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		// the node object only contains indices to index the actual objects in the scene. 
+		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+		meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+	}
+	// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		_ProcessNode(scene, node->mChildren[i], meshes);
+	}
+}
+
+void GLModelImporter::_ProcessMesh(ImportedMesh &newMesh, const aiMesh *mesh, unsigned int steps, bool flipTextureY, GLArenaPool &arenas)
+{
+	// data to fill
+	std::vector<GLVertex> vertices(mesh->mNumVertices);
+	std::vector<GLuint> indices;
+
+	// Walk through each of the mesh's vertices. Missing attributes are zeroed since welding compares whole vertices.
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		GLVertex &vertex = vertices[i];
+		vertex.Position = mesh->HasPositions() ? glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z) : glm::vec3(0.0f);
+		vertex.Normal = mesh->HasNormals() ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : glm::vec3(0.0f);
+		// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+		// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+		vertex.TexCoords = mesh->HasTextureCoords(0) ? glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y) : glm::vec2(0.0f);
+		vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+		if (mesh->HasTangentsAndBitangents()) {
+			vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+			vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+		}
+	}
+	// now walk through each of the mesh's faces and retrieve the corresponding vertex indices.
+	// Points and lines sorted into their own meshes have nothing to add to a triangle list.
+	indices.reserve(mesh->mNumFaces * 3);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		const aiFace &face = mesh->mFaces[i];
+		if (face.mNumIndices == 3) {
+			indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+		}
+	}
+	_FinishMesh(newMesh, vertices, indices, steps, mesh->HasNormals(), mesh->HasTextureCoords(0), flipTextureY, arenas);
+}
+
+void GLModelImporter::_FinishMesh(ImportedMesh &newMesh, std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, unsigned int steps,
+	bool hasNormals, bool hasTexCoords, bool flipTextureY, GLArenaPool &arenas)
+{
+	GLArena &arena = arenas.Acquire();
+	GLMeshProcessor::Process(vertices, indices, steps, hasNormals, hasTexCoords, _pool, arena);
+	arenas.Release(arena);
+	// tangents were generated in the file's UV space, like assimp does
+	if (flipTextureY && hasTexCoords) {
+		for (unsigned int i = 0; i < vertices.size(); i++) {
+			vertices[i].TexCoords.y = -vertices[i].TexCoords.y;
+		}
+	}
+	glm::vec3 meshMin(FLT_MAX), meshMax(-FLT_MAX);
+	for (unsigned int i = 0; i < vertices.size(); i++) {
+		meshMin = glm::min(meshMin, vertices[i].Position);
+		meshMax = glm::max(meshMax, vertices[i].Position);
+	}
+
+	// moving the vectors into the mesh keeps their heap storage, so the pointers stay valid
+	newMesh.vertexStorage.swap(vertices);
+	newMesh.indexStorage.swap(indices);
+	newMesh.vertices = newMesh.vertexStorage.data();
+	newMesh.numVertices = newMesh.vertexStorage.size();
+	newMesh.indices = newMesh.indexStorage.data();
+	newMesh.numIndices = newMesh.indexStorage.size();
+	newMesh.minbb = meshMin;
+	newMesh.maxbb = meshMax;
+}
+
+void GLModelImporter::_LoadMaterials(ImportedModel &model, const aiMaterial *material, ImportedMesh &mesh)
+{
+	// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+	// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
+	// Same applies to other texture as the following list summarizes:
+	// diffuse: texture_diffuseN
+	// specular: texture_specularN
+	// normal: texture_normalN
+
+	// diffuse maps
+	_LoadMaterialTextures(model, material, aiTextureType_DIFFUSE, TextureType::Diffuse, mesh.textures);
+	// specular maps
+	_LoadMaterialTextures(model, material, aiTextureType_SPECULAR, TextureType::Specular, mesh.textures);
+	// normal maps (AssImp assumes height is normals)
+	_LoadMaterialTextures(model, material, aiTextureType_HEIGHT, TextureType::Normal, mesh.textures);
+	// height maps
+	_LoadMaterialTextures(model, material, aiTextureType_AMBIENT, TextureType::Height, mesh.textures);
+}
+
+void GLModelImporter::_LoadMaterialTextures(ImportedModel &model, const aiMaterial *mat, aiTextureType type, TextureType texType, std::vector<unsigned int> &meshTextures)
+{
+	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+	{
+		aiString str;
+		mat->GetTexture(type, i, &str);
+		meshTextures.push_back(_AddTexture(model, str.C_Str(), texType));
+	}
+}
+
+unsigned int GLModelImporter::_AddTexture(ImportedModel &model, const std::string &path, TextureType texType)
+{
+	// check if texture was referenced before and if so, share it
+	auto found = model.textureLookup.find(path);
+	if (found != model.textureLookup.end()) {
+		return found->second;
+	}
+	ImportedTexture texture;
+	texture.path = path;
+	texture.filename = path;
+	if (model.directory.length() > 0) {
+		texture.filename = model.directory + '\\' + texture.filename;
+	}
+	texture.type = texType;
+	model.textures.push_back(texture);
+	model.textureLookup[path] = (unsigned int)model.textures.size() - 1;
+	return (unsigned int)model.textures.size() - 1;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,192 @@
+#pragma once
+#ifndef GLMODELIMPORTER_HPP
+#define GLMODELIMPORTER_HPP
+
+#include <glm/glm.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "GLArena.hpp"
+#include "GLAssetCache.hpp"
+#include "GLAssetPack.hpp"
+#include "GLMesh.hpp"
+#include "GLMeshCache.hpp"
+#include "GLMappedFile.hpp"
+#include "GLTextureCompressor.hpp"
+#include "ThreadPool.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+namespace opengl {
+
+struct ImportedTexture
+{
+	std::string path; // as referenced by the material
+	std::string filename; // path resolved against the model directory
+	std::string cachePath; // block compressed copy of filename, empty unless compressed
+	std::string cacheName; // what that copy is called in an asset pack, filename + TEXTURE_CACHE_EXT
+	TextureType type;
+	bool skip; // set by the caller for images it already has, DecodeTextures() leaves them alone
+	unsigned char *data;
+	int width, height, components;
+	GLCompressedImage compressed; // used instead of data when texture compression is on
+	const unsigned char *encoded; // image embedded in the model file, decoded instead of reading filename
+	size_t encodedSize;
+	// the diffuse and specular images a DiffuseSpecular texture is baked from, filename only names the result
+	std::string diffuseFilename, specularFilename;
+
+	ImportedTexture() : type(TextureType::Unknown), skip(false), data(nullptr), width(0), height(0), components(0), encoded(nullptr), encodedSize(0) {}
+};
+
+// Where a vertex attribute lives when a mesh is read in place instead of converted to GLVertex.
+struct ImportedAttribute
+{
+	int buffer; // index into ImportedModel::buffers, -1 leaves the attribute disabled
+	size_t offset;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+};
+
+// Bytes of the model file that are uploaded to a GL buffer as they are.
+struct ImportedBuffer
+{
+	const unsigned char *data;
+	size_t size;
+};
+
+struct ImportedMesh
+{
+	// vertices/indices point either into the storage vectors or into the mapped mesh cache
+	std::vector<GLVertex> vertexStorage;
+	std::vector<GLuint> indexStorage;
+	const GLVertex *vertices;
+	const GLuint *indices;
+	size_t numVertices, numIndices;
+	std::vector<unsigned int> textures; // indices into ImportedModel::textures
+	// translations of the identical copies folded into this mesh, starting with its own zero; empty when it's drawn once
+	std::vector<glm::vec3> instances;
+	glm::vec3 minbb, maxbb; // around every instance
+	// set for meshes read in place from a glTF binary, their attributes and indices live in
+	// ImportedModel::buffers in the file's own layout and vertices/indices stay null
+	bool external;
+	ImportedAttribute attributes[GLMesh::NUM_ATTRIBUTES];
+	int indexBuffer;
+	size_t indexOffset;
+	GLenum indexType;
+
+	ImportedMesh() : vertices(nullptr), indices(nullptr), numVertices(0), numIndices(0), external(false), indexBuffer(-1), indexOffset(0), indexType(GL_UNSIGNED_INT) {}
+};
+
+// CPU side result of importing a model: geometry in the layout GLMesh uploads, decoded images and bounds.
+struct ImportedModel
+{
+	std::string path, directory;
+	GLMeshCache cache; // keeps the mapped geometry alive when it came from the mesh cache
+	std::string cachePath; // mesh cache the geometry was read from or written to, empty when it has none
+	std::string cacheName; // what the mesh cache is called in an asset pack, path + MESH_CACHE_EXT
+	GLMappedFile source; // the mapped glTF binary that buffers and embedded images point into
+	std::vector<ImportedBuffer> buffers;
+	std::vector<ImportedMesh> meshes;
+	std::vector<ImportedTexture> textures;
+	std::unordered_map<std::string, unsigned int> textureLookup; // path -> index into textures
+	glm::vec3 minbb, maxbb;
+	float scaleFactor;
+	// what the mesh cache is keyed on besides the import flags, zero when the geometry doesn't go through it
+	uint64_t sourceHash;
+	unsigned int cacheOptions;
+	double importMs, processMs, decodeMs; // processMs is part of importMs
+	unsigned int decodedTextures;
+	// post-processing temporaries: requests served by the load's arenas, blocks they took from the heap, bytes at their peak
+	size_t tempAllocations, tempHeapAllocations, tempPeakBytes;
+
+	ImportedModel() : minbb(0.0f), maxbb(0.0f), scaleFactor(1.0f), sourceHash(0), cacheOptions(0), importMs(0.0), processMs(0.0), decodeMs(0.0), decodedTextures(0),
+		tempAllocations(0), tempHeapAllocations(0), tempPeakBytes(0) {}
+};
+
+// First stage of model loading. Reads a model into an ImportedModel and decodes its images without
+// making any GL calls, so it runs on any thread and on machines without a GPU. GLModelLoader uploads the result.
+class GLModelImporter
+{
+public:
+	explicit GLModelImporter(ThreadPool &pool) : _pool(pool), _assimpPostProcessing(false), _channelPacking(true), _pack(nullptr), _cache(nullptr) {}
+	// The processed geometry is cached next to the model (path + MESH_CACHE_EXT) and reused
+	// on later imports as long as the source file's contents and the import options are unchanged.
+	// glTF binaries (.glb) skip the cache and are read in place, their buffer views go to GL unconverted.
+	bool Import(const std::string &path, ImportedModel &model, bool flipTextureY = false, unsigned int assimpFlags = aiProcessPreset_TargetRealtime_MaxQuality);
+	// Post-processing (normals, tangents, welding, degenerates) runs on the pool with GLMeshProcessor by default.
+	// Enabling this leaves it to assimp instead, which is slower but useful for comparing the results.
+	void SetAssimpPostProcessing(bool enabled);
+	// Materials with both a diffuse and a specular map get a single DiffuseSpecular texture instead,
+	// baked (and cached when compressed) by DecodeTexture(). Uncompressed normal maps keep only x and y.
+	// On by default.
+	void SetChannelPacking(bool enabled);
+	// Keeps the mesh and texture caches in the shared cache's directory, keyed by content, instead of next to
+	// their sources. Null, or a cache that isn't open, goes back to the sidecar files. Has to outlive the importer.
+	void SetAssetCache(GLAssetCache *cache);
+	// Mesh and texture caches found in the pack are used from its mapping without hashing their sources.
+	// Anything it doesn't hold is read from its own file as usual. The pack has to outlive the imported models.
+	void SetAssetPack(const GLAssetPack *pack);
+	// Decodes every texture that isn't marked skip across the pool.
+	void DecodeTextures(ImportedModel &model, bool compress);
+	// Fills either the compressed image (from its cache or by encoding) or the raw decoded pixels.
+	// Compressed images are cached next to the source image (filename + TEXTURE_CACHE_EXT).
+	void DecodeTexture(ImportedTexture &texture, bool compress);
+	static const unsigned char *ImageData(const ImportedTexture &texture, size_t &size);
+	// Frees the pixels but keeps the size and mip layout needed to upload from a staging buffer.
+	static void FreeImage(ImportedTexture &texture);
+
+private:
+	const std::string MESH_CACHE_EXT = ".meshcache";
+	const std::string TEXTURE_CACHE_EXT = ".bc.dds";
+
+	ThreadPool &_pool;
+	bool _assimpPostProcessing;
+	bool _channelPacking;
+	const GLAssetPack *_pack;
+	GLAssetCache *_cache;
+
+	// reads the model with assimp or the OBJ parser unless the mesh cache is up to date.
+	bool _ImportGeometry(ImportedModel &model, const std::string &path, unsigned int assimpFlags, bool flipTextureY, GLArenaPool &arenas);
+	// sets path to where a mesh or texture cache for key is: an entry of the shared cache when one is open,
+	// the sidecar file otherwise. False when the shared cache has no such entry.
+	bool _FindCache(GLAssetCache::Category category, uint64_t key, const std::string &sidecar, std::string &path);
+	// drops an entry _FindCache() returned that couldn't be read.
+	void _DiscardCache(GLAssetCache::Category category, uint64_t key);
+	// has write produce the file at path, through a temporary file that's committed to the shared cache when one is open.
+	bool _WriteCache(GLAssetCache::Category category, uint64_t key, const std::string &path, const std::function<bool(const std::string &)> &write);
+	// builds the meshes straight from a mapped cache, skipping assimp entirely.
+	void _ImportFromCache(ImportedModel &model);
+	bool _ImportAssimp(ImportedModel &model, const std::string &path, unsigned int assimpFlags, bool flipTextureY, GLArenaPool &arenas);
+	// OBJ files skip assimp entirely, the parsed meshes go through the same post-processing.
+	bool _ImportObj(ImportedModel &model, const std::string &path, unsigned int assimpFlags, bool flipTextureY, GLArenaPool &arenas);
+	// maps a glTF binary and describes its primitives without touching the vertex data.
+	// Returns false without changing the model if the file needs assimp.
+	bool _ImportGlb(ImportedModel &model, const std::string &path);
+	// folds meshes that are translated copies of an earlier mesh into its instances.
+	void _FoldInstances(ImportedModel &model);
+	// replaces each mesh's diffuse and specular map with one packed texture and drops the textures no mesh uses anymore.
+	// Runs after the mesh cache is written, which keeps the material's own maps.
+	static void _PackMaterials(ImportedModel &model);
+	static void _PrintThroughput(const std::string &path, const char *reader, size_t bytes, double ms);
+	// processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+	void _ProcessNode(const aiScene *scene, const aiNode *node, std::vector<const aiMesh *> &meshes);
+	// converts and post-processes one mesh. Touches nothing but newMesh, so meshes run in parallel.
+	void _ProcessMesh(ImportedMesh &newMesh, const aiMesh *mesh, unsigned int steps, bool flipTextureY, GLArenaPool &arenas);
+	// post-processes the mesh's corners, flips the texture coordinates and moves them into newMesh.
+	// The temporaries come from an arena that goes back to the pool reset once the mesh is done.
+	void _FinishMesh(ImportedMesh &newMesh, std::vector<GLVertex> &vertices, std::vector<GLuint> &indices, unsigned int steps,
+		bool hasNormals, bool hasTexCoords, bool flipTextureY, GLArenaPool &arenas);
+	void _LoadMaterials(ImportedModel &model, const aiMaterial *material, ImportedMesh &mesh);
+	// checks all material textures of a given type and adds the ones the model doesn't reference yet.
+	void _LoadMaterialTextures(ImportedModel &model, const aiMaterial *mat, aiTextureType type, TextureType texType, std::vector<unsigned int> &meshTextures);
+	static unsigned int _AddTexture(ImportedModel &model, const std::string &path, TextureType texType);
+};
+
+} // namespace opengl
+#endif // GLMODELIMPORTER_HPP
\ No newline at end of file
@@ -1,214 +1,589 @@
 //SOURCE: https://learnopengl.com/code_viewer_gh.php?code=includes/learnopengl/mesh.h
 
 #include "GLModelLoader.hpp"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.hpp"
-#include <float.h>
 #include "GLMatrix.hpp"
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <float.h>
+#include <numeric>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX // keeps std::max usable
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 namespace opengl {
 
-GLModel *GLModelLoader::Load(std::string const &path, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags)
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::duration<double, std::milli> Ms;
+
+// highest resident set size of the process so far
+static size_t PeakResidentBytes()
 {
-	_model = new GLModel();
-	// read file via ASSIMP
-	_gammaCorrection = gammaCorrection;
-	_flipTextureY = flipTextureY;
-	Assimp::Importer importer;
-	_scene = importer.ReadFile(path, assimpFlags);
-	// check for errors
-	if (_scene == nullptr || _scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || _scene->mRootNode == nullptr) // if is Not Zero
-	{
-		std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+		return (size_t)usage.ru_maxrss;
+#else
+		return (size_t)usage.ru_maxrss * 1024;
+#endif
+	}
+	return 0;
+#endif
+}
+
+// storage that is written through a mapping once and never changes afterwards
+static GLuint CreateMappedBuffer(size_t size, void *&data)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, GL_MAP_WRITE_BIT);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+	}
+	data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+// Projects the box's corners with transform. Returns false when they all lie outside the same frustum plane.
+// size is the area of the corners' bounding rectangle in normalized device coordinates, clamped to the
+// screen for visible boxes, so it is 4 for a box that fills the view.
+static bool ProjectBox(const glm::mat4 &transform, const glm::vec3 &minbb, const glm::vec3 &maxbb, float &size)
+{
+	size = 0.0f;
+	if (!(minbb.x <= maxbb.x && minbb.y <= maxbb.y && minbb.z <= maxbb.z)) {
 		return false;
 	}
-	// retrieve the directory path of the filepath
-	_model->_directory = "";
-	int loc = path.find_last_of("/\\");
-	if (loc != std::string::npos) {
-		_model->_directory = path.substr(0, loc);
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+	bool behind = false;
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 p = transform * glm::vec4(i & 1 ? maxbb.x : minbb.x, i & 2 ? maxbb.y : minbb.y, i & 4 ? maxbb.z : minbb.z, 1.0f);
+		outside[0] += p.x < -p.w;
+		outside[1] += p.x > p.w;
+		outside[2] += p.y < -p.w;
+		outside[3] += p.y > p.w;
+		outside[4] += p.z < -p.w;
+		outside[5] += p.z > p.w;
+		if (p.w <= 0.0f) {
+			behind = true;
+			continue;
+		}
+		glm::vec2 ndc = glm::vec2(p) / p.w;
+		lo = glm::min(lo, ndc);
+		hi = glm::max(hi, ndc);
+	}
+	bool visible = std::find(outside, outside + 6, 8) == outside + 6;
+	if (visible && behind) {
+		// a visible box that reaches behind the camera surrounds it
+		size = 4.0f;
+		return true;
+	}
+	if (visible) {
+		lo = glm::clamp(lo, glm::vec2(-1.0f), glm::vec2(1.0f));
+		hi = glm::clamp(hi, glm::vec2(-1.0f), glm::vec2(1.0f));
 	}
+	if (lo.x <= hi.x && lo.y <= hi.y) {
+		size = (hi.x - lo.x) * (hi.y - lo.y);
+	}
+	return visible;
+}
 
-	// process ASSIMP's root node recursively
-	_model->_scaleFactor = 1.0f;
-	_minbb = glm::vec3(FLT_MAX);
-	_maxbb = glm::vec3(FLT_MIN);
-	_ProcessNode(_scene->mRootNode);
+// Pages the geometry an import produced. Meshes read in place from a glTF binary have no CPU copy to page.
+static bool WritePages(const ImportedModel &imported, const std::string &pagePath, unsigned int assimpFlags)
+{
+	if (imported.sourceHash == 0) {
+		return false;
+	}
+	for (unsigned int i = 0; i < imported.meshes.size(); i++) {
+		if (imported.meshes[i].external) {
+			return false;
+		}
+	}
+	GLGeometryPageWriter writer;
+	if (!writer.Begin(pagePath)) {
+		return false;
+	}
+	for (unsigned int i = 0; i < imported.meshes.size(); i++) {
+		const ImportedMesh &mesh = imported.meshes[i];
+		writer.AddMesh(mesh.vertices, mesh.numVertices, mesh.indices, mesh.numIndices, mesh.instances);
+	}
+	return writer.End(imported.sourceHash, assimpFlags, imported.cacheOptions, imported.minbb, imported.maxbb);
+}
 
-	float tmp = _maxbb.x - _minbb.x;
-	tmp = _maxbb.y - _minbb.y > tmp ? _maxbb.y - _minbb.y : tmp;
-	tmp = _maxbb.z - _minbb.z > tmp ? _maxbb.z - _minbb.z : tmp;
-	_model->_scaleFactor = 1.0f / tmp;
-	_model->_minbb = _minbb;
-	_model->_maxbb = _maxbb;
-	return _model;
+static bool UnmapBuffer(GLuint buffer)
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	// false means the contents were lost while mapped, e.g. on a display mode change
+	GLboolean intact = glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return intact == GL_TRUE;
 }
 
-void GLModelLoader::Unload()
+// the files a texture's cache is made from, a packed copy of it goes stale when one of them changes
+static std::vector<std::string> TextureSources(const ImportedTexture &texture)
 {
-	for (unsigned int i = 0; i < _textures.size(); i++) {
-		glDeleteTextures(1, &_textures[i].id);
+	std::vector<std::string> sources;
+	if (!texture.diffuseFilename.empty()) {
+		sources.push_back(texture.diffuseFilename);
+		sources.push_back(texture.specularFilename);
+	}
+	else if (texture.encoded != nullptr) {
+		sources.push_back(texture.filename.substr(0, texture.filename.rfind('#'))); // the model it's embedded in
+	}
+	else {
+		sources.push_back(texture.filename);
 	}
+	return sources;
 }
 
-void GLModelLoader::_ProcessNode(const aiNode *node)
+GLModelLoader::~GLModelLoader()
 {
-	// process each mesh located at the current node
-	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-		// the node object only contains indices to index the actual objects in the scene. 
-		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-		aiMesh* mesh = _scene->mMeshes[node->mMeshes[i]];
-		_ProcessMesh(mesh);
+	if (_loaderThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(_jobMutex);
+			_stopLoader = true;
+		}
+		_jobReady.notify_one();
+		_loaderThread.join();
 	}
-	// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-	for (unsigned int i = 0; i < node->mNumChildren; i++) {
-		_ProcessNode(node->mChildren[i]);
+	if (_loaderContext != nullptr) {
+		SDL_GL_DeleteContext(_loaderContext);
 	}
 }
 
-void GLModelLoader::_ProcessMesh(const aiMesh *mesh)
+GLModel *GLModelLoader::Load(std::string const &path, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags)
 {
-	// data to fill
-	std::vector<GLVertex> vertices;
-	std::vector<GLuint> indices;
-	std::vector<GLTexture> meshTextures;
+	_ImportJob job;
+	_InitJob(job, new GLModel(), path, gammaCorrection, flipTextureY, assimpFlags);
+	ImportedModel &imported = *job.imported;
+	if (!_importer.Import(path, imported, flipTextureY, assimpFlags)) {
+		delete job.model;
+		return nullptr;
+	}
+	// textures an earlier model already loaded are only referenced
+	job.handles.resize(imported.textures.size(), 0);
+	for (unsigned int i = 0; i < imported.textures.size(); i++) {
+		imported.textures[i].skip = _textures.IsResident(_GetTexture(job, i).handle);
+	}
+	_importer.DecodeTextures(imported, job.compressTextures);
+	job.succeeded = true;
+	_Upload(job);
+	_PrintTimings(job);
+	return job.model;
+}
 
-	// Walk through each of the mesh's vertices
-	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-		GLVertex vertex;
-		glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-							// positions
-		if (mesh->HasPositions()) {
-			vector.x = mesh->mVertices[i].x;
-			vector.y = mesh->mVertices[i].y;
-			vector.z = mesh->mVertices[i].z;
-			vertex.Position = vector;
-			_minbb.x = std::min(_minbb.x, vector.x);
-			_minbb.y = std::min(_minbb.y, vector.y);
-			_minbb.z = std::min(_minbb.z, vector.z);
-			_maxbb.x = std::max(_maxbb.x, vector.x);
-			_maxbb.y = std::max(_maxbb.y, vector.y);
-			_maxbb.z = std::max(_maxbb.z, vector.z);
-		}
-		// normals
-		if (mesh->HasNormals()) {
-			vector.x = mesh->mNormals[i].x;
-			vector.y = mesh->mNormals[i].y;
-			vector.z = mesh->mNormals[i].z;
-			vertex.Normal = vector;
-		}
-		// texture coordinates
-		vertex.TexCoords.x = 0.0f;
-		vertex.TexCoords.y = 0.0f;
-		if (mesh->HasTextureCoords(0)) {
-			// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-			// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-			vertex.TexCoords.x = mesh->mTextureCoords[0][i].x;
-			vertex.TexCoords.y = mesh->mTextureCoords[0][i].y;
-		}
-		// tangent
-		if (mesh->HasTangentsAndBitangents()) {
-			vertex.Tangent.x = mesh->mTangents[i].x;
-			vertex.Tangent.y = mesh->mTangents[i].y;
-			vertex.Tangent.z = mesh->mTangents[i].z;
-			// bitangent
-			vertex.Bitangent.x = mesh->mBitangents[i].x;
-			vertex.Bitangent.y = mesh->mBitangents[i].y;
-			vertex.Bitangent.z = mesh->mBitangents[i].z;
-		}
-		vertices.push_back(vertex);
-	}
-	if (_flipTextureY && mesh->HasTextureCoords(0)) {
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-			vertices[i].TexCoords.y = -vertices[i].TexCoords.y;
-		}
-	}
-	// now walk through each of the mesh's faces (a face is a triangle) and retrieve the corresponding vertex indices.
-	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-		aiFace face = mesh->mFaces[i];
-		// retrieve all indices of the face and store them in the indices vector
-		for (unsigned int j = 0; j < face.mNumIndices; j++) {
-			indices.push_back(face.mIndices[j]);
-		}
-	}
-	// process materials
-	aiMaterial* material = _scene->mMaterials[mesh->mMaterialIndex];
-
-	// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-	// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-	// Same applies to other texture as the following list summarizes:
-	// diffuse: texture_diffuseN
-	// specular: texture_specularN
-	// normal: texture_normalN
-
-	// diffuse maps
-	std::vector<GLTexture> diffuseMaps = _LoadMaterialTextures(material, aiTextureType_DIFFUSE, TextureType::Diffuse);
-	meshTextures.insert(meshTextures.end(), diffuseMaps.begin(), diffuseMaps.end());
-	// specular maps
-	std::vector<GLTexture> specularMaps = _LoadMaterialTextures(material, aiTextureType_SPECULAR, TextureType::Specular);
-	meshTextures.insert(meshTextures.end(), specularMaps.begin(), specularMaps.end());
-	// normal maps (AssImp assumes height is normals)
-	std::vector<GLTexture> normalMaps = _LoadMaterialTextures(material, aiTextureType_HEIGHT, TextureType::Normal);
-	meshTextures.insert(meshTextures.end(), normalMaps.begin(), normalMaps.end());
-	// height maps
-	std::vector<GLTexture> heightMaps = _LoadMaterialTextures(material, aiTextureType_AMBIENT, TextureType::Height);
-	meshTextures.insert(meshTextures.end(), heightMaps.begin(), heightMaps.end());
-
-	// return a mesh object created from the extracted mesh data
-	GLMesh newMesh;
-	newMesh.Load(vertices, indices, meshTextures);
-	_model->_meshes.push_back(newMesh);
+GLModel *GLModelLoader::LoadOutOfCore(std::string const &path, size_t budget, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags)
+{
+	_ImportJob job;
+	_InitJob(job, new GLModel(), path, gammaCorrection, flipTextureY, assimpFlags);
+	ImportedModel &imported = *job.imported;
+	// with an up to date mesh cache this only maps it, none of the geometry is read. Without one this is the
+	// full in-memory import the pages are then built from (see the LoadOutOfCore() comment).
+	if (!_importer.Import(path, imported, flipTextureY, assimpFlags)) {
+		delete job.model;
+		return nullptr;
+	}
+	const std::string pagePath = path + PAGE_EXT;
+	GLGeometryStreamer *geometry = new GLGeometryStreamer(_pool);
+	if (!geometry->Open(pagePath, imported.sourceHash, assimpFlags, imported.cacheOptions, budget)) {
+		if (!WritePages(imported, pagePath, assimpFlags)
+			|| !geometry->Open(pagePath, imported.sourceHash, assimpFlags, imported.cacheOptions, budget)) {
+			std::cout << "Failed to page the geometry of: " << path << std::endl;
+			delete geometry;
+			delete job.model;
+			return nullptr;
+		}
+	}
+	// the geometry only comes from the pages from here on
+	imported.cache.Close();
+	for (unsigned int i = 0; i < imported.meshes.size(); i++) {
+		ImportedMesh &mesh = imported.meshes[i];
+		std::vector<GLVertex>().swap(mesh.vertexStorage);
+		std::vector<GLuint>().swap(mesh.indexStorage);
+		mesh.vertices = nullptr;
+		mesh.indices = nullptr;
+	}
+
+	job.handles.resize(imported.textures.size(), 0);
+	for (unsigned int i = 0; i < imported.textures.size(); i++) {
+		imported.textures[i].skip = _textures.IsResident(_GetTexture(job, i).handle);
+	}
+	_importer.DecodeTextures(imported, job.compressTextures);
+	job.succeeded = true;
+	Clock::time_point start = Clock::now();
+	_PublishModel(job);
+	_UploadTextures(job);
+	for (unsigned int i = 0; i < imported.meshes.size() && i < geometry->NumMeshes(); i++) {
+		std::vector<GLTexture> textures = _GetTextures(job, imported.meshes[i]);
+		geometry->SetMesh(i, textures, _streamer.AddFeedbackGroup(textures));
+	}
+	job.model->_geometry = geometry;
+	_geometry.push_back(geometry);
+	job.uploadMs += Ms(Clock::now() - start).count();
+	_PrintTimings(job);
+	return job.model;
+}
+
+GLModel *GLModelLoader::Upload(ImportedModel &imported)
+{
+	_ImportJob job;
+	_InitJob(job, new GLModel(), imported.path, false, false, 0);
+	job.imported = &imported;
+	_Upload(job);
+	return job.model;
+}
+
+GLModel *GLModelLoader::LoadAsync(std::string const &path, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags)
+{
+	std::shared_ptr<_ImportJob> job = std::make_shared<_ImportJob>();
+	_InitJob(*job, new GLModel(), path, gammaCorrection, flipTextureY, assimpFlags);
+	return _LoadAsync(job);
+}
+
+GLModel *GLModelLoader::LoadAsync(std::string const &path, const glm::mat4 &placement, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags)
+{
+	std::shared_ptr<_ImportJob> job = std::make_shared<_ImportJob>();
+	_InitJob(*job, new GLModel(), path, gammaCorrection, flipTextureY, assimpFlags);
+	// without a view there is nothing to prioritize for
+	job->prioritized = _hasLoadView;
+	job->viewProjModel = _loadView * placement;
+	return _LoadAsync(job);
+}
+
+void GLModelLoader::SetLoadView(const glm::mat4 &viewProj)
+{
+	_loadView = viewProj;
+	_hasLoadView = true;
 }
 
-std::vector<GLTexture> GLModelLoader::_LoadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType texType)
+GLModel *GLModelLoader::_LoadAsync(std::shared_ptr<_ImportJob> job)
 {
-	std::vector<GLTexture> matTextures;
-	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+	_StartLoader();
+	job->queued = Clock::now();
+	_pendingLoads++;
+	_pendingVisible++;
 	{
-		aiString str;
-		mat->GetTexture(type, i, &str);
-		// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-		bool skip = false;
-		for (unsigned int j = 0; j < _textures.size(); j++) {
-			if (std::strcmp(_textures[j].path.C_Str(), str.C_Str()) == 0) {
-				matTextures.push_back(_textures[j]);
-				skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+		std::lock_guard<std::mutex> lock(_jobMutex);
+		_jobs.push_back(job);
+	}
+	_jobReady.notify_one();
+	return job->model;
+}
+
+void GLModelLoader::Update(float budgetMs)
+{
+	Clock::time_point start = Clock::now();
+	for (;;) {
+		_UploadItem item;
+		{
+			std::lock_guard<std::mutex> lock(_uploadMutex);
+			if (_uploads.empty()) {
 				break;
 			}
+			item = _uploads.front();
+		}
+		if (item.fence != nullptr) {
+			// the loader context hasn't finished with these buffers yet, try again next frame
+			if (glClientWaitSync(item.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				break;
+			}
+			glDeleteSync(item.fence);
+		}
+		{
+			std::lock_guard<std::mutex> lock(_uploadMutex);
+			_uploads.pop_front();
+		}
+		_FinishUpload(item);
+		if (Ms(Clock::now() - start).count() >= budgetMs) {
+			break;
+		}
+	}
+	_streamer.Update(std::max(0.0f, budgetMs - (float)Ms(Clock::now() - start).count()));
+	for (unsigned int i = 0; i < _geometry.size(); i++) {
+		_geometry[i]->Update(std::max(0.0f, budgetMs - (float)Ms(Clock::now() - start).count()));
+	}
+}
+
+bool GLModelLoader::IsLoading() const
+{
+	return _pendingLoads > 0;
+}
+
+bool GLModelLoader::IsVisibleLoaded() const
+{
+	return _pendingVisible == 0;
+}
+
+void GLModelLoader::SetTextureCompression(bool enabled)
+{
+	_compressTextures = enabled;
+}
+
+void GLModelLoader::SetChannelPacking(bool enabled)
+{
+	_importer.SetChannelPacking(enabled);
+}
+
+GLAssetCache &GLModelLoader::GetCache()
+{
+	return _cache;
+}
+
+void GLModelLoader::SetAssetPack(const GLAssetPack *pack)
+{
+	_importer.SetAssetPack(pack);
+	_streamer.SetAssetPack(pack);
+}
+
+bool GLModelLoader::WriteAssetPack(const std::string &packPath, const std::vector<std::string> &files) const
+{
+	GLAssetPackWriter writer;
+	for (unsigned int i = 0; i < _packFiles.size(); i++) {
+		writer.AddFile(_packFiles[i].name, _packFiles[i].path, _packFiles[i].sources);
+	}
+	for (unsigned int i = 0; i < files.size(); i++) {
+		writer.AddFile(files[i]);
+	}
+	if (!writer.Write(packPath)) {
+		std::cout << "Failed to write asset pack: " << packPath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+GLTextureStreamer &GLModelLoader::GetStreamer()
+{
+	return _streamer;
+}
+
+void GLModelLoader::Unload(GLModel *model)
+{
+	for (unsigned int i = 0; i < model->_textures.size(); i++) {
+		_textures.Release(model->_textures[i].handle);
+		if (_textures.RefCount(model->_textures[i].handle) == 0) {
+			_streamer.Unregister(model->_textures[i].handle);
+		}
+	}
+	for (unsigned int i = 0; i < model->_meshes.size(); i++) {
+		model->_meshes[i].Unload();
+	}
+	if (!model->_buffers.empty()) {
+		glDeleteBuffers((GLsizei)model->_buffers.size(), model->_buffers.data());
+	}
+	if (model->_geometry != nullptr) {
+		_geometry.erase(std::find(_geometry.begin(), _geometry.end(), model->_geometry));
+		delete model->_geometry;
+	}
+	delete model;
+}
+
+void GLModelLoader::Unload()
+{
+	_streamer.Clear();
+	_textures.Clear();
+}
+
+void GLModelLoader::_InitJob(_ImportJob &job, GLModel *model, const std::string &path, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags)
+{
+	job.model = model;
+	job.imported = &job.ownedModel;
+	job.path = path;
+	job.gammaCorrection = gammaCorrection;
+	job.flipTextureY = flipTextureY;
+	job.assimpFlags = assimpFlags;
+	// BC4/BC5 are core since GL 3.0, BC1/BC3 still need the S3TC extension
+	job.compressTextures = _compressTextures && GLEW_EXT_texture_compression_s3tc;
+	job.succeeded = false;
+	job.sharedContext = false;
+	job.prioritized = false;
+	job.visibleLoaded = false;
+	job.viewProjModel = glm::mat4(1.0f);
+	job.numVisible = 0;
+	job.stageMs = 0.0;
+	job.uploadMs = 0.0;
+}
+
+void GLModelLoader::_Upload(_ImportJob &job)
+{
+	ImportedModel &imported = *job.imported;
+	Clock::time_point start = Clock::now();
+	_PublishModel(job);
+	_UploadTextures(job);
+	_CreateBuffers(imported, job.model->_buffers);
+	for (unsigned int i = 0; i < imported.meshes.size(); i++) {
+		job.model->_meshes.push_back(_CreateMesh(job, imported.meshes[i]));
+	}
+	job.uploadMs += Ms(Clock::now() - start).count();
+}
+
+void GLModelLoader::_UploadTextures(_ImportJob &job)
+{
+	ImportedModel &imported = *job.imported;
+	job.handles.resize(imported.textures.size(), 0);
+	// GL uploads have to stay on the thread that owns the context
+	for (unsigned int i = 0; i < imported.textures.size(); i++) {
+		ImportedTexture &texture = imported.textures[i];
+		GLTexture glTexture = _GetTexture(job, i);
+		if (!_textures.IsResident(glTexture.handle)) {
+			_FinishTexture(glTexture, texture, 0);
 		}
-		if (!skip) {  // if texture hasn't been loaded already, load it
-			GLTexture texture;
-			texture.id = _TextureFromFile(str.C_Str(), _model->_directory, _gammaCorrection);
-			texture.type = texType;
-			texture.path = str;
-			matTextures.push_back(texture);
-			_textures.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+		GLModelImporter::FreeImage(texture);
+	}
+}
+
+void GLModelLoader::_FinishTexture(const GLTexture &glTexture, const ImportedTexture &texture, GLuint pbo)
+{
+	size_t size;
+	if (GLModelImporter::ImageData(texture, size) == nullptr && pbo == 0) {
+		_UploadTexture(glTexture.id, texture, pbo, 0); // reports the failure
+		return;
+	}
+	// streamed textures start from a small mip tail, feedback brings in the rest
+	bool streamed = _streamer.IsEnabled() && !texture.compressed.levels.empty();
+	unsigned int firstLevel = streamed ? GLTextureStreamer::InitialLevel(texture.compressed) : 0;
+	_UploadTexture(glTexture.id, texture, pbo, firstLevel);
+	_textures.SetResident(glTexture.handle, true);
+	if (!texture.cachePath.empty()) {
+		_PackFile file;
+		file.name = texture.cacheName;
+		file.path = texture.cachePath;
+		file.sources = TextureSources(texture);
+		_packFiles.push_back(file);
+	}
+	if (streamed) {
+		_streamer.Register(glTexture.handle, glTexture.id, texture.cachePath, texture.compressed, firstLevel);
+	}
+}
+
+GLMesh GLModelLoader::_CreateMesh(_ImportJob &job, const ImportedMesh &mesh)
+{
+	std::vector<GLTexture> textures = _GetTextures(job, mesh);
+	GLMesh newMesh;
+	if (mesh.external) {
+		const std::vector<GLuint> &buffers = job.model->_buffers;
+		GLVertexAttribute attributes[GLMesh::NUM_ATTRIBUTES];
+		for (unsigned int i = 0; i < GLMesh::NUM_ATTRIBUTES; i++) {
+			const ImportedAttribute &attribute = mesh.attributes[i];
+			attributes[i].buffer = attribute.buffer >= 0 ? buffers[attribute.buffer] : 0;
+			attributes[i].offset = attribute.offset;
+			attributes[i].size = attribute.size;
+			attributes[i].type = attribute.type;
+			attributes[i].normalized = attribute.normalized;
+			attributes[i].stride = attribute.stride;
 		}
+		newMesh.Load(attributes, buffers[mesh.indexBuffer], mesh.indexType, mesh.indexOffset, mesh.numIndices, textures);
+	}
+	else {
+		newMesh.Load(mesh.vertices, mesh.numVertices, mesh.indices, mesh.numIndices, textures);
+	}
+	if (!mesh.instances.empty()) {
+		newMesh.SetInstances(mesh.instances);
+	}
+	newMesh.SetFeedbackId(_streamer.AddFeedbackGroup(textures));
+	return newMesh;
+}
+
+void GLModelLoader::_CreateBuffers(ImportedModel &imported, std::vector<GLuint> &buffers)
+{
+	for (unsigned int i = 0; i < imported.buffers.size(); i++) {
+		buffers.push_back(GLMesh::CreateBuffer(imported.buffers[i].data, imported.buffers[i].size));
 	}
-	return matTextures;
+	_PackMeshes(imported, buffers);
 }
 
-GLuint GLModelLoader::_TextureFromFile(const std::string &path, const std::string &directory, bool gamma)
+void GLModelLoader::_PackMeshes(ImportedModel &imported, std::vector<GLuint> &buffers)
 {
-	int width, height, nrComponents;
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	std::string filename = path;
-	if (directory.length() > 0) {
-		filename = directory + '\\' + path;
+	std::vector<size_t> firstVertex(imported.meshes.size(), 0), firstIndex(imported.meshes.size(), 0);
+	size_t numVertices = 0, numIndices = 0;
+	for (unsigned int i = 0; i < imported.meshes.size(); i++) {
+		if (!imported.meshes[i].external) {
+			firstVertex[i] = numVertices;
+			firstIndex[i] = numIndices;
+			numVertices += imported.meshes[i].numVertices;
+			numIndices += imported.meshes[i].numIndices;
+		}
+	}
+	if (numVertices == 0 || numIndices == 0) {
+		return;
+	}
+	void *vertexData, *indexData;
+	GLuint vbo = CreateMappedBuffer(numVertices * sizeof(GLVertex), vertexData);
+	GLuint ebo = CreateMappedBuffer(numIndices * sizeof(GLuint), indexData);
+	if (vertexData == nullptr || indexData == nullptr) {
+		std::cout << "Failed to map the geometry buffers of " << imported.path << ", uploading mesh by mesh" << std::endl;
+		if (vertexData != nullptr) {
+			UnmapBuffer(vbo);
+		}
+		if (indexData != nullptr) {
+			UnmapBuffer(ebo);
+		}
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ebo);
+		return;
+	}
+	const int vertexBuffer = (int)buffers.size();
+	buffers.push_back(vbo);
+	buffers.push_back(ebo);
+	const size_t offsets[GLMesh::NUM_ATTRIBUTES] = { offsetof(GLVertex, Position), offsetof(GLVertex, Normal), offsetof(GLVertex, TexCoords),
+		offsetof(GLVertex, Tangent), offsetof(GLVertex, Bitangent) };
+	const GLint sizes[GLMesh::NUM_ATTRIBUTES] = { 3, 3, 2, 3, 3 };
+	_pool.ParallelFor(imported.meshes.size(), [&](size_t i) {
+		ImportedMesh &mesh = imported.meshes[i];
+		if (mesh.external) {
+			return;
+		}
+		std::memcpy((GLVertex *)vertexData + firstVertex[i], mesh.vertices, mesh.numVertices * sizeof(GLVertex));
+		std::memcpy((GLuint *)indexData + firstIndex[i], mesh.indices, mesh.numIndices * sizeof(GLuint));
+		std::vector<GLVertex>().swap(mesh.vertexStorage);
+		std::vector<GLuint>().swap(mesh.indexStorage);
+		mesh.vertices = nullptr;
+		mesh.indices = nullptr;
+		// indices stay relative to the mesh, so its attributes start at its first vertex instead
+		mesh.external = true;
+		for (unsigned int j = 0; j < GLMesh::NUM_ATTRIBUTES; j++) {
+			mesh.attributes[j].buffer = vertexBuffer;
+			mesh.attributes[j].offset = firstVertex[i] * sizeof(GLVertex) + offsets[j];
+			mesh.attributes[j].size = sizes[j];
+			mesh.attributes[j].type = GL_FLOAT;
+			mesh.attributes[j].normalized = GL_FALSE;
+			mesh.attributes[j].stride = sizeof(GLVertex);
+		}
+		mesh.indexBuffer = vertexBuffer + 1;
+		mesh.indexOffset = firstIndex[i] * sizeof(GLuint);
+		mesh.indexType = GL_UNSIGNED_INT;
+	});
+	if (!UnmapBuffer(vbo) || !UnmapBuffer(ebo)) {
+		std::cout << "Geometry buffers of " << imported.path << " were lost while mapped" << std::endl;
 	}
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data) {
-		GLenum format = 0;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
+	// nothing points into the mapped mesh cache anymore
+	imported.cache.Close();
+}
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
+void GLModelLoader::_UploadTexture(GLuint id, const ImportedTexture &texture, GLuint pbo, unsigned int firstLevel)
+{
+	size_t size;
+	const unsigned char *pixels = GLModelImporter::ImageData(texture, size);
+	if (pixels || pbo != 0) {
+		glBindTexture(GL_TEXTURE_2D, id);
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		//glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		//glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
@@ -217,14 +592,403 @@ GLuint GLModelLoader::_TextureFromFile(const std::string &path, const std::strin
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		if (pbo != 0) {
+			// the pixels are already in GPU visible memory, the data pointers are offsets into the bound buffer
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		}
+		const std::vector<GLCompressedImage::Level> &levels = texture.compressed.levels;
+		if (!levels.empty()) {
+			// the whole mip chain comes precomputed, nothing to generate
+			for (unsigned int i = firstLevel; i < levels.size(); i++) {
+				const void *data = pbo != 0 ? (const void *)(uintptr_t)levels[i].offset : pixels + levels[i].offset;
+				glCompressedTexImage2D(GL_TEXTURE_2D, i - firstLevel, texture.compressed.format, levels[i].width, levels[i].height, 0, (GLsizei)levels[i].size, data);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)(levels.size() - 1 - firstLevel));
+		}
+		else {
+			GLenum format = 0;
+			if (texture.components == 1)
+				format = GL_RED;
+			else if (texture.components == 2)
+				format = GL_RG;
+			else if (texture.components == 3)
+				format = GL_RGB;
+			else if (texture.components == 4)
+				format = GL_RGBA;
+			glTexImage2D(GL_TEXTURE_2D, 0, format, texture.width, texture.height, 0, format, GL_UNSIGNED_BYTE, pbo != 0 ? (const void *)0 : pixels);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		if (pbo != 0) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
 	}
 	else {
-		std::cout << "Texture failed to load at path: " << path << std::endl;
+		std::cout << "Texture failed to load at path: " << texture.filename << std::endl;
+	}
+}
+
+void GLModelLoader::_UploadPlaceholder(GLuint id, TextureType texType)
+{
+	// neutral values so unlit/unmapped surfaces look plausible: grey albedo, flat normal, no specular
+	unsigned char texel[4] = { 128, 128, 128, 255 };
+	if (texType == TextureType::Normal) {
+		texel[2] = 255;
+	}
+	else if (texType == TextureType::Specular) {
+		texel[0] = texel[1] = texel[2] = 0;
+	}
+	else if (texType == TextureType::DiffuseSpecular) {
+		texel[3] = 0;
+	}
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// no mipmaps yet, so a mipmapped min filter would leave the texture incomplete
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+}
+
+GLTexture GLModelLoader::_GetTexture(_ImportJob &job, unsigned int index)
+{
+	const ImportedTexture &texture = job.imported->textures[index];
+	unsigned int &handle = job.handles[index];
+	if (handle == 0) {
+		// keyed by the resolved filename, so models in different directories don't mix up relative paths
+		bool created;
+		handle = _textures.Acquire(texture.filename, texture.type, created);
+		if (created) {
+			_UploadPlaceholder(_textures.Id(handle), texture.type);
+		}
+		job.model->_textures.push_back(_textures.Get(handle));
+	}
+	// the sampler slot follows this material's usage, not whoever registered the file first
+	GLTexture glTexture = _textures.Get(handle);
+	glTexture.type = texture.type;
+	return glTexture;
+}
+
+std::vector<GLTexture> GLModelLoader::_GetTextures(_ImportJob &job, const ImportedMesh &mesh)
+{
+	std::vector<GLTexture> meshTextures;
+	for (unsigned int i = 0; i < mesh.textures.size(); i++) {
+		meshTextures.push_back(_GetTexture(job, mesh.textures[i]));
+	}
+	return meshTextures;
+}
+
+void GLModelLoader::_PublishModel(const _ImportJob &job)
+{
+	job.model->_directory = job.imported->directory;
+	job.model->_scaleFactor = job.imported->scaleFactor;
+	job.model->_minbb = job.imported->minbb;
+	job.model->_maxbb = job.imported->maxbb;
+	if (!job.imported->cachePath.empty()) {
+		_PackFile file;
+		file.name = job.imported->cacheName;
+		file.path = job.imported->cachePath;
+		file.sources.push_back(job.imported->path);
+		_packFiles.push_back(file);
+	}
+}
+
+void GLModelLoader::_FinishVisible(_ImportJob &job)
+{
+	if (job.visibleLoaded) {
+		return;
+	}
+	job.visibleLoaded = true;
+	_pendingVisible--;
+	if (job.succeeded && job.prioritized) {
+		std::cout << "Visible part of " << job.path << " resident after " << Ms(Clock::now() - job.queued).count() << " ms ("
+			<< job.numVisible << " of " << job.imported->meshes.size() << " meshes)" << std::endl;
+	}
+}
+
+void GLModelLoader::_PrintTimings(const _ImportJob &job)
+{
+	const ImportedModel &imported = *job.imported;
+	std::cout << "Loaded " << job.path << ": " << imported.meshes.size() << " meshes, " << imported.textures.size()
+		<< " textures, import " << imported.importMs << " ms (post-process " << imported.processMs << " ms), decode " << imported.decodeMs << " ms ("
+		<< imported.decodedTextures << " on " << _pool.NumThreads() << " threads), upload " << job.uploadMs << " ms";
+	if (job.stageMs > 0.0) {
+		std::cout << " + " << job.stageMs << " ms staged on the loader " << (job.sharedContext ? "context" : "thread");
+	}
+	std::cout << std::endl;
+	std::cout << "  temporaries: " << imported.tempAllocations << " allocations from " << imported.tempHeapAllocations << " heap blocks, "
+		<< imported.tempPeakBytes / (1024.0 * 1024.0) << " MB at peak; process peak RSS " << PeakResidentBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+void GLModelLoader::_StartLoader()
+{
+	if (_loaderThread.joinable()) {
+		return;
+	}
+	// creating the shared context makes it current, so switch back to the render context afterwards
+	_window = SDL_GL_GetCurrentWindow();
+	SDL_GLContext renderContext = SDL_GL_GetCurrentContext();
+	if (_window != nullptr && renderContext != nullptr && GLEW_ARB_sync) {
+		SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+		_loaderContext = SDL_GL_CreateContext(_window);
+		SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+		SDL_GL_MakeCurrent(_window, renderContext);
+	}
+	if (_loaderContext == nullptr) {
+		std::cout << "Failed to create a shared loader context, uploads will run on the render thread: " << SDL_GetError() << std::endl;
+	}
+	_stopLoader = false;
+	_loaderThread = std::thread(&GLModelLoader::_LoaderLoop, this);
+}
+
+void GLModelLoader::_LoaderLoop()
+{
+	bool sharedContext = _loaderContext != nullptr && SDL_GL_MakeCurrent(_window, _loaderContext) == 0;
+	for (;;) {
+		std::shared_ptr<_ImportJob> job;
+		{
+			std::unique_lock<std::mutex> lock(_jobMutex);
+			_jobReady.wait(lock, [this] { return _stopLoader || !_jobs.empty(); });
+			if (_stopLoader) {
+				break;
+			}
+			job = _jobs.front();
+			_jobs.pop_front();
+		}
+		_LoadJob(job, sharedContext);
+	}
+	if (sharedContext) {
+		SDL_GL_MakeCurrent(_window, nullptr);
+	}
+}
+
+void GLModelLoader::_LoadJob(const std::shared_ptr<_ImportJob> &job, bool sharedContext)
+{
+	ImportedModel &imported = *job->imported;
+	_UploadItem item;
+	item.job = job;
+	item.index = 0;
+	item.pbo = 0;
+	item.fence = nullptr;
+	if (!_importer.Import(job->path, imported, job->flipTextureY, job->assimpFlags)) {
+		item.kind = _UploadKind::Done;
+		_PushUpload(item);
+		return;
+	}
+	job->succeeded = true;
+	item.kind = _UploadKind::Model;
+	_PushUpload(item);
+
+	// geometry first so the scene shows up with placeholder textures while the images decode
+	Clock::time_point start = Clock::now();
+	if (!imported.meshes.empty()) {
+		_UploadItem buffersItem = item;
+		buffersItem.kind = _UploadKind::Buffers;
+		if (sharedContext) {
+			_CreateBuffers(imported, job->buffers);
+			// flushing makes sure the fence actually gets submitted and can signal
+			buffersItem.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+		}
+		_PushUpload(buffersItem);
+	}
+	std::vector<unsigned int> order;
+	_PrioritizeMeshes(*job, order, job->numVisible);
+	for (unsigned int i = 0; i < order.size(); i++) {
+		_UploadItem meshItem = item;
+		meshItem.kind = _UploadKind::Mesh;
+		meshItem.index = order[i];
+		_PushUpload(meshItem);
+	}
+	job->stageMs = Ms(Clock::now() - start).count();
+
+	// decodes are queued in the order the meshes first use the textures, so the visible ones finish
+	// first. Once those are staged the marker tells the render thread the view is complete.
+	std::vector<unsigned int> textureOrder;
+	std::vector<unsigned char> queued(imported.textures.size(), 0);
+	std::vector<unsigned char> visibleTexture(imported.textures.size(), 0);
+	unsigned int numVisibleTextures = 0;
+	for (unsigned int i = 0; i < order.size(); i++) {
+		const std::vector<unsigned int> &meshTextures = imported.meshes[order[i]].textures;
+		for (unsigned int t = 0; t < meshTextures.size(); t++) {
+			unsigned int index = meshTextures[t];
+			if (!queued[index]) {
+				queued[index] = 1;
+				textureOrder.push_back(index);
+				if (i < job->numVisible) {
+					visibleTexture[index] = 1;
+					numVisibleTextures++;
+				}
+			}
+		}
+	}
+	for (unsigned int i = 0; i < imported.textures.size(); i++) {
+		if (!queued[i]) {
+			textureOrder.push_back(i);
+		}
+	}
+	_UploadItem visibleItem = item;
+	visibleItem.kind = _UploadKind::Visible;
+	if (numVisibleTextures == 0) {
+		_PushUpload(visibleItem);
+	}
+
+	// textures are staged in the order they finish decoding
+	start = Clock::now();
+	std::mutex decodedMutex;
+	std::condition_variable decodedReady;
+	std::deque<unsigned int> decoded;
+	unsigned int numDecoded = 0;
+	for (unsigned int n = 0; n < textureOrder.size(); n++) {
+		unsigned int i = textureOrder[n];
+		// files another model already uploaded only need their handle, the render thread shares them
+		imported.textures[i].skip = _textures.IsResident(imported.textures[i].filename);
+		if (imported.textures[i].skip) {
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			decoded.push_back(i);
+			continue;
+		}
+		numDecoded++;
+		_pool.Submit([this, job, i, &decodedMutex, &decodedReady, &decoded] {
+			_importer.DecodeTexture(job->imported->textures[i], job->compressTextures);
+			std::lock_guard<std::mutex> lock(decodedMutex);
+			decoded.push_back(i);
+			decodedReady.notify_one();
+		});
+	}
+	double textureStageMs = 0.0;
+	for (unsigned int n = 0; n < imported.textures.size(); n++) {
+		unsigned int i;
+		{
+			std::unique_lock<std::mutex> lock(decodedMutex);
+			decodedReady.wait(lock, [&decoded] { return !decoded.empty(); });
+			i = decoded.front();
+			decoded.pop_front();
+		}
+		Clock::time_point stageStart = Clock::now();
+		ImportedTexture &texture = imported.textures[i];
+		_UploadItem textureItem = item;
+		textureItem.kind = _UploadKind::Texture;
+		textureItem.index = i;
+		size_t size;
+		const unsigned char *pixels = GLModelImporter::ImageData(texture, size);
+		if (sharedContext && pixels) {
+			// copy into a pixel buffer so the render thread's glTexImage2D is a GPU side transfer
+			glGenBuffers(1, &textureItem.pbo);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, textureItem.pbo);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			if (dst != nullptr) {
+				std::memcpy(dst, pixels, size);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				GLModelImporter::FreeImage(texture);
+			}
+			else {
+				glDeleteBuffers(1, &textureItem.pbo);
+				textureItem.pbo = 0;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (textureItem.pbo != 0) {
+				textureItem.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				glFlush();
+			}
+		}
+		_PushUpload(textureItem);
+		if (visibleTexture[i] && --numVisibleTextures == 0) {
+			_PushUpload(visibleItem);
+		}
+		textureStageMs += Ms(Clock::now() - stageStart).count();
+	}
+	// decoding overlaps with staging, so only the time spent waiting on the pool counts as decode
+	imported.decodedTextures = numDecoded;
+	imported.decodeMs = Ms(Clock::now() - start).count() - textureStageMs;
+	job->stageMs += textureStageMs;
+	job->sharedContext = sharedContext;
+	item.kind = _UploadKind::Done;
+	_PushUpload(item);
+}
+
+void GLModelLoader::_PrioritizeMeshes(const _ImportJob &job, std::vector<unsigned int> &order, unsigned int &numVisible)
+{
+	const ImportedModel &imported = *job.imported;
+	unsigned int numMeshes = (unsigned int)imported.meshes.size();
+	order.resize(numMeshes);
+	std::iota(order.begin(), order.end(), 0u);
+	numVisible = numMeshes;
+	if (!job.prioritized) {
+		return;
+	}
+	// the mesh bounds are in model space, before the scale factor the renderer applies
+	glm::mat4 transform = glm::scale(job.viewProjModel, glm::vec3(imported.scaleFactor));
+	std::vector<float> sizes(numMeshes);
+	std::vector<unsigned char> visible(numMeshes);
+	numVisible = 0;
+	for (unsigned int i = 0; i < numMeshes; i++) {
+		const ImportedMesh &mesh = imported.meshes[i];
+		visible[i] = ProjectBox(transform, mesh.minbb, mesh.maxbb, sizes[i]);
+		numVisible += visible[i];
+	}
+	// meshes in view first, the biggest on screen leading each group
+	std::stable_sort(order.begin(), order.end(), [&visible, &sizes](unsigned int a, unsigned int b) {
+		if (visible[a] != visible[b]) {
+			return visible[a] > visible[b];
+		}
+		return sizes[a] > sizes[b];
+	});
+}
+
+void GLModelLoader::_PushUpload(const _UploadItem &item)
+{
+	std::lock_guard<std::mutex> lock(_uploadMutex);
+	_uploads.push_back(item);
+}
+
+void GLModelLoader::_FinishUpload(const _UploadItem &item)
+{
+	_ImportJob &job = *item.job;
+	Clock::time_point start = Clock::now();
+	if (item.kind == _UploadKind::Model) {
+		_PublishModel(job);
+		job.handles.resize(job.imported->textures.size(), 0);
+	}
+	else if (item.kind == _UploadKind::Buffers) {
+		// with a fence the loader context has created them already
+		if (item.fence == nullptr) {
+			_CreateBuffers(*job.imported, job.buffers);
+		}
+		job.model->_buffers = job.buffers;
+	}
+	else if (item.kind == _UploadKind::Mesh) {
+		job.model->_meshes.push_back(_CreateMesh(job, job.imported->meshes[item.index]));
+	}
+	else if (item.kind == _UploadKind::Texture) {
+		ImportedTexture &texture = job.imported->textures[item.index];
+		GLTexture glTexture = _GetTexture(job, item.index);
+		// another model may have finished the same file already
+		if (!_textures.IsResident(glTexture.handle)) {
+			if (texture.skip) {
+				// it was released again between the loader's lookup and now
+				_importer.DecodeTexture(texture, job.compressTextures);
+			}
+			_FinishTexture(glTexture, texture, item.pbo);
+		}
+		if (item.pbo != 0) {
+			glDeleteBuffers(1, &item.pbo);
+		}
+		GLModelImporter::FreeImage(texture);
+	}
+	else if (item.kind == _UploadKind::Visible) {
+		_FinishVisible(job);
+	}
+	else {
+		// a failed import never gets a visible marker
+		_FinishVisible(job);
+		_pendingLoads--;
+		if (job.succeeded) {
+			_PrintTimings(job);
+		}
+		return;
 	}
-	stbi_image_free(data);
-	return textureID;
+	job.uploadMs += Ms(Clock::now() - start).count();
 }
 
 } // namespace opengl
\ No newline at end of file
@@ -7,12 +7,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 //#include <stb_image.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include <SDL_video.h>
 
 #include "GLMesh.hpp"
 #include "GLModel.hpp"
+#include "GLModelImporter.hpp"
+#include "GLTextureRegistry.hpp"
+#include "GLTextureStreamer.hpp"
+#include "GLGeometryStreamer.hpp"
+#include "ThreadPool.hpp"
 
 #include <string>
 #include <fstream>
@@ -20,6 +23,12 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 
 namespace opengl {
 
@@ -28,26 +37,167 @@ class GLModel;
 class GLModelLoader
 {
 public:
-	GLModelLoader() {};
+	GLModelLoader() : _importer(_pool), _compressTextures(true), _streamer(_pool), _hasLoadView(false), _window(nullptr), _loaderContext(nullptr), _stopLoader(false), _pendingLoads(0), _pendingVisible(0) { _importer.SetAssetCache(&_cache); };
+	~GLModelLoader();
 	//aiProcessPreset_TargetRealtime_MaxQuality, aiProcessPreset_TargetRealtime_Quality, aiProcessPreset_TargetRealtime_Fast
+	// Imports the model with GLModelImporter (geometry and images cached next to their sources) and uploads it.
 	GLModel *Load(std::string const &path, bool gammaCorrection = false, bool flipTextureY = false, unsigned int assimpFlags = aiProcessPreset_TargetRealtime_MaxQuality);
+	// Returns an empty model right away and loads it on a background thread with its own shared GL context.
+	// Meshes and textures are added to the model as they become resident, textures are drawn with a
+	// 1x1 placeholder until their image arrives. Must be called from the render thread.
+	GLModel *LoadAsync(std::string const &path, bool gammaCorrection = false, bool flipTextureY = false, unsigned int assimpFlags = aiProcessPreset_TargetRealtime_MaxQuality);
+	// Progressive version of LoadAsync. Once the model's bounds are known its meshes, and the textures they use,
+	// are queued by importance to the load view: meshes inside the frustum first, largest on screen first,
+	// then the rest the same way. placement is where the model is drawn before GetScaleFactor() is applied.
+	GLModel *LoadAsync(std::string const &path, const glm::mat4 &placement, bool gammaCorrection = false, bool flipTextureY = false,
+		unsigned int assimpFlags = aiProcessPreset_TargetRealtime_MaxQuality);
+	// Camera the progressive loads that start afterwards are prioritized for, projection * view.
+	void SetLoadView(const glm::mat4 &viewProj);
+	// For models that don't fit in memory. The geometry is cut into spatially compact pages on disk
+	// (path + PAGE_EXT, rebuilt from the import when the source changes) that the model streams in by
+	// visibility and distance as it is drawn, into GPU pools of budget bytes. Only the textures are loaded up front.
+	// Memory stays bounded after the first run only: the pages are built from a full import, so a run that has to
+	// write them without a mesh cache to map holds the whole model in memory once, as Load() would.
+	GLModel *LoadOutOfCore(std::string const &path, size_t budget, bool gammaCorrection = false, bool flipTextureY = false,
+		unsigned int assimpFlags = aiProcessPreset_TargetRealtime_MaxQuality);
+	// Upload stage on its own: turns a model imported elsewhere, with its textures decoded, into a GLModel.
+	// Images other models already loaded are dropped instead of uploaded again. Must be called from the render thread.
+	GLModel *Upload(ImportedModel &imported);
+	// Finishes queued asynchronous uploads, streamed texture levels and geometry pages on the render thread until budgetMs milliseconds have passed.
+	// At least one upload is finished per call so loading always makes progress.
+	void Update(float budgetMs);
+	// True while an asynchronous load still has work that hasn't been published to its model.
+	bool IsLoading() const;
+	// True once every asynchronous load has published what was visible from its load view: those meshes
+	// and their textures. Loads without a view count every mesh as visible.
+	bool IsVisibleLoaded() const;
+	// Textures are block compressed (see GLTextureCompressor) and cached next to the source image
+	// when enabled and the driver supports S3TC. On by default.
+	void SetTextureCompression(bool enabled);
+	// Bakes specular maps into the diffuse alpha and keeps two channels of uncompressed normal maps,
+	// see GLModelImporter::SetChannelPacking(). On by default.
+	void SetChannelPacking(bool enabled);
+	// Mesh and texture caches live next to their sources until this is opened, then in its directory.
+	// Open it before starting any loads.
+	GLAssetCache &GetCache();
+	// Mesh and texture caches are read from the pack's mapping when it holds them, see GLModelImporter::SetAssetPack().
+	// The pack has to outlive the loader. Call before starting any loads.
+	void SetAssetPack(const GLAssetPack *pack);
+	// Packs the mesh and texture caches of every model loaded so far, followed by files, into one GLAssetPack.
+	// Models loaded from a pack add nothing new, so write it from a run that loaded everything from loose files.
+	bool WriteAssetPack(const std::string &packPath, const std::vector<std::string> &files) const;
+	// Mip streaming of compressed textures, disabled until it is given a budget.
+	GLTextureStreamer &GetStreamer();
+	// Releases the model's textures and geometry and deletes it. Textures other models still use stay loaded.
+	// The model must have finished loading.
+	void Unload(GLModel *model);
+	// Deletes every texture the loader created.
 	void Unload();
 
 private:
-	GLModel *_model;
-	std::vector<GLTexture> _textures;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-	bool _gammaCorrection, _flipTextureY;
-	const aiScene *_scene;
-	glm::vec3 _minbb, _maxbb;
-
-	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void _ProcessNode(const aiNode *node);
-	void _ProcessMesh(const aiMesh *mesh);
-
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
-	std::vector<GLTexture> _LoadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType texType);
-	static GLuint _TextureFromFile(const std::string &path, const std::string &directory, bool gamma);
+	struct _ImportJob
+	{
+		GLModel *model;
+		ImportedModel *imported; // points at ownedModel unless the caller passed in its own
+		ImportedModel ownedModel;
+		std::string path;
+		bool gammaCorrection, flipTextureY, compressTextures;
+		unsigned int assimpFlags;
+		std::vector<unsigned int> handles; // registry handle per imported texture, zero until the render thread acquires it
+		std::vector<GLuint> buffers; // the model's shared buffers when they were filled on the loader context
+		bool succeeded, sharedContext;
+		bool prioritized, visibleLoaded;
+		glm::mat4 viewProjModel; // load view * placement, the model's own scale is added after the import
+		unsigned int numVisible; // meshes that lead the upload order
+		std::chrono::high_resolution_clock::time_point queued;
+		double stageMs; // buffers filled on the loader thread
+		double uploadMs; // render thread
+	};
+
+	// work handed from the loader thread to the render thread. Buffers were filled on the loader
+	// context and may only be used after the fence has signaled; zero buffers mean upload from CPU memory.
+	enum class _UploadKind
+	{
+		Model, // directory, bounds and scale
+		Buffers, // the buffers every mesh draws from, before any of the meshes
+		Mesh,
+		Texture,
+		Visible, // follows the last mesh and texture that were visible from the load view
+		Done,
+	};
+	struct _UploadItem
+	{
+		_UploadKind kind;
+		std::shared_ptr<_ImportJob> job;
+		unsigned int index;
+		GLuint pbo;
+		GLsync fence;
+	};
+
+	const std::string PAGE_EXT = ".geopages";
+
+	ThreadPool _pool;
+	GLModelImporter _importer;
+	GLTextureRegistry _textures;	// stores all the textures loaded so far, shared between models so none is loaded more than once.
+	bool _compressTextures;
+	GLTextureStreamer _streamer;
+	std::vector<GLGeometryStreamer *> _geometry; // of the out-of-core models, owned by them
+	glm::mat4 _loadView;
+	bool _hasLoadView;
+	GLAssetCache _cache;
+	struct _PackFile
+	{
+		std::string name, path;
+		std::vector<std::string> sources; // what the cache was made from, it goes stale in the pack when they change
+	};
+	std::vector<_PackFile> _packFiles; // the caches the loads went through, in the order they were needed
+
+	// asynchronous loading. _textures and _pendingLoads are only touched on the render thread.
+	SDL_Window *_window;
+	SDL_GLContext _loaderContext;
+	std::thread _loaderThread;
+	std::deque<std::shared_ptr<_ImportJob>> _jobs;
+	std::mutex _jobMutex;
+	std::condition_variable _jobReady;
+	bool _stopLoader;
+	std::deque<_UploadItem> _uploads;
+	std::mutex _uploadMutex;
+	int _pendingLoads;
+	int _pendingVisible;
+
+	void _InitJob(_ImportJob &job, GLModel *model, const std::string &path, bool gammaCorrection, bool flipTextureY, unsigned int assimpFlags);
+	// creates the model's textures and meshes from job's decoded import on the calling (GL) thread.
+	void _Upload(_ImportJob &job);
+	void _UploadTextures(_ImportJob &job);
+	// uploads from pbo when it isn't zero, otherwise from the decoded image. Compressed images start at firstLevel.
+	static void _UploadTexture(GLuint id, const ImportedTexture &texture, GLuint pbo, unsigned int firstLevel);
+	// uploads an image that isn't resident yet and hands it to the streamer.
+	void _FinishTexture(const GLTexture &glTexture, const ImportedTexture &texture, GLuint pbo);
+	GLMesh _CreateMesh(_ImportJob &job, const ImportedMesh &mesh);
+	// creates the buffers the model's meshes share: one per ImportedModel::buffers entry, straight from the
+	// mapped file, then one vertex and one index buffer that every other mesh is packed into (see _PackMeshes).
+	void _CreateBuffers(ImportedModel &imported, std::vector<GLuint> &buffers);
+	// sizes both buffers for the whole model up front and has the pool copy each mesh straight into the
+	// mapped storage, freeing its CPU copy right after. The meshes then point into the buffers like read
+	// in place ones. Leaves the meshes alone if the buffers can't be mapped.
+	void _PackMeshes(ImportedModel &imported, std::vector<GLuint> &buffers);
+	static void _UploadPlaceholder(GLuint id, TextureType texType);
+	// returns the registered texture, the first call per job adds the model's reference and
+	// creates a placeholder if the texture is new.
+	GLTexture _GetTexture(_ImportJob &job, unsigned int index);
+	std::vector<GLTexture> _GetTextures(_ImportJob &job, const ImportedMesh &mesh);
+	void _PublishModel(const _ImportJob &job);
+	void _PrintTimings(const _ImportJob &job);
+
+	void _StartLoader();
+	void _LoaderLoop();
+	GLModel *_LoadAsync(std::shared_ptr<_ImportJob> job);
+	void _LoadJob(const std::shared_ptr<_ImportJob> &job, bool sharedContext);
+	// mesh upload order and how many of them lead the order because they are visible.
+	void _FinishVisible(_ImportJob &job);
+	static void _PrioritizeMeshes(const _ImportJob &job, std::vector<unsigned int> &order, unsigned int &numVisible);
+	void _PushUpload(const _UploadItem &item);
+	void _FinishUpload(const _UploadItem &item);
 };
 
 } // namespace opengl
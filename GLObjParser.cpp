@@ -0,0 +1,448 @@
+#include "GLObjParser.hpp"
+#include "GLMappedFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace opengl {
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::duration<double, std::milli> Ms;
+
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// OBJ indices are 1-based. Negative ones count back from the last element read so far and are
+// kept relative (count + index + 1) until the chunk's offset in the file is known.
+struct ObjCorner
+{
+	int v, vt, vn;
+	unsigned char relative; // bit per index
+};
+
+// a run of faces that starts where a group or material changes. Chunks don't know what was
+// active before them, so unset names are inherited while stitching.
+struct ObjSegment
+{
+	size_t firstCorner;
+	bool setGroup, setMaterial;
+	std::string group, material;
+};
+
+struct ObjChunk
+{
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<ObjCorner> corners; // three per triangle
+	std::vector<ObjSegment> segments;
+	std::vector<std::string> libraries;
+};
+
+struct ObjRange
+{
+	unsigned int chunk, segment, mesh;
+	size_t first, end, offset;
+	bool allNormals, anyTexCoords;
+};
+
+static const char *SkipSpace(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	return p;
+}
+
+static const char *LineEnd(const char *p, const char *end)
+{
+	const char *e = (const char *)std::memchr(p, '\n', end - p);
+	return e != nullptr ? e : end;
+}
+
+// the rest of the line without surrounding whitespace
+static std::string Rest(const char *p, const char *lineEnd)
+{
+	p = SkipSpace(p, lineEnd);
+	const char *e = lineEnd;
+	while (e > p && (e[-1] == '\r' || e[-1] == ' ' || e[-1] == '\t')) {
+		e--;
+	}
+	return std::string(p, e);
+}
+
+static bool Keyword(const char *p, const char *lineEnd, const char *word, const char *&rest)
+{
+	size_t len = std::strlen(word);
+	if ((size_t)(lineEnd - p) < len || std::memcmp(p, word, len) != 0) {
+		return false;
+	}
+	if (p + len < lineEnd && p[len] != ' ' && p[len] != '\t') {
+		return false;
+	}
+	rest = p + len;
+	return true;
+}
+
+static ObjSegment &NextSegment(ObjChunk &chunk)
+{
+	if (chunk.segments.back().firstCorner != chunk.corners.size()) {
+		ObjSegment segment = chunk.segments.back();
+		segment.firstCorner = chunk.corners.size();
+		chunk.segments.push_back(segment);
+	}
+	return chunk.segments.back();
+}
+
+static void ParseChunk(const char *p, const char *end, ObjChunk &chunk)
+{
+	chunk.segments.push_back(ObjSegment{ 0, false, false, std::string(), std::string() });
+	std::vector<ObjCorner> polygon;
+	const char *rest;
+	while (p < end) {
+		const char *lineEnd = LineEnd(p, end);
+		p = SkipSpace(p, lineEnd);
+		if (Keyword(p, lineEnd, "v", rest)) {
+			glm::vec3 v;
+			rest = GLObjParser::ParseFloat(rest, lineEnd, v.x);
+			rest = GLObjParser::ParseFloat(rest, lineEnd, v.y);
+			GLObjParser::ParseFloat(rest, lineEnd, v.z);
+			chunk.positions.push_back(v);
+		}
+		else if (Keyword(p, lineEnd, "vt", rest)) {
+			glm::vec2 vt;
+			rest = GLObjParser::ParseFloat(rest, lineEnd, vt.x);
+			GLObjParser::ParseFloat(rest, lineEnd, vt.y);
+			chunk.texCoords.push_back(vt);
+		}
+		else if (Keyword(p, lineEnd, "vn", rest)) {
+			glm::vec3 vn;
+			rest = GLObjParser::ParseFloat(rest, lineEnd, vn.x);
+			rest = GLObjParser::ParseFloat(rest, lineEnd, vn.y);
+			GLObjParser::ParseFloat(rest, lineEnd, vn.z);
+			chunk.normals.push_back(vn);
+		}
+		else if (Keyword(p, lineEnd, "f", rest)) {
+			polygon.clear();
+			for (;;) {
+				rest = SkipSpace(rest, lineEnd);
+				ObjCorner corner = { 0, 0, 0, 0 };
+				const char *next = GLObjParser::ParseInt(rest, lineEnd, corner.v);
+				if (next == rest) {
+					break;
+				}
+				if (next < lineEnd && *next == '/') {
+					next++;
+					if (next < lineEnd && *next != '/') {
+						next = GLObjParser::ParseInt(next, lineEnd, corner.vt);
+					}
+					if (next < lineEnd && *next == '/') {
+						next = GLObjParser::ParseInt(next + 1, lineEnd, corner.vn);
+					}
+				}
+				rest = next;
+				if (corner.v < 0) {
+					corner.v += (int)chunk.positions.size() + 1;
+					corner.relative |= 1;
+				}
+				if (corner.vt < 0) {
+					corner.vt += (int)chunk.texCoords.size() + 1;
+					corner.relative |= 2;
+				}
+				if (corner.vn < 0) {
+					corner.vn += (int)chunk.normals.size() + 1;
+					corner.relative |= 4;
+				}
+				polygon.push_back(corner);
+			}
+			for (size_t i = 2; i < polygon.size(); i++) {
+				chunk.corners.push_back(polygon[0]);
+				chunk.corners.push_back(polygon[i - 1]);
+				chunk.corners.push_back(polygon[i]);
+			}
+		}
+		else if (Keyword(p, lineEnd, "usemtl", rest)) {
+			ObjSegment &segment = NextSegment(chunk);
+			segment.setMaterial = true;
+			segment.material = Rest(rest, lineEnd);
+		}
+		else if (Keyword(p, lineEnd, "o", rest) || Keyword(p, lineEnd, "g", rest)) {
+			ObjSegment &segment = NextSegment(chunk);
+			segment.setGroup = true;
+			segment.group = Rest(rest, lineEnd);
+		}
+		else if (Keyword(p, lineEnd, "mtllib", rest)) {
+			chunk.libraries.push_back(Rest(rest, lineEnd));
+		}
+		p = lineEnd + 1;
+	}
+}
+
+// resolves a corner index against everything read before the chunk, -1 when it is missing or out of range
+static int Resolve(int index, bool relative, size_t base, size_t total)
+{
+	long long global = relative ? (long long)base + index : (long long)index;
+	if ((!relative && index == 0) || global < 1 || global > (long long)total) {
+		return -1;
+	}
+	return (int)(global - 1);
+}
+
+const char *GLObjParser::ParseFloat(const char *p, const char *end, float &value)
+{
+	static const double POWERS[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	p = SkipSpace(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	// up to 19 significant digits fit in the mantissa, the rest only move the exponent
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int e;
+		const char *next = ParseInt(p + 1, end, e);
+		if (next != p + 1) {
+			exponent += e;
+			p = next;
+		}
+	}
+	double result = (double)mantissa;
+	if (exponent < 0) {
+		result = -exponent <= 22 ? result / POWERS[-exponent] : result * std::pow(10.0, exponent);
+	}
+	else if (exponent > 0) {
+		result = exponent <= 22 ? result * POWERS[exponent] : result * std::pow(10.0, exponent);
+	}
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+const char *GLObjParser::ParseInt(const char *p, const char *end, int &value)
+{
+	const char *start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p == end || *p < '0' || *p > '9') {
+		value = 0;
+		return start;
+	}
+	int result = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		result = result * 10 + (*p - '0');
+	}
+	value = negative ? -result : result;
+	return p;
+}
+
+bool GLObjParser::ParseMaterials(const std::string &path, std::vector<GLObjModel::Material> &materials)
+{
+	std::ifstream file(path);
+	if (!file) {
+		return false;
+	}
+	std::string line;
+	const char *rest;
+	while (std::getline(file, line)) {
+		const char *lineEnd = line.data() + line.size();
+		const char *p = SkipSpace(line.data(), lineEnd);
+		if (Keyword(p, lineEnd, "newmtl", rest)) {
+			materials.push_back(GLObjModel::Material());
+			materials.back().name = Rest(rest, lineEnd);
+			continue;
+		}
+		// same slots assimp fills: bump maps land in height, which the loader treats as normals, ambient maps in height
+		int slot = -1;
+		if (Keyword(p, lineEnd, "map_Kd", rest)) {
+			slot = 0;
+		}
+		else if (Keyword(p, lineEnd, "map_Ks", rest)) {
+			slot = 1;
+		}
+		else if (Keyword(p, lineEnd, "map_bump", rest) || Keyword(p, lineEnd, "map_Bump", rest) || Keyword(p, lineEnd, "bump", rest)) {
+			slot = 2;
+		}
+		else if (Keyword(p, lineEnd, "map_Ka", rest)) {
+			slot = 3;
+		}
+		if (slot >= 0 && !materials.empty()) {
+			// options like -bm 0.5 come before the filename
+			std::string value = Rest(rest, lineEnd);
+			size_t space = value.find_last_of(" \t");
+			materials.back().textures[slot] = space == std::string::npos ? value : value.substr(space + 1);
+		}
+	}
+	return true;
+}
+
+bool GLObjParser::Parse(const std::string &path, ThreadPool &pool, GLObjModel &model)
+{
+	Clock::time_point start = Clock::now();
+	GLMappedFile file;
+	if (!file.Open(path)) {
+		std::cout << "Failed to open " << path << std::endl;
+		return false;
+	}
+	const char *data = (const char *)file.Data();
+	model.bytes = file.Size();
+
+	// split at line starts so every chunk parses on its own
+	size_t numChunks = std::max<size_t>(1, std::min<size_t>(model.bytes / MIN_CHUNK_BYTES, pool.NumThreads() * 8));
+	std::vector<size_t> bounds(numChunks + 1, model.bytes);
+	bounds[0] = 0;
+	for (size_t i = 1; i < numChunks; i++) {
+		size_t pos = std::max(bounds[i - 1], model.bytes * i / numChunks);
+		const char *newline = (const char *)std::memchr(data + pos, '\n', model.bytes - pos);
+		bounds[i] = newline != nullptr ? newline - data + 1 : model.bytes;
+	}
+	std::vector<ObjChunk> chunks(numChunks);
+	pool.ParallelFor(numChunks, [data, &bounds, &chunks](size_t i) {
+		ParseChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+	});
+
+	// materials before faces, usemtl names are resolved against them
+	std::string directory;
+	size_t loc = path.find_last_of("/\\");
+	if (loc != std::string::npos) {
+		directory = path.substr(0, loc + 1);
+	}
+	for (unsigned int i = 0; i < chunks.size(); i++) {
+		for (unsigned int j = 0; j < chunks[i].libraries.size(); j++) {
+			if (!ParseMaterials(directory + chunks[i].libraries[j], model.materials)) {
+				std::cout << "Failed to read material library " << directory + chunks[i].libraries[j] << std::endl;
+			}
+		}
+	}
+	std::unordered_map<std::string, int> materialLookup;
+	for (unsigned int i = 0; i < model.materials.size(); i++) {
+		materialLookup[model.materials[i].name] = (int)i;
+	}
+
+	// stitch the chunks together in file order
+	std::vector<size_t> positionBase(numChunks + 1, 0), texCoordBase(numChunks + 1, 0), normalBase(numChunks + 1, 0);
+	for (size_t i = 0; i < numChunks; i++) {
+		positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+		texCoordBase[i + 1] = texCoordBase[i] + chunks[i].texCoords.size();
+		normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+	}
+	std::vector<glm::vec3> positions(positionBase[numChunks]), normals(normalBase[numChunks]);
+	std::vector<glm::vec2> texCoords(texCoordBase[numChunks]);
+	pool.ParallelFor(numChunks, [&](size_t i) {
+		std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), positions.begin() + positionBase[i]);
+		std::copy(chunks[i].texCoords.begin(), chunks[i].texCoords.end(), texCoords.begin() + texCoordBase[i]);
+		std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), normals.begin() + normalBase[i]);
+		std::vector<glm::vec3>().swap(chunks[i].positions);
+		std::vector<glm::vec2>().swap(chunks[i].texCoords);
+		std::vector<glm::vec3>().swap(chunks[i].normals);
+	});
+
+	// one mesh per group and material, runs that come back to an earlier pair are appended to its mesh
+	std::vector<ObjRange> ranges;
+	std::vector<size_t> meshCorners;
+	std::unordered_map<std::string, unsigned int> meshLookup;
+	std::string group, material;
+	for (unsigned int c = 0; c < numChunks; c++) {
+		const ObjChunk &chunk = chunks[c];
+		for (unsigned int s = 0; s < chunk.segments.size(); s++) {
+			const ObjSegment &segment = chunk.segments[s];
+			if (segment.setGroup) {
+				group = segment.group;
+			}
+			if (segment.setMaterial) {
+				material = segment.material;
+			}
+			size_t end = s + 1 < chunk.segments.size() ? chunk.segments[s + 1].firstCorner : chunk.corners.size();
+			if (end == segment.firstCorner) {
+				continue;
+			}
+			std::string key = group + '\n' + material;
+			auto found = meshLookup.find(key);
+			if (found == meshLookup.end()) {
+				found = meshLookup.insert(std::make_pair(key, (unsigned int)model.meshes.size())).first;
+				model.meshes.push_back(GLObjModel::Mesh());
+				auto mat = materialLookup.find(material);
+				model.meshes.back().material = mat != materialLookup.end() ? mat->second : -1;
+				meshCorners.push_back(0);
+			}
+			ObjRange range = { c, s, found->second, segment.firstCorner, end, meshCorners[found->second], true, false };
+			meshCorners[found->second] += end - segment.firstCorner;
+			ranges.push_back(range);
+		}
+	}
+	for (unsigned int i = 0; i < model.meshes.size(); i++) {
+		model.meshes[i].vertices.resize(meshCorners[i]);
+		model.meshes[i].indices.resize(meshCorners[i]);
+	}
+
+	pool.ParallelFor(ranges.size(), [&](size_t r) {
+		ObjRange &range = ranges[r];
+		const ObjChunk &chunk = chunks[range.chunk];
+		GLObjModel::Mesh &mesh = model.meshes[range.mesh];
+		GLVertex *out = &mesh.vertices[range.offset];
+		for (size_t i = range.first; i < range.end; i += 3, out += 3) {
+			bool valid = true;
+			for (int k = 0; k < 3; k++) {
+				const ObjCorner &corner = chunk.corners[i + k];
+				GLVertex &vertex = out[k];
+				int v = Resolve(corner.v, (corner.relative & 1) != 0, positionBase[range.chunk], positions.size());
+				int vt = corner.vt != 0 ? Resolve(corner.vt, (corner.relative & 2) != 0, texCoordBase[range.chunk], texCoords.size()) : -1;
+				int vn = corner.vn != 0 ? Resolve(corner.vn, (corner.relative & 4) != 0, normalBase[range.chunk], normals.size()) : -1;
+				valid = valid && v >= 0;
+				vertex.Position = v >= 0 ? positions[v] : glm::vec3(0.0f);
+				vertex.TexCoords = vt >= 0 ? texCoords[vt] : glm::vec2(0.0f);
+				vertex.Normal = vn >= 0 ? normals[vn] : glm::vec3(0.0f);
+				vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+				range.allNormals = range.allNormals && vn >= 0;
+				range.anyTexCoords = range.anyTexCoords || vt >= 0;
+			}
+			if (!valid) {
+				// collapses into a degenerate triangle that post-processing drops
+				out[0] = out[1] = out[2] = out[0];
+			}
+		}
+		for (size_t i = 0; i < range.end - range.first; i++) {
+			mesh.indices[range.offset + i] = (GLuint)(range.offset + i);
+		}
+	});
+	for (unsigned int i = 0; i < model.meshes.size(); i++) {
+		model.meshes[i].hasNormals = true;
+		model.meshes[i].hasTexCoords = false;
+	}
+	for (unsigned int r = 0; r < ranges.size(); r++) {
+		GLObjModel::Mesh &mesh = model.meshes[ranges[r].mesh];
+		mesh.hasNormals = mesh.hasNormals && ranges[r].allNormals;
+		mesh.hasTexCoords = mesh.hasTexCoords || ranges[r].anyTexCoords;
+	}
+	model.parseMs = Ms(Clock::now() - start).count();
+	return true;
+}
+
+} // namespace opengl
\ No newline at end of file
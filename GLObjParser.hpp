@@ -0,0 +1,53 @@
+#pragma once
+#ifndef GLOBJPARSER_HPP
+#define GLOBJPARSER_HPP
+
+#include "GLMesh.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace opengl {
+
+// Result of parsing a Wavefront OBJ file and its material libraries.
+struct GLObjModel
+{
+	struct Material
+	{
+		std::string name;
+		// one per slot, in the order the G-buffer samples them: diffuse, specular, normal (bump), height (ambient)
+		std::string textures[4];
+	};
+	// One per run of faces with the same group and material. Every corner is its own vertex,
+	// like assimp's OBJ importer hands them to post-processing.
+	struct Mesh
+	{
+		std::vector<GLVertex> vertices;
+		std::vector<GLuint> indices;
+		int material; // index into materials, -1 without one
+		bool hasNormals, hasTexCoords;
+	};
+	std::vector<Mesh> meshes;
+	std::vector<Material> materials;
+	size_t bytes; // size of the .obj file
+	double parseMs;
+
+	GLObjModel() : bytes(0), parseMs(0.0) {}
+};
+
+// Fast path for OBJ files. The file is mapped and split into line aligned chunks that are parsed
+// in parallel, then stitched back together in file order. Faces are fan triangulated.
+class GLObjParser
+{
+public:
+	static bool Parse(const std::string &path, ThreadPool &pool, GLObjModel &model);
+	static bool ParseMaterials(const std::string &path, std::vector<GLObjModel::Material> &materials);
+	// Locale independent, without the overhead of strtod. Returns the first character after the number.
+	static const char *ParseFloat(const char *p, const char *end, float &value);
+	static const char *ParseInt(const char *p, const char *end, int &value);
+};
+
+} // namespace opengl
+#endif // GLOBJPARSER_HPP
\ No newline at end of file
@@ -23,45 +23,406 @@
 */
 
 #include "GLProgram.hpp"
+#include "GLMeshCache.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 namespace opengl
 {
 
-bool GLProgram::Create(const std::string &vshader_path, const std::string &fshader_path)
+const GLAssetPack *GLProgram::_pack = nullptr;
+GLAssetCache *GLProgram::_cache = nullptr;
+
+static bool ReadSource(const std::string &path, const GLAssetPack *pack, std::string &source)
+{
+	const unsigned char *data;
+	size_t size;
+	if (pack != nullptr && pack->Find(path, data, size)) {
+		source.assign((const char *)data, size);
+		return true;
+	}
+	std::ifstream input(path, std::ios::in | std::ios::binary);
+	if (!input) {
+		return false;
+	}
+	source.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// the module ModulePath() names, left out when it's older than the source it was compiled from
+static bool ReadModule(const std::string &path, const GLAssetPack *pack, std::string &module)
+{
+	const std::string modulePath = GLProgram::ModulePath(path);
+	const unsigned char *data;
+	size_t size;
+	const unsigned char *sourceData;
+	size_t sourceSize;
+	if (pack != nullptr && pack->Find(modulePath, data, size) && pack->Find(path, sourceData, sourceSize)) {
+		module.assign((const char *)data, size); // packed together with its source, which hasn't changed since
+		return true;
+	}
+	struct stat moduleInfo, sourceInfo;
+	if (stat(modulePath.c_str(), &moduleInfo) != 0 || (stat(path.c_str(), &sourceInfo) == 0 && sourceInfo.st_mtime > moduleInfo.st_mtime)) {
+		return false;
+	}
+	return ReadSource(modulePath, nullptr, module);
+}
+
+// "#define NAME value" lines as specialization constant values, the value is true, false or an integer (true without one)
+static bool ParseDefines(const std::string &defines, std::vector<std::pair<std::string, GLuint>> &values)
+{
+	std::istringstream lines(defines);
+	std::string line;
+	while (std::getline(lines, line)) {
+		std::istringstream words(line);
+		std::string directive, name, value;
+		if (!(words >> directive)) {
+			continue;
+		}
+		if (directive != "#define" || !(words >> name)) {
+			return false;
+		}
+		if (!(words >> value) || value == "true") {
+			values.push_back(std::make_pair(name, 1u));
+		}
+		else if (value == "false") {
+			values.push_back(std::make_pair(name, 0u));
+		}
+		else {
+			char *end;
+			long number = std::strtol(value.c_str(), &end, 0);
+			if (*end != '\0') {
+				return false; // floats and expressions only work in GLSL
+			}
+			values.push_back(std::make_pair(name, (GLuint)number));
+		}
+	}
+	return true;
+}
+
+// every stage's module with the defines it declares a specialization constant for. False when a stage
+// has no module or a define has no constant in any of them, the defines have to be compiled in then.
+static bool ReadModules(const std::string *paths, unsigned int count, const std::string &defines, const GLAssetPack *pack,
+	std::vector<std::string> &modules, std::vector<std::vector<GLuint>> &constantIds, std::vector<std::vector<GLuint>> &constantValues)
+{
+	std::vector<std::pair<std::string, GLuint>> values;
+	if (!ParseDefines(defines, values)) {
+		return false;
+	}
+	std::vector<bool> matched(values.size(), false);
+	modules.resize(count);
+	constantIds.resize(count);
+	constantValues.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		std::vector<std::pair<std::string, GLuint>> ids;
+		if (!ReadModule(paths[i], pack, modules[i]) || !GLShader::GetSpecializationIds(modules[i].data(), modules[i].size(), ids)) {
+			return false;
+		}
+		for (unsigned int j = 0; j < values.size(); j++) {
+			for (unsigned int k = 0; k < ids.size(); k++) {
+				if (ids[k].first == values[j].first) {
+					constantIds[i].push_back(ids[k].second);
+					constantValues[i].push_back(values[j].second);
+					matched[j] = true;
+				}
+			}
+		}
+	}
+	return std::find(matched.begin(), matched.end(), false) == matched.end();
+}
+
+// a binary only loads on the driver that linked it, so the driver is part of the key
+static uint64_t BinaryKey(const std::vector<std::string> &sources, const std::string &defines, bool separable, bool spirv)
 {
-	opengl::GLShader v, f;
+	uint64_t hash = GLMeshCache::Hash(defines.data(), defines.size());
+	for (const std::string &source : sources) {
+		hash = GLMeshCache::Hash(source.data(), source.size(), hash);
+		uint64_t size = source.size(); // keeps the boundaries between sources
+		hash = GLMeshCache::Hash(&size, sizeof(size), hash);
+	}
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum name : names) {
+		const char *value = (const char *)glGetString(name);
+		if (value != nullptr) {
+			hash = GLMeshCache::Hash(value, std::strlen(value), hash);
+		}
+	}
+	return GLAssetCache::Key(GLAssetCache::Category::ProgramBinary, hash, { sources.size(), (uint64_t)separable, (uint64_t)spirv });
+}
+
+void GLProgram::SetAssetPack(const GLAssetPack *pack)
+{
+	_pack = pack;
+}
+
+void GLProgram::SetAssetCache(GLAssetCache *cache)
+{
+	_cache = cache;
+}
+
+std::string GLProgram::ModulePath(const std::string &sourcePath)
+{
+	return sourcePath + ".spv";
+}
+
+// compile and link state kept from CreateAsync() until Wait()
+struct GLProgram::PendingLink
+{
+	std::vector<ShaderType> types;
+	std::vector<std::string> paths;
+	std::string defines;
+	bool separable;
+	bool spirv;
+	std::vector<GLShader> shaders;
+	bool saveBinary;
+	uint64_t binaryKey;
+};
+
+bool GLProgram::Create(const std::string &vshader_path, const std::string &fshader_path, const std::string &defines)
+{
+	return CreateAsync(vshader_path, fshader_path, defines) && Wait();
+}
+
+bool GLProgram::CreateAsync(const std::string &vshader_path, const std::string &fshader_path, const std::string &defines)
+{
+	const ShaderType types[] = { ShaderType::VERTEX, ShaderType::FRAGMENT };
+	const std::string paths[] = { vshader_path, fshader_path };
+	return _CreateAsync(types, paths, 2, defines, false);
+}
+
+bool GLProgram::CreateSeparable(ShaderType type, const std::string &path, const std::string &defines)
+{
+	return CreateSeparableAsync(type, path, defines) && Wait();
+}
+
+bool GLProgram::CreateSeparableAsync(ShaderType type, const std::string &path, const std::string &defines)
+{
+	return _CreateAsync(&type, &path, 1, defines, true);
+}
+
+bool GLProgram::_CreateAsync(const ShaderType *types, const std::string *paths, unsigned int count, const std::string &defines, bool separable, bool spirv)
+{
+	std::vector<std::string> sources(count);
+	for (unsigned int i = 0; i < count; i++) {
+		if (!ReadSource(paths[i], _pack, sources[i])) {
+			std::cout << "Error reading: " << paths[i] << std::endl;
+			return false;
+		}
+	}
+	std::vector<std::string> modules;
+	std::vector<std::vector<GLuint>> constantIds, constantValues;
+	spirv = spirv && GLEW_ARB_gl_spirv && ReadModules(paths, count, defines, _pack, modules, constantIds, constantValues);
+	std::vector<GLenum> formats;
+	GetBinaryFormats(formats);
+	bool cached = _cache != nullptr && _cache->IsOpen() && !formats.empty();
+	uint64_t key = cached ? BinaryKey(spirv ? modules : sources, defines, separable, spirv) : 0;
+
+	_pending.reset();
+	_uniforms.reset();
 	_id = glCreateProgram();
 	if (_id == 0) {
 		return false;
 	}
-	v.Create(opengl::ShaderType::VERTEX);
-	if (!v.CompileFile(vshader_path)) {
-		std::cout << "Error compiling: " << vshader_path << std::endl << v.GetInfoLog() << std::endl;
-		v.Destroy();
+	// set before loading a binary too, not every driver restores it from the binary
+	SetLinkOptions(cached, separable);
+	std::string binaryPath;
+	if (cached && _cache->Find(GLAssetCache::Category::ProgramBinary, key, binaryPath)) {
+		if (LoadBinary(binaryPath)) {
+			// already linked, but still pending so callers finish setting it up in Wait() as they would otherwise
+			_pending = std::make_shared<PendingLink>();
+			_pending->separable = separable;
+			_pending->spirv = false;
+			_pending->saveBinary = false;
+			_pending->binaryKey = key;
+			return true;
+		}
+		// the driver changed in a way its version string doesn't show, link from source and replace the binary
+		_cache->Discard(GLAssetCache::Category::ProgramBinary, key);
 		Destroy();
-		return false;
+		_id = glCreateProgram();
+		if (_id == 0) {
+			return false;
+		}
+		SetLinkOptions(cached, separable);
+	}
+
+	static bool threadsSet = false;
+	if (!threadsSet && GLEW_ARB_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF); // as many as the driver likes
+		threadsSet = true;
+	}
+	std::shared_ptr<PendingLink> pending = std::make_shared<PendingLink>();
+	pending->types.assign(types, types + count);
+	pending->paths.assign(paths, paths + count);
+	pending->defines = defines;
+	pending->separable = separable;
+	pending->spirv = spirv;
+	pending->shaders.resize(count);
+	pending->saveBinary = cached;
+	pending->binaryKey = key;
+	for (unsigned int i = 0; i < count; i++) {
+		pending->shaders[i].Create(types[i]);
+		if (!spirv) {
+			pending->shaders[i].CompileAsync(sources[i].data(), (int)sources[i].size(), defines);
+		}
+		else if (!pending->shaders[i].CompileSpirv(modules[i].data(), (int)modules[i].size(), constantIds[i], constantValues[i])) {
+			std::cout << "Error specializing: " << ModulePath(paths[i]) << std::endl << pending->shaders[i].GetInfoLog() << std::endl;
+			for (unsigned int j = 0; j <= i; j++) {
+				pending->shaders[j].Destroy();
+			}
+			Destroy();
+			return _CreateAsync(types, paths, count, defines, separable, false);
+		}
+		Attach(pending->shaders[i].Id());
+	}
+	// a failed compile fails the link, Wait() tells which it was
+	glLinkProgram(_id);
+	_pending = pending;
+	return true;
+}
+
+bool GLProgram::IsPending() const
+{
+	return _pending != nullptr;
+}
+
+bool GLProgram::IsReady() const
+{
+	if (_pending == nullptr || !GLEW_ARB_parallel_shader_compile) {
+		return true;
 	}
-	f.Create(opengl::ShaderType::FRAGMENT);
-	if (!f.CompileFile(fshader_path)) {
-		std::cout << "Error compiling: " << fshader_path << std::endl << f.GetInfoLog() << std::endl;
-		v.Destroy();
-		f.Destroy();
+	int done = 0;
+	glGetProgramiv(_id, GL_COMPLETION_STATUS_ARB, &done);
+	return done != GL_FALSE;
+}
+
+bool GLProgram::Wait()
+{
+	if (_pending == nullptr) {
+		return _id != 0;
+	}
+	std::shared_ptr<PendingLink> pending = _pending;
+	_pending.reset();
+	int status = 0;
+	glGetProgramiv(_id, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		bool compiled = true;
+		for (unsigned int i = 0; i < pending->shaders.size() && compiled; i++) {
+			if (!pending->shaders[i].IsCompiled()) {
+				std::cout << "Error compiling: " << pending->paths[i] << std::endl << pending->shaders[i].GetInfoLog() << std::endl;
+				compiled = false;
+			}
+		}
+		if (compiled) {
+			std::cout << "Failed to link shader program." << std::endl << GetInfoLog() << std::endl;
+		}
+		for (unsigned int i = 0; i < pending->shaders.size(); i++) {
+			pending->shaders[i].Destroy();
+		}
 		Destroy();
-		return false;
+		return pending->spirv && _CreateFromSource(*pending);
+	}
+	for (unsigned int i = 0; i < pending->shaders.size(); i++) {
+		pending->shaders[i].Destroy();
+	}
+	if (pending->spirv && !_HasResourceNames()) {
+		std::cout << "The driver dropped the names of the SPIR-V program's uniforms." << std::endl;
+		Destroy();
+		return _CreateFromSource(*pending);
+	}
+	_BuildUniformTable();
+	if (pending->saveBinary) {
+		std::string tempPath = _cache->TempPath(GLAssetCache::Category::ProgramBinary, pending->binaryKey);
+		if (!SaveBinary(tempPath) || !_cache->Commit(GLAssetCache::Category::ProgramBinary, pending->binaryKey, tempPath)) {
+			std::remove(tempPath.c_str());
+		}
 	}
-	Attach(v.Id());
-	Attach(f.Id());
+	return true;
+}
 
-	v.Destroy();
-	f.Destroy();
-	if (!Link()) {
-		std::cout << "Failed to link shader program." << std::endl;
-		return false;
+bool GLProgram::_CreateFromSource(const PendingLink &pending)
+{
+	std::cout << "Compiling the GLSL sources instead." << std::endl;
+	return _CreateAsync(pending.types.data(), pending.paths.data(), (unsigned int)pending.paths.size(), pending.defines, pending.separable, false) && Wait();
+}
+
+// a module's debug names are optional to the driver, and uniforms and blocks are looked up by name
+bool GLProgram::_HasResourceNames() const
+{
+	const ProgramResource resources[] = { ProgramResource::UNIFORM, ProgramResource::UNIFORM_BLOCK };
+	for (ProgramResource resource : resources) {
+		if (GetResourceCount(resource) > 0 && GetResourceName(resource, 0).empty()) {
+			return false;
+		}
 	}
 	return true;
 }
 
+int GLProgram::GetUniformLocation(uint32_t id) const
+{
+	const UniformEntry *uniform = _FindUniform(id);
+	return uniform != nullptr ? uniform->location : -1;
+}
+
+const GLProgram::UniformEntry *GLProgram::_FindUniform(uint32_t id) const
+{
+	if (_uniforms == nullptr) {
+		return nullptr;
+	}
+	auto found = std::lower_bound(_uniforms->begin(), _uniforms->end(), id,
+		[](const UniformEntry &uniform, uint32_t id) { return uniform.id < id; });
+	return found != _uniforms->end() && found->id == id ? &*found : nullptr;
+}
+
+void GLProgram::_BuildUniformTable()
+{
+	std::shared_ptr<std::vector<UniformEntry>> uniforms = std::make_shared<std::vector<UniformEntry>>();
+	const std::vector<ResourceProperty> props = { ResourceProperty::LOCATION, ResourceProperty::ARRAY_SIZE };
+	std::vector<int> values;
+	auto add = [&uniforms](const std::string &name, int location) {
+		UniformEntry uniform;
+		uniform.id = UniformId(name.c_str());
+		uniform.location = location;
+		uniform.name = name;
+		uniforms->push_back(uniform);
+	};
+	int count = GetResourceCount(ProgramResource::UNIFORM);
+	for (int i = 0; i < count; i++) {
+		GetResourceProperties(ProgramResource::UNIFORM, i, props, values);
+		if (values[0] < 0) {
+			continue; // in a block
+		}
+		std::string name = GetResourceName(ProgramResource::UNIFORM, i);
+		add(name, values[0]);
+		// arrays of basic types are reported once as "name[0]", their elements have consecutive locations
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+			std::string base = name.substr(0, name.size() - 3);
+			add(base, values[0]);
+			for (int j = 1; j < values[1]; j++) {
+				add(base + "[" + std::to_string(j) + "]", values[0] + j);
+			}
+		}
+	}
+	std::sort(uniforms->begin(), uniforms->end(), [](const UniformEntry &a, const UniformEntry &b) { return a.id < b.id; });
+	// two names with one hash, neither can be told apart by id so both go to the driver
+	for (size_t i = 1; i < uniforms->size(); i++) {
+		if ((*uniforms)[i].id == (*uniforms)[i - 1].id) {
+			uint32_t id = (*uniforms)[i].id;
+			uniforms->erase(std::remove_if(uniforms->begin(), uniforms->end(),
+				[id](const UniformEntry &uniform) { return uniform.id == id; }), uniforms->end());
+			i = 0;
+		}
+	}
+	_uniforms = uniforms;
+}
+
 std::string GLProgram::GetInfoLog() const {
 	int len = 0;
 	std::string log;
@@ -112,7 +473,7 @@ void GLProgram::GetResourceProperties(ProgramResource resource, int activeIndex,
 }
 
 void GLProgram::_GetResource(ProgramResource resource, int activeIndex, std::vector<int> &subroutineIndices,
-	GLenum typeCount, GLenum type)
+	GLenum typeCount, GLenum type) const
 {
 	int propCount = 1;
 	GLenum props = typeCount;
@@ -126,29 +487,43 @@ void GLProgram::_GetResource(ProgramResource resource, int activeIndex, std::vec
 	}
 }
 
-bool GLProgram::SaveBinary(const std::string &filename, GLenum &savedFormat) const
+bool GLProgram::SaveBinary(const std::string &filename) const
 {
 	int len = 0;
 	glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &len);
-	char *binaryData = (char *) new char[len];
-	glGetProgramBinary(_id, len, NULL, &savedFormat, binaryData);
-
-	std::ofstream file;
-	file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
-	file.write(binaryData, len);
+	if (len <= 0) {
+		return false;
+	}
+	std::vector<char> binaryData(len);
+	GLenum format = 0;
+	glGetProgramBinary(_id, len, &len, &format, &binaryData[0]);
+	if (len <= 0) {
+		return false;
+	}
+	uint32_t savedFormat = (uint32_t)format;
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	file.write((const char *)&savedFormat, sizeof(savedFormat));
+	file.write(&binaryData[0], len);
+	// a flush that fails on close still leaves a short file, which must not be loaded next run
 	file.close();
-	delete[] binaryData;
-	return false;
+	if (file.fail()) {
+		std::remove(filename.c_str());
+		return false;
+	}
+	return true;
 }
 
-bool GLProgram::LoadBinary(const std::string &filename, GLenum binaryFormat)
+bool GLProgram::LoadBinary(const std::string &filename)
 {
 	std::ifstream input(filename, std::ios::in | std::ios::binary);
-	if (!input)
+	uint32_t binaryFormat = 0;
+	if (!input || !input.read((char *)&binaryFormat, sizeof(binaryFormat)))
 		return false;
 	std::string binaryData = std::string(std::istreambuf_iterator<char>(input),
 		std::istreambuf_iterator<char>());
-	glProgramBinary(_id, binaryFormat, (const void *)binaryData.c_str(),
+	if (binaryData.empty())
+		return false;
+	glProgramBinary(_id, (GLenum)binaryFormat, (const void *)binaryData.c_str(),
 		binaryData.length());
 	int status = 0;
 	glGetProgramiv(_id, GL_LINK_STATUS, &status);
@@ -29,7 +29,12 @@
 #include <GL/glew.h>
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <utility>
 #include "GLShader.hpp"
+#include "GLAssetPack.hpp"
+#include "GLAssetCache.hpp"
 #include "GLUniform.hpp"
 
 namespace opengl {
@@ -228,6 +233,13 @@ enum class ResourceProperty
 	IS_PER_PATCH = GL_IS_PER_PATCH,
 };
 
+// A uniform's name hashed (FNV-1a) for GLProgram's location table. Hashed at compile time when the
+// name is a literal, e.g. static constexpr uint32_t CAM_POSITION = UniformId("CamPosition");
+constexpr uint32_t UniformId(const char *name, uint32_t hash = 2166136261u)
+{
+	return *name == '\0' ? hash : UniformId(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
+
 class GLProgram
 {
 protected:
@@ -238,7 +250,33 @@ public:
 	GLProgram(int id) : _id(id) { }
 	bool operator==(const GLProgram &other) const;
 	void Create();
-	bool Create(const std::string &vshader_path, const std::string &fshader_path);
+	// Defines are whole "#define NAME value" lines inserted into both shaders, see GLShader::CompileAsync().
+	// Each set of defines is a separate program and program binary.
+	bool Create(const std::string &vshader_path, const std::string &fshader_path, const std::string &defines = std::string());
+	// Submits the compile and link without waiting on either, so a batch of programs is compiled side by side
+	// (on the driver's threads with GL_ARB_parallel_shader_compile). Wait() before first using the program.
+	// Only fails when a source can't be read, compile and link errors are reported by Wait().
+	bool CreateAsync(const std::string &vshader_path, const std::string &fshader_path, const std::string &defines = std::string());
+	// A program with a single stage that a GLProgramPipeline combines with other stages' programs.
+	bool CreateSeparable(ShaderType type, const std::string &path, const std::string &defines = std::string());
+	bool CreateSeparableAsync(ShaderType type, const std::string &path, const std::string &defines = std::string());
+	// True between CreateAsync() and Wait().
+	bool IsPending() const;
+	// Whether Wait() would return without blocking. Always true without GL_ARB_parallel_shader_compile.
+	bool IsReady() const;
+	// Blocks until the program is linked and returns whether it succeeded, the program is destroyed if it didn't.
+	bool Wait();
+	// Shader sources the pack holds are compiled from its mapping instead of their files.
+	// Null reads every source from its file again.
+	static void SetAssetPack(const GLAssetPack *pack);
+	// Programs are linked once per driver and loaded from their binaries afterwards, keyed by
+	// both sources and the driver's vendor, renderer and version. Null always compiles from source.
+	static void SetAssetCache(GLAssetCache *cache);
+	// The SPIR-V module compile_shaders.bat builds from a shader source. With GL_ARB_gl_spirv programs specialize
+	// the modules instead of compiling GLSL, each define setting the specialization constant of the same name.
+	// They compile the GLSL when a module is missing or older than its source, a define has no constant,
+	// or the driver rejects the module or drops the names uniforms are looked up by.
+	static std::string ModulePath(const std::string &sourcePath);
 	// Shaders are automatically detatched when a program is destroyed.
 	void Destroy();
 	int Id() const;
@@ -274,13 +312,16 @@ public:
 	// might not always work. Also, note that binaries loading may not be
 	// supported on some systems.
 
-	// Saving a program's binary requires it to be linked first.
+	// Saving a program's binary requires it to be linked first,
+	// with SetLinkOptions(true, ...) so the driver keeps the binary.
 	// Binaries are specific to each graphics card and system,
 	// so only save/load binaries on the same system.
-	bool SaveBinary(const std::string &filename, GLenum &savedFormat) const;
-	// Loading a binary automatically links it.
+	// The file starts with the binary's format.
+	bool SaveBinary(const std::string &filename) const;
+	// Loading a binary automatically links it. Returns false when the
+	// driver rejects it, the program can still be linked from source then.
 	// Consider using setLinkOptions() before loading a binary.
-	bool LoadBinary(const std::string &filename, GLenum binaryFormat);
+	bool LoadBinary(const std::string &filename);
 	//static int GetBinaryFormatCount();
 	static void GetBinaryFormats(std::vector<GLenum> &formats);
 
@@ -307,8 +348,14 @@ public:
 	// ********************* AFTER LINKING *********************
 	// All metadata can be found through Resources. 
 
+	// Programs from Create()/Wait() look names up in the location table built when they were linked,
+	// without asking the driver. Others fall back to glGetUniformLocation().
 	GLUniform GetUniform(const std::string &name) const;
 	int GetUniformLocation(const std::string &name) const;
+	// By UniformId(), -1 if the program has no such uniform or no location table. Arrays are found by
+	// both "name" and "name[i]". Block members have no location, see GLUniformBlock.
+	GLUniform GetUniform(uint32_t id) const;
+	int GetUniformLocation(uint32_t id) const;
 	int GetUniformBlockIndex(const std::string &name) const;
 	int GetAttributeLocation(const std::string &name) const;
 	int GetSubroutineUniformLocation(ShaderType type, const std::string &name) const;
@@ -343,11 +390,31 @@ public:
 	void GetCompatibleSubroutines(ProgramResource resource, int resourceIndex, 
 		std::vector<int> &subroutineIndices);
 	void GetVariables(ProgramResource resource, int resourceIndex, 
-		std::vector<int> &subroutineIndices);
+		std::vector<int> &subroutineIndices) const;
 
 private:
+	struct PendingLink;
+
+	static const GLAssetPack *_pack;
+	static GLAssetCache *_cache;
+	std::shared_ptr<PendingLink> _pending;
+	struct UniformEntry
+	{
+		uint32_t id; // UniformId(name)
+		int location;
+		std::string name; // compared by name lookups, a name outside the table may share an id in it
+	};
+	// every active uniform outside a block, sorted by id
+	std::shared_ptr<const std::vector<UniformEntry>> _uniforms;
+
+	void _BuildUniformTable();
+	const UniformEntry *_FindUniform(uint32_t id) const;
+	bool _CreateAsync(const ShaderType *types, const std::string *paths, unsigned int count, const std::string &defines, bool separable, bool spirv = true);
+	bool _CreateFromSource(const PendingLink &pending);
+	bool _HasResourceNames() const;
+
 	void _GetResource(ProgramResource resource, int activeIndex, std::vector<int> &subroutineIndices, 
-		GLenum typeCount, GLenum type);
+		GLenum typeCount, GLenum type) const;
 };
 
 
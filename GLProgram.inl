@@ -39,6 +39,7 @@ inline void GLProgram::Create() {
 inline void GLProgram::Destroy() {
 	glDeleteProgram(_id);
 	_id = 0;
+	_uniforms.reset();
 }
 
 inline int GLProgram::Id() const {
@@ -159,11 +160,18 @@ inline void GLProgram::SetSubroutineUniforms(ShaderType shaderType, int count, i
 // ******************** AFTER LINKING *********************
 
 inline GLUniform GLProgram::GetUniform(const std::string &name) const {
-	return GLUniform(_id, glGetUniformLocation(_id, name.c_str()));
+	return GLUniform(_id, GetUniformLocation(name));
 }
 
 inline int GLProgram::GetUniformLocation(const std::string &name) const {
-	return glGetUniformLocation(_id, name.c_str());
+	const UniformEntry *uniform = _FindUniform(UniformId(name.c_str()));
+	// names missing from the table (or without one) are asked of the driver, so is any name whose hash
+	// only matches another uniform's
+	return uniform != nullptr && uniform->name == name ? uniform->location : glGetUniformLocation(_id, name.c_str());
+}
+
+inline GLUniform GLProgram::GetUniform(uint32_t id) const {
+	return GLUniform(_id, GetUniformLocation(id));
 }
 
 inline int GLProgram::GetUniformBlockIndex(const std::string &name) const {
@@ -264,7 +272,7 @@ inline void GLProgram::GetCompatibleSubroutines(ProgramResource resource, int re
 	_GetResource(resource, resourceIndex, subroutineIndices, GL_NUM_COMPATIBLE_SUBROUTINES, GL_COMPATIBLE_SUBROUTINES);
 }
 
-inline void GLProgram::GetVariables(ProgramResource resource, int resourceIndex, std::vector<int> &subroutineIndices) {
+inline void GLProgram::GetVariables(ProgramResource resource, int resourceIndex, std::vector<int> &subroutineIndices) const {
 	_GetResource(resource, resourceIndex, subroutineIndices, GL_NUM_ACTIVE_VARIABLES, GL_ACTIVE_VARIABLES);
 }
 
@@ -0,0 +1,62 @@
+#include "GLProgramPipeline.hpp"
+
+namespace opengl {
+
+void GLProgramPipeline::Create()
+{
+	glGenProgramPipelines(1, &_id);
+}
+
+void GLProgramPipeline::Destroy()
+{
+	glDeleteProgramPipelines(1, &_id);
+	_id = 0;
+}
+
+GLuint GLProgramPipeline::Id() const
+{
+	return _id;
+}
+
+void GLProgramPipeline::UseStages(GLbitfield stages, const GLProgram &program)
+{
+	glUseProgramStages(_id, stages, program.Id());
+}
+
+void GLProgramPipeline::SetActiveProgram(const GLProgram &program)
+{
+	glActiveShaderProgram(_id, program.Id());
+}
+
+void GLProgramPipeline::Bind() const
+{
+	glUseProgram(0);
+	glBindProgramPipeline(_id);
+}
+
+void GLProgramPipeline::Unbind()
+{
+	glBindProgramPipeline(0);
+}
+
+bool GLProgramPipeline::Validate() const
+{
+	glValidateProgramPipeline(_id);
+	int status = 0;
+	glGetProgramPipelineiv(_id, GL_VALIDATE_STATUS, &status);
+	return status != GL_FALSE;
+}
+
+std::string GLProgramPipeline::GetInfoLog() const
+{
+	int len = 0;
+	std::string log;
+	glGetProgramPipelineiv(_id, GL_INFO_LOG_LENGTH, &len);
+	if (len > 0) {
+		log.resize(len + 1);
+		glGetProgramPipelineInfoLog(_id, len, &len, &log[0]);
+	}
+	return log;
+}
+
+} // namespace opengl
\ No newline at end of file
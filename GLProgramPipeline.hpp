@@ -0,0 +1,36 @@
+#pragma once
+#ifndef GLPROGRAMPIPELINE_HPP
+#define GLPROGRAMPIPELINE_HPP
+
+#include <GL/glew.h>
+#include <string>
+#include "GLProgram.hpp"
+
+namespace opengl {
+
+// Combines separable programs (GLProgram::CreateSeparable()) stage by stage, so a stage is compiled and linked
+// once and shared by every pipeline using it. Swapping one stage doesn't relink anything.
+class GLProgramPipeline
+{
+public:
+	GLProgramPipeline() : _id(0) {}
+	void Create();
+	void Destroy();
+	GLuint Id() const;
+	// Stages are GL_VERTEX_SHADER_BIT, GL_FRAGMENT_SHADER_BIT, etc., taken from the program.
+	void UseStages(GLbitfield stages, const GLProgram &program);
+	// The program glUniform*() calls go to while the pipeline is bound, GLUniform sets its program's uniforms directly anyway.
+	void SetActiveProgram(const GLProgram &program);
+	// A bound program overrides the pipeline, so the program binding is cleared first.
+	void Bind() const;
+	static void Unbind();
+	// Checks that the stages in use fit together, e.g. that every stage's inputs are written by the stage before.
+	bool Validate() const;
+	std::string GetInfoLog() const;
+
+private:
+	GLuint _id;
+};
+
+} // namespace opengl
+#endif // GLPROGRAMPIPELINE_HPP
\ No newline at end of file
@@ -23,6 +23,10 @@
 */
 
 #include "GLShader.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 
 namespace opengl
 {
@@ -50,6 +54,88 @@ bool GLShader::CompileString(const char *source_str) {
 	return result != GL_FALSE;
 }
 
+bool GLShader::CompileString(const char *source_str, int length) {
+	CompileAsync(source_str, length);
+	return IsCompiled();
+}
+
+void GLShader::CompileAsync(const char *source_str, int length) {
+	glShaderSource(_id, 1, &source_str, &length);
+	glCompileShader(_id);
+}
+
+void GLShader::CompileAsync(const char *source_str, int length, const std::string &defines) {
+	if (defines.empty()) {
+		CompileAsync(source_str, length);
+		return;
+	}
+	const char *end = source_str + length;
+	const char *version = "#version";
+	const char *insert = std::search(source_str, end, version, version + std::strlen(version));
+	if (insert != end) {
+		insert = std::find(insert, end, '\n');
+		insert = insert != end ? insert + 1 : end;
+	}
+	else {
+		insert = source_str;
+	}
+	int line = (int)std::count(source_str, insert, '\n') + 1;
+	std::string prologue = defines + "#line " + std::to_string(line) + "\n";
+	// the source is passed in pieces around the defines instead of being copied
+	const char *strings[3] = { source_str, prologue.c_str(), insert };
+	int lengths[3] = { (int)(insert - source_str), (int)prologue.size(), (int)(end - insert) };
+	glShaderSource(_id, 3, strings, lengths);
+	glCompileShader(_id);
+}
+
+bool GLShader::IsCompiled() const {
+	int result = 0;
+	glGetShaderiv(_id, GL_COMPILE_STATUS, &result);
+	return result != GL_FALSE;
+}
+
+bool GLShader::CompileSpirv(const void *module, int size, const std::vector<GLuint> &constantIds, const std::vector<GLuint> &constantValues) {
+	GLuint id = _id;
+	glShaderBinary(1, &id, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, module, size);
+	glSpecializeShaderARB(id, "main", (GLuint)constantIds.size(), constantIds.empty() ? NULL : &constantIds[0],
+		constantValues.empty() ? NULL : &constantValues[0]);
+	return IsCompiled();
+}
+
+bool GLShader::GetSpecializationIds(const void *module, size_t size, std::vector<std::pair<std::string, GLuint>> &ids) {
+	const uint32_t MAGIC = 0x07230203;
+	const uint32_t OP_NAME = 5, OP_DECORATE = 71, DECORATION_SPEC_ID = 1;
+	const uint32_t *words = (const uint32_t *)module;
+	size_t count = size / sizeof(uint32_t);
+	if (count < 5 || words[0] != MAGIC)
+		return false;
+	std::unordered_map<uint32_t, std::string> names;
+	std::vector<std::pair<uint32_t, GLuint>> specIds; // result id, SpecId
+	// every instruction starts with its length in words and its opcode, the header is 5 words
+	for (size_t i = 5; i < count; ) {
+		uint32_t length = words[i] >> 16;
+		uint32_t opcode = words[i] & 0xFFFF;
+		if (length == 0 || i + length > count)
+			return false;
+		if (opcode == OP_NAME && length > 2) {
+			const char *name = (const char *)&words[i + 2];
+			const char *end = std::find(name, name + (length - 2) * sizeof(uint32_t), '\0');
+			names[words[i + 1]].assign(name, end);
+		}
+		else if (opcode == OP_DECORATE && length == 4 && words[i + 2] == DECORATION_SPEC_ID) {
+			specIds.push_back(std::make_pair(words[i + 1], (GLuint)words[i + 3]));
+		}
+		i += length;
+	}
+	for (unsigned int i = 0; i < specIds.size(); i++) {
+		auto found = names.find(specIds[i].first);
+		if (found != names.end()) {
+			ids.push_back(std::make_pair(found->second, specIds[i].second));
+		}
+	}
+	return true;
+}
+
 std::string GLShader::GetInfoLog() const {
 	int len = 0;
 	std::string log;
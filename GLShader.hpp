@@ -31,6 +31,7 @@
 #include <string>
 #include <fstream>
 #include <streambuf>
+#include <utility>
 
 namespace opengl {
 
@@ -75,6 +76,21 @@ public:
 	bool CompileFile(const std::string &path);
 	bool CompileStream(std::istream &input);
 	bool CompileString(const char *source_str);
+	// For sources that aren't NULL terminated, e.g. in a mapped GLAssetPack.
+	bool CompileString(const char *source_str, int length);
+	// Starts compiling without waiting for it, check IsCompiled() once the result is needed.
+	// Drivers with GL_ARB_parallel_shader_compile compile on their own threads meanwhile.
+	void CompileAsync(const char *source_str, int length);
+	// Compiles a specialization of the source: the defines (whole "#define NAME value" lines) are inserted
+	// after the #version line, with a #line so error messages still point into the original source.
+	void CompileAsync(const char *source_str, int length, const std::string &defines);
+	bool IsCompiled() const;
+	// Loads a SPIR-V module (GL_ARB_gl_spirv) and specializes its main() with the constants instead of
+	// compiling GLSL, see GLProgram::ModulePath(). Returns whether specialization succeeded.
+	bool CompileSpirv(const void *module, int size, const std::vector<GLuint> &constantIds, const std::vector<GLuint> &constantValues);
+	// Name and SpecId of each specialization constant the module declares, from its debug names.
+	// False if it isn't a SPIR-V module.
+	static bool GetSpecializationIds(const void *module, size_t size, std::vector<std::pair<std::string, GLuint>> &ids);
 	// Error message for compile failure.
 	std::string GetInfoLog() const;
 	std::string GetSource() const;
@@ -85,7 +101,6 @@ public:
 	// Hints to OpenGL to free the shader compiler from memory.
 	// It will be re-enabled and initialized the next time a shader is compiled.
 	static void ReleaseCompiler();
-	// glShaderBinary() //only for OpenGL ES
 };
 
 
@@ -0,0 +1,449 @@
+#include "GLTextureCompressor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GLTEXTURECOMPRESSOR_SSE2
+#endif
+
+namespace opengl {
+
+static uint32_t FourCC(char a, char b, char c, char d)
+{
+	return (uint32_t)(unsigned char)a | ((uint32_t)(unsigned char)b << 8) | ((uint32_t)(unsigned char)c << 16) | ((uint32_t)(unsigned char)d << 24);
+}
+
+// DDS_HEADER / DDS_PIXELFORMAT as documented for Direct3D
+struct DDSPixelFormat
+{
+	uint32_t size, flags, fourCC, rgbBitCount;
+	uint32_t rBitMask, gBitMask, bBitMask, aBitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat ddspf;
+	uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+static const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+static const uint32_t DDS_CACHE_TAG = 0x43545344; // "DSTC" in reserved1[0]
+static const uint32_t DDS_CACHE_VERSION = 1;
+
+static size_t BlockBytes(GLenum format)
+{
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+static void ComputeLevels(GLCompressedImage &image, int width, int height, int numLevels)
+{
+	image.levels.clear();
+	size_t offset = 0;
+	for (int i = 0; i < numLevels; i++) {
+		GLCompressedImage::Level level;
+		level.width = std::max(1, width >> i);
+		level.height = std::max(1, height >> i);
+		level.offset = offset;
+		level.size = (size_t)((level.width + 3) / 4) * ((level.height + 3) / 4) * BlockBytes(image.format);
+		offset += level.size;
+		image.levels.push_back(level);
+	}
+}
+
+// per channel minimum and maximum of a 4x4 RGBA block
+static void BlockMinMax(const unsigned char block[64], unsigned char minColor[4], unsigned char maxColor[4])
+{
+#ifdef GLTEXTURECOMPRESSOR_SSE2
+	__m128i a = _mm_loadu_si128((const __m128i *)block);
+	__m128i b = _mm_loadu_si128((const __m128i *)(block + 16));
+	__m128i c = _mm_loadu_si128((const __m128i *)(block + 32));
+	__m128i d = _mm_loadu_si128((const __m128i *)(block + 48));
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+	// fold the four pixels of each register into one
+	lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+	lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+	hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+	hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+	int lo32 = _mm_cvtsi128_si32(lo);
+	int hi32 = _mm_cvtsi128_si32(hi);
+	std::memcpy(minColor, &lo32, 4);
+	std::memcpy(maxColor, &hi32, 4);
+#else
+	for (int c = 0; c < 4; c++) {
+		minColor[c] = 255;
+		maxColor[c] = 0;
+	}
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+			maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+		}
+	}
+#endif
+}
+
+static uint16_t To565(const unsigned char color[4])
+{
+	return (uint16_t)((((color[0] * 31 + 127) / 255) << 11) | (((color[1] * 63 + 127) / 255) << 5) | ((color[2] * 31 + 127) / 255));
+}
+
+static void From565(uint16_t value, int color[3])
+{
+	int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void EncodeColorBlock(const unsigned char block[64], unsigned char out[8])
+{
+	unsigned char minColor[4], maxColor[4];
+	BlockMinMax(block, minColor, maxColor);
+	// pull the endpoints in a little, the extremes are usually outliers
+	for (int c = 0; c < 3; c++) {
+		int inset = (maxColor[c] - minColor[c]) >> 4;
+		minColor[c] = (unsigned char)(minColor[c] + inset);
+		maxColor[c] = (unsigned char)(maxColor[c] - inset);
+	}
+	uint16_t color0 = To565(maxColor);
+	uint16_t color1 = To565(minColor);
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		// four color mode (color0 > color1): c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+		int palette[4][3];
+		From565(color0, palette[0]);
+		From565(color1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++) {
+			const unsigned char *pixel = block + i * 4;
+			int best = 0, bestError = INT_MAX;
+			for (int p = 0; p < 4; p++) {
+				int dr = pixel[0] - palette[p][0], dg = pixel[1] - palette[p][1], db = pixel[2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+	out[0] = (unsigned char)(color0 & 0xFF);
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xFF);
+	out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++) {
+		out[4 + i] = (unsigned char)(indices >> (i * 8));
+	}
+}
+
+void GLTextureCompressor::EncodeBC1(const unsigned char block[64], unsigned char out[8])
+{
+	EncodeColorBlock(block, out);
+}
+
+void GLTextureCompressor::EncodeBC3(const unsigned char block[64], unsigned char out[16])
+{
+	EncodeBC4(block, 3, out);
+	EncodeColorBlock(block, out + 8);
+}
+
+void GLTextureCompressor::EncodeBC4(const unsigned char block[64], int channel, unsigned char out[8])
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++) {
+		lo = std::min(lo, (int)block[i * 4 + channel]);
+		hi = std::max(hi, (int)block[i * 4 + channel]);
+	}
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	uint64_t indices = 0;
+	if (hi != lo) {
+		// eight value mode (red0 > red1): r0, r1 and six interpolated steps from r0 to r1
+		int palette[8];
+		palette[0] = hi;
+		palette[1] = lo;
+		for (int i = 1; i < 7; i++) {
+			palette[i + 1] = ((7 - i) * hi + i * lo) / 7;
+		}
+		for (int i = 0; i < 16; i++) {
+			int value = block[i * 4 + channel];
+			int best = 0, bestError = INT_MAX;
+			for (int p = 0; p < 8; p++) {
+				int error = std::abs(value - palette[p]);
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+}
+
+void GLTextureCompressor::EncodeBC5(const unsigned char block[64], unsigned char out[16])
+{
+	EncodeBC4(block, 0, out);
+	EncodeBC4(block, 1, out + 8);
+}
+
+GLTextureCompressor::Format GLTextureCompressor::ChooseFormat(TextureType type, const unsigned char *rgba, int width, int height)
+{
+	if (type == TextureType::Normal) {
+		return Format::BC5;
+	}
+	if (type == TextureType::Specular) {
+		return Format::BC4;
+	}
+	for (size_t i = 0, count = (size_t)width * height; i < count; i++) {
+		if (rgba[i * 4 + 3] != 255) {
+			return Format::BC3;
+		}
+	}
+	return Format::BC1;
+}
+
+GLenum GLTextureCompressor::InternalFormat(Format format)
+{
+	switch (format) {
+	case Format::BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case Format::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case Format::BC4:
+		return GL_COMPRESSED_RED_RGTC1;
+	default:
+		return GL_COMPRESSED_RG_RGTC2;
+	}
+}
+
+void GLTextureCompressor::Compress(const unsigned char *rgba, int width, int height, Format format, ThreadPool &pool, GLCompressedImage &image)
+{
+	int numLevels = 1;
+	while ((width >> numLevels) > 0 || (height >> numLevels) > 0) {
+		numLevels++;
+	}
+	image.format = InternalFormat(format);
+	ComputeLevels(image, width, height, numLevels);
+	image.data.resize(image.levels.back().offset + image.levels.back().size);
+
+	std::vector<unsigned char> mip, nextMip;
+	const unsigned char *pixels = rgba;
+	for (int i = 0; i < numLevels; i++) {
+		const GLCompressedImage::Level &level = image.levels[i];
+		if (i > 0) {
+			// 2x2 box filter of the previous level, edges are clamped for odd sizes
+			const GLCompressedImage::Level &prev = image.levels[i - 1];
+			nextMip.resize((size_t)level.width * level.height * 4);
+			pool.ParallelFor(level.height, [&](size_t y) {
+				int y0 = std::min((int)y * 2, prev.height - 1), y1 = std::min((int)y * 2 + 1, prev.height - 1);
+				for (int x = 0; x < level.width; x++) {
+					int x0 = std::min(x * 2, prev.width - 1), x1 = std::min(x * 2 + 1, prev.width - 1);
+					for (int c = 0; c < 4; c++) {
+						int sum = pixels[((size_t)y0 * prev.width + x0) * 4 + c] + pixels[((size_t)y0 * prev.width + x1) * 4 + c]
+							+ pixels[((size_t)y1 * prev.width + x0) * 4 + c] + pixels[((size_t)y1 * prev.width + x1) * 4 + c];
+						nextMip[((size_t)y * level.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+					}
+				}
+			});
+			mip.swap(nextMip);
+			pixels = mip.data();
+		}
+
+		int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+		size_t blockBytes = BlockBytes(image.format);
+		unsigned char *dst = image.data.data() + level.offset;
+		pool.ParallelFor(blocksY, [&](size_t by) {
+			unsigned char block[64];
+			for (int bx = 0; bx < blocksX; bx++) {
+				for (int py = 0; py < 4; py++) {
+					int y = std::min((int)by * 4 + py, level.height - 1);
+					for (int px = 0; px < 4; px++) {
+						int x = std::min(bx * 4 + px, level.width - 1);
+						std::memcpy(block + (py * 4 + px) * 4, pixels + ((size_t)y * level.width + x) * 4, 4);
+					}
+				}
+				unsigned char *out = dst + ((size_t)by * blocksX + bx) * blockBytes;
+				switch (format) {
+				case Format::BC1:
+					EncodeBC1(block, out);
+					break;
+				case Format::BC3:
+					EncodeBC3(block, out);
+					break;
+				case Format::BC4:
+					EncodeBC4(block, 0, out);
+					break;
+				case Format::BC5:
+					EncodeBC5(block, out);
+					break;
+				}
+			}
+		});
+	}
+}
+
+// Checks a cache header and fills in the image's format and mip layout.
+static bool ReadHeader(uint32_t magic, const DDSHeader &header, GLCompressedImage &image)
+{
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader)
+		|| header.reserved1[0] != DDS_CACHE_TAG || header.reserved1[1] != DDS_CACHE_VERSION) {
+		return false;
+	}
+	if (header.ddspf.fourCC == FourCC('D', 'X', 'T', '1'))
+		image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	else if (header.ddspf.fourCC == FourCC('D', 'X', 'T', '5'))
+		image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	else if (header.ddspf.fourCC == FourCC('A', 'T', 'I', '1'))
+		image.format = GL_COMPRESSED_RED_RGTC1;
+	else if (header.ddspf.fourCC == FourCC('A', 'T', 'I', '2'))
+		image.format = GL_COMPRESSED_RG_RGTC2;
+	else
+		return false;
+
+	ComputeLevels(image, (int)header.width, (int)header.height, std::max(1, (int)header.mipMapCount));
+	return true;
+}
+
+bool GLTextureCompressor::Load(const std::string &cachePath, uint64_t sourceHash, GLCompressedImage &image)
+{
+	std::ifstream file(cachePath, std::ios::in | std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	uint32_t magic;
+	DDSHeader header;
+	if (!file.read((char *)&magic, sizeof(magic)) || !file.read((char *)&header, sizeof(header))
+		|| header.reserved1[2] != (uint32_t)sourceHash || header.reserved1[3] != (uint32_t)(sourceHash >> 32)
+		|| !ReadHeader(magic, header, image)) {
+		return false;
+	}
+	size_t size = image.levels.back().offset + image.levels.back().size;
+	image.data.resize(size);
+	if (!file.read((char *)image.data.data(), size)) {
+		image = GLCompressedImage();
+		return false;
+	}
+	return true;
+}
+
+bool GLTextureCompressor::Load(const unsigned char *data, size_t size, GLCompressedImage &image)
+{
+	uint32_t magic;
+	DDSHeader header;
+	const size_t headerSize = sizeof(magic) + sizeof(header);
+	if (size < headerSize) {
+		return false;
+	}
+	std::memcpy(&magic, data, sizeof(magic));
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (!ReadHeader(magic, header, image) || headerSize + image.levels.back().offset + image.levels.back().size > size) {
+		image = GLCompressedImage();
+		return false;
+	}
+	image.data.assign(data + headerSize, data + headerSize + image.levels.back().offset + image.levels.back().size);
+	return true;
+}
+
+bool GLTextureCompressor::Save(const std::string &cachePath, uint64_t sourceHash, const GLCompressedImage &image)
+{
+	if (image.levels.empty()) {
+		return false;
+	}
+	DDSHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.size = sizeof(DDSHeader);
+	header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+	header.width = image.levels[0].width;
+	header.height = image.levels[0].height;
+	header.pitchOrLinearSize = (uint32_t)image.levels[0].size;
+	header.mipMapCount = (uint32_t)image.levels.size();
+	header.reserved1[0] = DDS_CACHE_TAG;
+	header.reserved1[1] = DDS_CACHE_VERSION;
+	header.reserved1[2] = (uint32_t)sourceHash;
+	header.reserved1[3] = (uint32_t)(sourceHash >> 32);
+	header.ddspf.size = sizeof(DDSPixelFormat);
+	header.ddspf.flags = 0x4; // FOURCC
+	switch (image.format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		header.ddspf.fourCC = FourCC('D', 'X', 'T', '1');
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		header.ddspf.fourCC = FourCC('D', 'X', 'T', '5');
+		break;
+	case GL_COMPRESSED_RED_RGTC1:
+		header.ddspf.fourCC = FourCC('A', 'T', 'I', '1');
+		break;
+	default:
+		header.ddspf.fourCC = FourCC('A', 'T', 'I', '2');
+		break;
+	}
+	header.caps = 0x1000 | 0x400000 | 0x8; // TEXTURE | MIPMAP | COMPLEX
+
+	std::ofstream file(cachePath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+	file.write((const char *)&DDS_MAGIC, sizeof(DDS_MAGIC));
+	file.write((const char *)&header, sizeof(header));
+	file.write((const char *)image.data.data(), image.data.size());
+	// the last write may only fail once it's flushed, and a short cache must not outlive this call
+	file.close();
+	if (file.fail()) {
+		std::remove(cachePath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool GLTextureCompressor::ReadLevels(const std::string &cachePath, const GLCompressedImage &layout, unsigned int firstLevel, std::vector<unsigned char> &data)
+{
+	if (firstLevel >= layout.levels.size()) {
+		return false;
+	}
+	std::ifstream file(cachePath, std::ios::in | std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	const GLCompressedImage::Level &first = layout.levels[firstLevel];
+	const GLCompressedImage::Level &last = layout.levels.back();
+	data.resize(last.offset + last.size - first.offset);
+	file.seekg(sizeof(DDS_MAGIC) + sizeof(DDSHeader) + first.offset);
+	return (bool)file.read((char *)data.data(), data.size());
+}
+
+bool GLTextureCompressor::ReadLevels(const unsigned char *cache, size_t size, const GLCompressedImage &layout, unsigned int firstLevel, std::vector<unsigned char> &data)
+{
+	if (firstLevel >= layout.levels.size()) {
+		return false;
+	}
+	const GLCompressedImage::Level &first = layout.levels[firstLevel];
+	const GLCompressedImage::Level &last = layout.levels.back();
+	const size_t begin = sizeof(DDS_MAGIC) + sizeof(DDSHeader) + first.offset;
+	const size_t end = sizeof(DDS_MAGIC) + sizeof(DDSHeader) + last.offset + last.size;
+	if (end > size) {
+		return false;
+	}
+	data.assign(cache + begin, cache + end);
+	return true;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef GLTEXTURECOMPRESSOR_HPP
+#define GLTEXTURECOMPRESSOR_HPP
+
+#include <GL/glew.h>
+
+#include "GLMesh.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace opengl {
+
+// Block compressed image with its full mip chain, levels stored one after another in data.
+struct GLCompressedImage
+{
+	struct Level
+	{
+		int width, height;
+		size_t offset, size;
+	};
+	GLenum format; // GL internal format, zero when empty
+	std::vector<Level> levels;
+	std::vector<unsigned char> data;
+
+	GLCompressedImage() : format(0) {}
+};
+
+// CPU encoder for the BC formats the G-buffer samples from, plus a DDS file cache for its output.
+// Diffuse maps use BC1 (BC3 when they have alpha), specular maps BC4 and normal maps BC5 (x/y only).
+class GLTextureCompressor
+{
+public:
+	enum class Format
+	{
+		BC1,
+		BC3,
+		BC4,
+		BC5,
+	};
+
+	static Format ChooseFormat(TextureType type, const unsigned char *rgba, int width, int height);
+	static GLenum InternalFormat(Format format);
+	// Compresses a width * height RGBA8 image and a box filtered mip chain down to 1x1.
+	// Block rows are encoded across the pool.
+	static void Compress(const unsigned char *rgba, int width, int height, Format format, ThreadPool &pool, GLCompressedImage &image);
+
+	// The cache is a regular DDS file, the source hash is kept in the header's reserved words.
+	static bool Load(const std::string &cachePath, uint64_t sourceHash, GLCompressedImage &image);
+	// Reads a cache that's already in memory, e.g. in a GLAssetPack, without checking its source.
+	static bool Load(const unsigned char *data, size_t size, GLCompressedImage &image);
+	static bool Save(const std::string &cachePath, uint64_t sourceHash, const GLCompressedImage &image);
+	// Reads levels [firstLevel, end) of a cache written by Save(). data is laid out like image.data from that level on.
+	static bool ReadLevels(const std::string &cachePath, const GLCompressedImage &layout, unsigned int firstLevel, std::vector<unsigned char> &data);
+	static bool ReadLevels(const unsigned char *cache, size_t size, const GLCompressedImage &layout, unsigned int firstLevel, std::vector<unsigned char> &data);
+
+	static void EncodeBC1(const unsigned char block[64], unsigned char out[8]);
+	static void EncodeBC3(const unsigned char block[64], unsigned char out[16]);
+	static void EncodeBC4(const unsigned char block[64], int channel, unsigned char out[8]);
+	static void EncodeBC5(const unsigned char block[64], unsigned char out[16]);
+};
+
+} // namespace opengl
+#endif // GLTEXTURECOMPRESSOR_HPP
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "GLTextureRegistry.hpp"
+
+#include <cctype>
+
+namespace opengl {
+
+GLTextureRegistry::~GLTextureRegistry()
+{
+	Clear();
+}
+
+unsigned int GLTextureRegistry::Acquire(const std::string &filename, TextureType type, bool &created)
+{
+	std::string path = NormalizePath(filename);
+	created = false;
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto found = _lookup.find(path);
+	if (found != _lookup.end()) {
+		_entries[found->second - 1].refs++;
+		return found->second;
+	}
+
+	unsigned int handle;
+	if (!_freeHandles.empty()) {
+		handle = _freeHandles.back();
+		_freeHandles.pop_back();
+	}
+	else {
+		_entries.push_back(Entry());
+		handle = (unsigned int)_entries.size();
+	}
+	Entry &entry = _entries[handle - 1];
+	entry.path = path;
+	glGenTextures(1, &entry.id);
+	entry.type = type;
+	entry.refs = 1;
+	entry.resident = false;
+	_lookup[path] = handle;
+	_size++;
+	created = true;
+	return handle;
+}
+
+void GLTextureRegistry::Release(unsigned int handle)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Entry &entry = _entries[handle - 1];
+	if (entry.refs == 0 || --entry.refs > 0) {
+		return;
+	}
+	glDeleteTextures(1, &entry.id);
+	_lookup.erase(entry.path);
+	entry.id = 0;
+	entry.path.clear();
+	_freeHandles.push_back(handle);
+	_size--;
+}
+
+void GLTextureRegistry::Clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (unsigned int i = 0; i < _entries.size(); i++) {
+		if (_entries[i].refs > 0) {
+			glDeleteTextures(1, &_entries[i].id);
+		}
+	}
+	_entries.clear();
+	_freeHandles.clear();
+	_lookup.clear();
+	_size = 0;
+}
+
+GLTexture GLTextureRegistry::Get(unsigned int handle) const
+{
+	const Entry &entry = _entries[handle - 1];
+	GLTexture texture;
+	texture.id = entry.id;
+	texture.type = entry.type;
+	texture.handle = handle;
+	return texture;
+}
+
+GLuint GLTextureRegistry::Id(unsigned int handle) const
+{
+	return _entries[handle - 1].id;
+}
+
+unsigned int GLTextureRegistry::RefCount(unsigned int handle) const
+{
+	return _entries[handle - 1].refs;
+}
+
+bool GLTextureRegistry::IsResident(unsigned int handle) const
+{
+	return _entries[handle - 1].resident;
+}
+
+bool GLTextureRegistry::IsResident(const std::string &filename) const
+{
+	std::string path = NormalizePath(filename);
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto found = _lookup.find(path);
+	return found != _lookup.end() && _entries[found->second - 1].resident;
+}
+
+void GLTextureRegistry::SetResident(unsigned int handle, bool resident)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_entries[handle - 1].resident = resident;
+}
+
+size_t GLTextureRegistry::Size() const
+{
+	return _size;
+}
+
+std::string GLTextureRegistry::NormalizePath(const std::string &path)
+{
+	// split into segments so "a\\b\\..\\c.png" and "./a/c.png" end up as the same key
+	size_t root = 0;
+	while (root < path.size() && root < 2 && (path[root] == '/' || path[root] == '\\')) {
+		root++;
+	}
+	const bool drive = path.size() >= 2 && path[1] == ':' && std::isalpha((unsigned char)path[0]);
+	std::vector<std::string> segments;
+	std::string segment;
+	for (size_t i = root; i <= path.size(); i++) {
+		char c = i < path.size() ? path[i] : '/';
+		if (c == '/' || c == '\\') {
+			if (segment == "..") {
+				// never above the root or the drive
+				bool atDrive = drive && segments.size() == 1 && segments[0].size() == 2;
+				if (!segments.empty() && segments.back() != ".." && !atDrive) {
+					segments.pop_back();
+				}
+				else if (root == 0 && !atDrive) {
+					segments.push_back(segment);
+				}
+			}
+			else if (!segment.empty() && segment != ".") {
+				segments.push_back(segment);
+			}
+			segment.clear();
+		}
+		else {
+			segment += (char)std::tolower((unsigned char)c);
+		}
+	}
+	std::string result(root, '/');
+	for (unsigned int i = 0; i < segments.size(); i++) {
+		if (i > 0) {
+			result += '/';
+		}
+		result += segments[i];
+	}
+	return result;
+}
+
+} // namespace opengl
\ No newline at end of file
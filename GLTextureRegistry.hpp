@@ -0,0 +1,67 @@
+#pragma once
+#ifndef GLTEXTUREREGISTRY_HPP
+#define GLTEXTUREREGISTRY_HPP
+
+#include <GL/glew.h>
+
+#include "GLMesh.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace opengl {
+
+// Owns every texture the model loader creates. Textures are looked up by their normalized file path,
+// shared between models and deleted once the last reference is released.
+// Handles are small indices, zero is never a valid handle. Only use it on the GL thread, except
+// IsResident(filename) which the loader thread may call while the GL thread keeps working.
+class GLTextureRegistry
+{
+public:
+	GLTextureRegistry() : _size(0) {}
+	~GLTextureRegistry();
+	// Returns the texture for filename and adds a reference to it. A new GL texture name is
+	// generated when the file wasn't registered yet, in which case created is set.
+	unsigned int Acquire(const std::string &filename, TextureType type, bool &created);
+	// Drops a reference, deleting the GL texture when it was the last one.
+	void Release(unsigned int handle);
+	// Deletes every texture regardless of its references.
+	void Clear();
+	GLTexture Get(unsigned int handle) const;
+	GLuint Id(unsigned int handle) const;
+	unsigned int RefCount(unsigned int handle) const;
+	// Set once the real image has been uploaded, until then the texture only holds a placeholder.
+	bool IsResident(unsigned int handle) const;
+	// Looks up filename without adding a reference. Safe to call from any thread.
+	bool IsResident(const std::string &filename) const;
+	void SetResident(unsigned int handle, bool resident);
+	size_t Size() const;
+
+	// Lower case, forward slashes, "." and ".." segments resolved. A leading separator (or two, for a share)
+	// and a drive prefix are kept, so an absolute path never matches a relative one.
+	static std::string NormalizePath(const std::string &path);
+
+private:
+	GLTextureRegistry(const GLTextureRegistry &) = delete;
+	GLTextureRegistry &operator=(const GLTextureRegistry &) = delete;
+
+	struct Entry
+	{
+		std::string path; // normalized, the key in _lookup
+		GLuint id;
+		TextureType type;
+		unsigned int refs;
+		bool resident;
+	};
+	std::vector<Entry> _entries; // handle - 1
+	std::vector<unsigned int> _freeHandles;
+	std::unordered_map<std::string, unsigned int> _lookup;
+	size_t _size;
+	mutable std::mutex _mutex; // held by everything that changes the entries or the lookup
+};
+
+} // namespace opengl
+#endif // GLTEXTUREREGISTRY_HPP
\ No newline at end of file
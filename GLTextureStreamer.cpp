@@ -0,0 +1,316 @@
+#include "GLTextureStreamer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+
+namespace opengl {
+
+// textures start from, and are evicted down to, the first level no larger than this
+static const int MIN_RESIDENT_SIZE = 128;
+
+GLTextureStreamer::GLTextureStreamer(ThreadPool &pool)
+	: _pool(pool), _pack(nullptr), _budget(0), _committedBytes(0), _frame(0), _pendingLoads(0)
+{
+}
+
+GLTextureStreamer::~GLTextureStreamer()
+{
+	// loads still in flight hold on to this
+	_loads.Wait();
+}
+
+void GLTextureStreamer::SetBudget(size_t bytes)
+{
+	_budget = bytes;
+}
+
+void GLTextureStreamer::SetAssetPack(const GLAssetPack *pack)
+{
+	_pack = pack;
+}
+
+bool GLTextureStreamer::IsEnabled() const
+{
+	return _budget > 0;
+}
+
+unsigned int GLTextureStreamer::InitialLevel(const GLCompressedImage &image)
+{
+	for (unsigned int i = 0; i < image.levels.size(); i++) {
+		if (std::max(image.levels[i].width, image.levels[i].height) <= MIN_RESIDENT_SIZE) {
+			return i;
+		}
+	}
+	return image.levels.empty() ? 0 : (unsigned int)image.levels.size() - 1;
+}
+
+void GLTextureStreamer::Register(unsigned int handle, GLuint id, const std::string &cachePath, const GLCompressedImage &layout, unsigned int firstLevel)
+{
+	if (_entries.size() <= handle) {
+		_entries.resize(handle + 1);
+	}
+	Entry &entry = _entries[handle];
+	if (entry.registered) {
+		Unregister(handle);
+	}
+	entry.registered = true;
+	entry.id = id;
+	entry.cachePath = cachePath;
+	entry.layout.format = layout.format;
+	entry.layout.levels = layout.levels;
+	entry.layout.data.clear();
+	entry.residentLevel = firstLevel;
+	entry.targetLevel = firstLevel;
+	entry.minLevel = std::max(firstLevel, InitialLevel(layout));
+	entry.wantedLevel = firstLevel;
+	entry.seenLevel = firstLevel;
+	entry.lastSeen = 0;
+	_committedBytes += _Bytes(entry, firstLevel);
+}
+
+void GLTextureStreamer::Unregister(unsigned int handle)
+{
+	if (handle >= _entries.size() || !_entries[handle].registered) {
+		return;
+	}
+	Entry &entry = _entries[handle];
+	_committedBytes -= _Bytes(entry, entry.targetLevel);
+	entry.registered = false;
+	entry.id = 0;
+}
+
+void GLTextureStreamer::Clear()
+{
+	_entries.clear();
+	_committedBytes = 0;
+}
+
+unsigned int GLTextureStreamer::AddFeedbackGroup(const std::vector<GLTexture> &textures)
+{
+	std::vector<unsigned int> handles;
+	for (unsigned int i = 0; i < textures.size(); i++) {
+		handles.push_back(textures[i].handle);
+	}
+	std::sort(handles.begin(), handles.end());
+	handles.erase(std::unique(handles.begin(), handles.end()), handles.end());
+	if (handles.empty()) {
+		return 0;
+	}
+	auto found = _groupIds.find(handles);
+	if (found != _groupIds.end()) {
+		return found->second;
+	}
+	if (_groups.size() >= (1u << (32 - FEEDBACK_ID_SHIFT)) - 1) {
+		return 0; // out of ids, the mesh just won't drive streaming
+	}
+	_groups.push_back(handles);
+	unsigned int id = (unsigned int)_groups.size();
+	_groupIds[handles] = id;
+	return id;
+}
+
+void GLTextureStreamer::ProcessFeedback(const unsigned int *feedback, int width, int height)
+{
+	_frame++;
+	for (int i = 0, count = width * height; i < count; i++) {
+		unsigned int group = feedback[i] >> FEEDBACK_ID_SHIFT;
+		if (group == 0 || group > _groups.size()) {
+			continue;
+		}
+		float footprint = (float)(feedback[i] & FEEDBACK_LOD_MASK) / FEEDBACK_LOD_SCALE - FEEDBACK_LOD_OFFSET;
+		const std::vector<unsigned int> &handles = _groups[group - 1];
+		for (unsigned int j = 0; j < handles.size(); j++) {
+			if (handles[j] >= _entries.size() || !_entries[handles[j]].registered) {
+				continue;
+			}
+			Entry &entry = _entries[handles[j]];
+			// the footprint is in UV units, scaling by the full resolution gives the sampled level
+			const GLCompressedImage::Level &top = entry.layout.levels[0];
+			float lod = footprint + std::log2((float)std::max(top.width, top.height));
+			unsigned int level = (unsigned int)std::min(std::max(lod, 0.0f), (float)entry.layout.levels.size() - 1);
+			if (entry.lastSeen != _frame) {
+				entry.lastSeen = _frame;
+				entry.seenLevel = level;
+			}
+			else {
+				entry.seenLevel = std::min(entry.seenLevel, level);
+			}
+		}
+	}
+	for (unsigned int i = 0; i < _entries.size(); i++) {
+		if (_entries[i].registered && _entries[i].lastSeen == _frame) {
+			_entries[i].wantedLevel = _entries[i].seenLevel;
+		}
+	}
+}
+
+void GLTextureStreamer::Update(float budgetMs)
+{
+	if (!IsEnabled()) {
+		return;
+	}
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Ms;
+	Clock::time_point start = Clock::now();
+	for (;;) {
+		Load load;
+		{
+			std::lock_guard<std::mutex> lock(_finishedMutex);
+			if (_finished.empty()) {
+				break;
+			}
+			load = std::move(_finished.front());
+			_finished.pop_front();
+		}
+		_pendingLoads--;
+		_Apply(load);
+		if (Ms(Clock::now() - start).count() >= budgetMs) {
+			break;
+		}
+	}
+
+	// recently seen textures that are missing the most levels go first
+	std::vector<unsigned int> requests;
+	for (unsigned int i = 0; i < _entries.size(); i++) {
+		const Entry &entry = _entries[i];
+		if (entry.registered && entry.targetLevel == entry.residentLevel && entry.wantedLevel < entry.residentLevel
+			&& _frame - entry.lastSeen < EVICT_AFTER_FRAMES) {
+			requests.push_back(i);
+		}
+	}
+	std::sort(requests.begin(), requests.end(), [this](unsigned int a, unsigned int b) {
+		const Entry &ea = _entries[a], &eb = _entries[b];
+		if (ea.lastSeen != eb.lastSeen) {
+			return ea.lastSeen > eb.lastSeen;
+		}
+		return ea.residentLevel - ea.wantedLevel > eb.residentLevel - eb.wantedLevel;
+	});
+	for (unsigned int i = 0; i < requests.size() && _pendingLoads < MAX_PENDING_LOADS; i++) {
+		Entry &entry = _entries[requests[i]];
+		// settle for a coarser level when the wanted one doesn't fit
+		for (unsigned int level = entry.wantedLevel; level < entry.residentLevel; level++) {
+			size_t extra = _Bytes(entry, level) - _Bytes(entry, entry.residentLevel);
+			if (_committedBytes + extra <= _budget || _Evict(_committedBytes + extra - _budget)) {
+				_committedBytes += extra;
+				entry.targetLevel = level;
+				_QueueLoad(requests[i], level);
+				break;
+			}
+		}
+	}
+}
+
+size_t GLTextureStreamer::ResidentBytes() const
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < _entries.size(); i++) {
+		if (_entries[i].registered) {
+			bytes += _Bytes(_entries[i], _entries[i].residentLevel);
+		}
+	}
+	return bytes;
+}
+
+size_t GLTextureStreamer::_Bytes(const Entry &entry, unsigned int level) const
+{
+	size_t bytes = 0;
+	for (unsigned int i = level; i < entry.layout.levels.size(); i++) {
+		bytes += entry.layout.levels[i].size;
+	}
+	return bytes;
+}
+
+void GLTextureStreamer::_QueueLoad(unsigned int handle, unsigned int level)
+{
+	_pendingLoads++;
+	const Entry &entry = _entries[handle];
+	GLuint id = entry.id;
+	std::string cachePath = entry.cachePath;
+	GLCompressedImage layout;
+	layout.format = entry.layout.format;
+	layout.levels = entry.layout.levels;
+	// caches in the asset pack are copied straight out of its mapping
+	const unsigned char *packed = nullptr;
+	size_t packedSize = 0;
+	if (_pack != nullptr) {
+		_pack->Find(cachePath, packed, packedSize);
+	}
+	_pool.Submit(_loads, [this, handle, level, id, cachePath, layout, packed, packedSize] {
+		Load load;
+		load.handle = handle;
+		load.id = id;
+		load.level = level;
+		load.ok = packed != nullptr ? GLTextureCompressor::ReadLevels(packed, packedSize, layout, level, load.data)
+			: GLTextureCompressor::ReadLevels(cachePath, layout, level, load.data);
+		std::lock_guard<std::mutex> lock(_finishedMutex);
+		_finished.push_back(std::move(load));
+	});
+}
+
+void GLTextureStreamer::_Apply(const Load &load)
+{
+	if (load.handle >= _entries.size() || !_entries[load.handle].registered || _entries[load.handle].id != load.id) {
+		return; // unloaded while streaming
+	}
+	Entry &entry = _entries[load.handle];
+	if (entry.targetLevel != load.level) {
+		return; // superseded, the newer load fixes up the accounting
+	}
+	if (!load.ok) {
+		std::cout << "Failed to stream texture levels from: " << entry.cachePath << std::endl;
+		_committedBytes -= _Bytes(entry, entry.targetLevel);
+		_committedBytes += _Bytes(entry, entry.residentLevel);
+		entry.targetLevel = entry.residentLevel;
+		entry.wantedLevel = entry.residentLevel;
+		return;
+	}
+	// respecify the whole chain, GL level 0 becomes the loaded level
+	const std::vector<GLCompressedImage::Level> &levels = entry.layout.levels;
+	const size_t base = levels[load.level].offset;
+	glBindTexture(GL_TEXTURE_2D, entry.id);
+	for (unsigned int i = load.level; i < levels.size(); i++) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, i - load.level, entry.layout.format, levels[i].width, levels[i].height, 0,
+			(GLsizei)levels[i].size, load.data.data() + levels[i].offset - base);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)(levels.size() - 1 - load.level));
+	glBindTexture(GL_TEXTURE_2D, 0);
+	entry.residentLevel = load.level;
+}
+
+bool GLTextureStreamer::_Evict(size_t needed)
+{
+	// least recently seen first, anything seen lately stays
+	std::vector<unsigned int> candidates;
+	for (unsigned int i = 0; i < _entries.size(); i++) {
+		const Entry &entry = _entries[i];
+		if (entry.registered && entry.targetLevel == entry.residentLevel && entry.residentLevel < entry.minLevel
+			&& _frame - entry.lastSeen >= EVICT_AFTER_FRAMES) {
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](unsigned int a, unsigned int b) {
+		return _entries[a].lastSeen < _entries[b].lastSeen;
+	});
+	size_t freed = 0;
+	unsigned int count = 0;
+	for (; count < candidates.size() && freed < needed; count++) {
+		const Entry &entry = _entries[candidates[count]];
+		freed += _Bytes(entry, entry.residentLevel) - _Bytes(entry, entry.minLevel);
+	}
+	if (freed < needed) {
+		return false;
+	}
+	// the memory is only returned once the smaller chain is uploaded, but it is already accounted for
+	for (unsigned int i = 0; i < count; i++) {
+		Entry &entry = _entries[candidates[i]];
+		_committedBytes -= _Bytes(entry, entry.residentLevel) - _Bytes(entry, entry.minLevel);
+		entry.targetLevel = entry.minLevel;
+		entry.wantedLevel = entry.minLevel;
+		_QueueLoad(candidates[i], entry.minLevel);
+	}
+	return true;
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+#ifndef GLTEXTURESTREAMER_HPP
+#define GLTEXTURESTREAMER_HPP
+
+#include <GL/glew.h>
+
+#include "GLAssetPack.hpp"
+#include "GLMesh.hpp"
+#include "GLTextureCompressor.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace opengl {
+
+// Keeps only the mip levels the camera actually samples resident, within a fixed memory budget.
+//
+// The G-buffer pass writes a feedback id per pixel together with the log2 UV footprint
+// (see FEEDBACK_* below). ProcessFeedback() turns a read back copy of that buffer into the finest
+// level each texture needs, and Update() streams levels in from the textures' DDS caches and
+// evicts the least recently seen textures down to a small mip tail when over budget.
+// Textures are re-specified in place so their GL names never change. Only call it on the GL thread.
+class GLTextureStreamer
+{
+public:
+	static const unsigned int FEEDBACK_ID_SHIFT = 12;
+	static const unsigned int FEEDBACK_LOD_MASK = 0xFFF;
+	// footprint is stored as (log2 + FEEDBACK_LOD_OFFSET) * FEEDBACK_LOD_SCALE
+	static const int FEEDBACK_LOD_OFFSET = 32;
+	static const int FEEDBACK_LOD_SCALE = 64;
+
+	explicit GLTextureStreamer(ThreadPool &pool);
+	~GLTextureStreamer();
+	// Zero disables streaming, textures are then uploaded with their full mip chain.
+	void SetBudget(size_t bytes);
+	bool IsEnabled() const;
+	// Levels of textures whose cache is in the pack are read from it. The pack has to outlive the streamer's loads.
+	void SetAssetPack(const GLAssetPack *pack);
+	// Level of the mip chain that newly loaded textures start from.
+	static unsigned int InitialLevel(const GLCompressedImage &image);
+
+	// Starts managing a texture whose levels [firstLevel, end) are currently resident.
+	void Register(unsigned int handle, GLuint id, const std::string &cachePath, const GLCompressedImage &layout, unsigned int firstLevel);
+	void Unregister(unsigned int handle);
+	void Clear();
+	// Returns the id a mesh writes to the feedback buffer, identical sets of textures share an id.
+	unsigned int AddFeedbackGroup(const std::vector<GLTexture> &textures);
+
+	void ProcessFeedback(const unsigned int *feedback, int width, int height);
+	// Finishes streamed loads for at most budgetMs, then queues new loads and evictions.
+	void Update(float budgetMs);
+	size_t ResidentBytes() const;
+
+private:
+	GLTextureStreamer(const GLTextureStreamer &) = delete;
+	GLTextureStreamer &operator=(const GLTextureStreamer &) = delete;
+
+	struct Entry
+	{
+		bool registered;
+		GLuint id;
+		std::string cachePath;
+		GLCompressedImage layout; // levels only, no data
+		unsigned int residentLevel; // full chain level that is GL level 0 right now
+		unsigned int targetLevel; // residentLevel, or the level a pending load will make resident
+		unsigned int minLevel; // never evicted past this
+		unsigned int wantedLevel;
+		unsigned int seenLevel; // finest level seen in the frame being processed
+		uint64_t lastSeen;
+	};
+	struct Load
+	{
+		unsigned int handle;
+		GLuint id; // tells a reused handle apart
+		unsigned int level;
+		std::vector<unsigned char> data;
+		bool ok;
+	};
+
+	const unsigned int MAX_PENDING_LOADS = 8;
+	const uint64_t EVICT_AFTER_FRAMES = 60; // unseen for this many feedback frames before it may be evicted
+
+	size_t _Bytes(const Entry &entry, unsigned int level) const;
+	void _QueueLoad(unsigned int handle, unsigned int level);
+	void _Apply(const Load &load);
+	bool _Evict(size_t needed);
+
+	ThreadPool &_pool;
+	TaskGroup _loads; // the reads this streamer queued on the shared pool
+	const GLAssetPack *_pack;
+	size_t _budget;
+	size_t _committedBytes; // bytes of every texture at its target level
+	uint64_t _frame;
+	unsigned int _pendingLoads;
+	std::vector<Entry> _entries; // by registry handle
+	std::vector<std::vector<unsigned int>> _groups; // feedback id - 1 -> registry handles
+	std::map<std::vector<unsigned int>, unsigned int> _groupIds;
+	std::deque<Load> _finished;
+	std::mutex _finishedMutex;
+};
+
+} // namespace opengl
+#endif // GLTEXTURESTREAMER_HPP
\ No newline at end of file
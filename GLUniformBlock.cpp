@@ -0,0 +1,176 @@
+#include "GLUniformBlock.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace opengl {
+
+GLUniformBlock::GLUniformBlock()
+	: _target(GL_UNIFORM_BUFFER), _resource(GL_UNIFORM_BLOCK), _buffer(0), _binding(0), _dirtyBegin(0), _dirtyEnd(0)
+{
+}
+
+bool GLUniformBlock::Create(const GLProgram &program, const std::string &blockName, GLuint binding, ProgramResource resource)
+{
+	Destroy();
+	int blockIndex = program.GetResourceIndex(resource, blockName);
+	if (blockIndex == (int)GL_INVALID_INDEX) {
+		std::cout << "No block named " << blockName << std::endl;
+		return false;
+	}
+	bool storage = resource == ProgramResource::SHADER_STORAGE_BLOCK;
+	ProgramResource variables = storage ? ProgramResource::BUFFER_VARIABLE : ProgramResource::UNIFORM;
+	_target = storage ? GL_SHADER_STORAGE_BUFFER : GL_UNIFORM_BUFFER;
+	_resource = (GLenum)resource;
+	_name = blockName;
+	_binding = binding;
+	_data.assign(program.GetResourceProperty(resource, blockIndex, ResourceProperty::BUFFER_DATA_SIZE), 0);
+
+	std::vector<int> indices;
+	program.GetVariables(resource, blockIndex, indices);
+	const std::vector<ResourceProperty> props = { ResourceProperty::OFFSET, ResourceProperty::ARRAY_STRIDE, ResourceProperty::MATRIX_STRIDE };
+	std::vector<int> values;
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		program.GetResourceProperties(variables, indices[i], props, values);
+		Member member;
+		member.offset = values[0];
+		member.arrayStride = values[1];
+		member.matrixStride = values[2];
+		_members[program.GetResourceName(variables, indices[i])] = member;
+	}
+
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(_target, _buffer);
+	glBufferData(_target, _data.size(), _data.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(_target, 0);
+	Bind();
+	return Attach(program);
+}
+
+void GLUniformBlock::Destroy()
+{
+	if (_buffer != 0) {
+		glDeleteBuffers(1, &_buffer);
+		_buffer = 0;
+	}
+	_data.clear();
+	_members.clear();
+	_dirtyBegin = _dirtyEnd = 0;
+}
+
+bool GLUniformBlock::Attach(const GLProgram &program) const
+{
+	int blockIndex = program.GetResourceIndex((ProgramResource)_resource, _name);
+	if (blockIndex == (int)GL_INVALID_INDEX) {
+		return false;
+	}
+	if (_target == GL_SHADER_STORAGE_BUFFER) {
+		glShaderStorageBlockBinding(program.Id(), blockIndex, _binding);
+	}
+	else {
+		glUniformBlockBinding(program.Id(), blockIndex, _binding);
+	}
+	return true;
+}
+
+GLuint GLUniformBlock::Binding() const
+{
+	return _binding;
+}
+
+size_t GLUniformBlock::Size() const
+{
+	return _data.size();
+}
+
+int GLUniformBlock::Offset(const std::string &member) const
+{
+	const Member *found = _Find(member);
+	return found ? found->offset : -1;
+}
+
+int GLUniformBlock::ArrayStride(const std::string &member) const
+{
+	const Member *found = _Find(member);
+	return found ? found->arrayStride : -1;
+}
+
+bool GLUniformBlock::Verify(const std::string &member, size_t offset) const
+{
+	int actual = Offset(member);
+	if (actual != (int)offset) {
+		std::cout << _name << "." << member << " is at " << actual << " in the program but at " << offset << " in C++" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void GLUniformBlock::Set(const std::string &member, const void *data, size_t size)
+{
+	const Member *found = _Find(member);
+	if (found != nullptr) {
+		_Write(found->offset, data, size);
+	}
+}
+
+void GLUniformBlock::Set(const std::string &member, const glm::mat3 &value)
+{
+	const Member *found = _Find(member);
+	if (found == nullptr) {
+		return;
+	}
+	for (int i = 0; i < 3; i++) {
+		_Write(found->offset + i * found->matrixStride, &value[i], sizeof(value[i]));
+	}
+}
+
+void GLUniformBlock::SetData(const void *data, size_t size, size_t offset)
+{
+	_Write(offset, data, size);
+}
+
+void GLUniformBlock::Upload()
+{
+	if (_dirtyBegin >= _dirtyEnd) {
+		return;
+	}
+	glBindBuffer(_target, _buffer);
+	glBufferSubData(_target, _dirtyBegin, _dirtyEnd - _dirtyBegin, &_data[_dirtyBegin]);
+	glBindBuffer(_target, 0);
+	_dirtyBegin = _dirtyEnd = 0;
+}
+
+void GLUniformBlock::Bind() const
+{
+	glBindBufferBase(_target, _binding, _buffer);
+}
+
+const GLUniformBlock::Member *GLUniformBlock::_Find(const std::string &member) const
+{
+	auto found = _members.find(member);
+	if (found == _members.end()) {
+		// arrays of basic types are reported once, by their first element
+		found = _members.find(member + "[0]");
+	}
+	return found != _members.end() ? &found->second : nullptr;
+}
+
+void GLUniformBlock::_Write(size_t offset, const void *data, size_t size)
+{
+	if (offset >= _data.size()) {
+		return;
+	}
+	size = std::min(size, _data.size() - offset);
+	std::memcpy(&_data[offset], data, size);
+	if (_dirtyBegin >= _dirtyEnd) {
+		_dirtyBegin = offset;
+		_dirtyEnd = offset + size;
+	}
+	else {
+		_dirtyBegin = std::min(_dirtyBegin, offset);
+		_dirtyEnd = std::max(_dirtyEnd, offset + size);
+	}
+}
+
+} // namespace opengl
\ No newline at end of file
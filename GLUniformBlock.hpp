@@ -0,0 +1,80 @@
+#pragma once
+#ifndef GLUNIFORMBLOCK_HPP
+#define GLUNIFORMBLOCK_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "GLProgram.hpp"
+
+namespace opengl {
+
+// A uniform or shader storage block's layout read back from a linked program, and the buffer that feeds it.
+// Members are written into a CPU copy at the offsets the program reports and the whole change goes up with one
+// buffer write, instead of a glUniform call per member and per program. A std140 or std430 block has the same
+// layout in every program declaring it, so one GLUniformBlock feeds all of them once they're Attach()ed.
+//
+// For a C++ struct mirroring the block, static_assert its offsets against the std140/std430 rules and
+// Verify() them against the program at startup, then SetData() copies the struct in one go.
+class GLUniformBlock
+{
+public:
+	GLUniformBlock();
+	// Resource is UNIFORM_BLOCK or SHADER_STORAGE_BLOCK. Fails if the program has no such block.
+	bool Create(const GLProgram &program, const std::string &blockName, GLuint binding,
+		ProgramResource resource = ProgramResource::UNIFORM_BLOCK);
+	void Destroy();
+	// Points the program's block at Binding(). Bindings reset on every link, binaries included.
+	bool Attach(const GLProgram &program) const;
+	GLuint Binding() const;
+	size_t Size() const;
+	// The member's byte offset, -1 if there is no such active member. Names are the program's,
+	// e.g. "lights[3].Color", storage blocks with an instance name prefix the block's name.
+	int Offset(const std::string &member) const;
+	int ArrayStride(const std::string &member) const;
+	// Whether the member is where a C++ layout puts it. Prints the difference if not.
+	bool Verify(const std::string &member, size_t offset) const;
+	void Set(const std::string &member, const void *data, size_t size);
+	// std140 and std430 put mat3 columns 16 bytes apart, the program's matrix stride is used.
+	void Set(const std::string &member, const glm::mat3 &value);
+	template <typename T>
+	void Set(const std::string &member, const T &value);
+	// Copies a struct laid out like the block (see Verify()) over the CPU copy.
+	void SetData(const void *data, size_t size, size_t offset = 0);
+	// Uploads everything written since the last Upload() with a single buffer write.
+	void Upload();
+	// Binds the buffer to Binding(), Create() already does.
+	void Bind() const;
+
+private:
+	struct Member
+	{
+		int offset;
+		int arrayStride;
+		int matrixStride;
+	};
+
+	const Member *_Find(const std::string &member) const;
+	void _Write(size_t offset, const void *data, size_t size);
+
+	GLenum _target;
+	GLenum _resource;
+	std::string _name;
+	GLuint _buffer;
+	GLuint _binding;
+	std::vector<unsigned char> _data;
+	size_t _dirtyBegin, _dirtyEnd;
+	std::unordered_map<std::string, Member> _members;
+};
+
+template <typename T>
+inline void GLUniformBlock::Set(const std::string &member, const T &value)
+{
+	Set(member, &value, sizeof(T));
+}
+
+} // namespace opengl
+#endif // GLUNIFORMBLOCK_HPP
\ No newline at end of file
@@ -88,19 +88,71 @@ int MyApplication::Init(const char *title, const WindowSettings &settings, int w
 	Mouse::SetPosition(_win, MOUSE_X_LOCK, MOUSE_Y_LOCK);
 	Mouse::Update();
 
-	_model1 = _modelLoader.Load(SPONZA_FILE, false, true);
-	_model2 = _modelLoader.Load(LUCY_FILE, false);
-	if (!_model1 || !_model2 || !_ds.Init(_win.Width(), _win.Height())) {
+	// without a pack everything is read from loose files once, and the caches they went through are packed afterwards
+	if (!_modelLoader.GetCache().Open(CACHE_DIRECTORY, CACHE_CAPACITY)) {
+		std::cout << "Failed to open the asset cache, caching next to the sources: " << CACHE_DIRECTORY << std::endl;
+	}
+	else {
+		opengl::GLProgram::SetAssetCache(&_modelLoader.GetCache());
+	}
+	_writeAssetPack = !_assetPack.Open(ASSET_PACK_FILE);
+	if (!_writeAssetPack) {
+		_modelLoader.SetAssetPack(&_assetPack);
+		opengl::GLProgram::SetAssetPack(&_assetPack);
+	}
+	_modelLoader.GetStreamer().SetBudget(TEXTURE_BUDGET);
+	if (ASYNC_LOADING && PROGRESSIVE_LOADING) {
+		GL.SetCamera(position, position + ViewDirection());
+		_modelLoader.SetLoadView(GL.ProjMatrix() * GL.ViewMatrix());
+		_model1 = _modelLoader.LoadAsync(SPONZA_FILE, _ds.Placement1(), false, true);
+		_model2 = GEOMETRY_BUDGET > 0 ? _modelLoader.LoadOutOfCore(LUCY_FILE, GEOMETRY_BUDGET, false)
+			: _modelLoader.LoadAsync(LUCY_FILE, _ds.Placement2(), false);
+	}
+	else if (ASYNC_LOADING) {
+		_model1 = _modelLoader.LoadAsync(SPONZA_FILE, false, true);
+		_model2 = GEOMETRY_BUDGET > 0 ? _modelLoader.LoadOutOfCore(LUCY_FILE, GEOMETRY_BUDGET, false) : _modelLoader.LoadAsync(LUCY_FILE, false);
+	}
+	else {
+		_model1 = _modelLoader.Load(SPONZA_FILE, false, true);
+		_model2 = GEOMETRY_BUDGET > 0 ? _modelLoader.LoadOutOfCore(LUCY_FILE, GEOMETRY_BUDGET, false) : _modelLoader.Load(LUCY_FILE, false);
+	}
+	if (!_model1 || !_model2 || !_ds.Init(_win.Width(), _win.Height(), _modelLoader.GetStreamer().IsEnabled())) {
 		return EXIT_FAILURE;
 	}
 	_ds.SetPerspective(NEAR_PLANE, FAR_PLANE);
+	if (ASYNC_LOADING && PROGRESSIVE_LOADING) {
+		// the first frame shows the start view complete, the rest keeps streaming in
+		while (!_modelLoader.IsVisibleLoaded()) {
+			SDL_PumpEvents();
+			_modelLoader.Update(UPLOAD_BUDGET_MS);
+			SDL_Delay(1);
+		}
+	}
 	return EXIT_SUCCESS;
 }
 
+glm::vec3 MyApplication::ViewDirection() const
+{
+	return glm::vec3(
+		cos(verticalAngle) * sin(horizontalAngle),
+		sin(verticalAngle),
+		cos(verticalAngle) * cos(horizontalAngle));
+}
+
 void MyApplication::Update(Uint32 ticks)
 {
 	float deltaTime = float(ticks);
 	float moveSpeed = 1.0f;
+	_modelLoader.Update(UPLOAD_BUDGET_MS);
+	if (!_loadsFinished && !_modelLoader.IsLoading()) {
+		_loadsFinished = true;
+		_modelLoader.GetCache().PrintStats();
+		if (_writeAssetPack) {
+			std::vector<std::string> shaders;
+			_ds.GetShaderFiles(shaders);
+			_modelLoader.WriteAssetPack(ASSET_PACK_FILE, shaders);
+		}
+	}
 	if (_win.IsInputFocused()) {
 		// Compute new orientation
 		horizontalAngle -= TURN_SPEED * (Mouse::X() - MOUSE_X_LOCK);
@@ -153,10 +205,7 @@ void MyApplication::Update(Uint32 ticks)
 		horizontalAngle = PI_ * 1.5f;
 	}
 
-	glm::vec3 direction(
-		cos(verticalAngle) * sin(horizontalAngle),
-		sin(verticalAngle),
-		cos(verticalAngle) * cos(horizontalAngle));
+	glm::vec3 direction = ViewDirection();
 
 	const glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
 	const glm::vec3 right = glm::cross(direction, up);
@@ -239,10 +288,18 @@ void MyApplication::Draw(Uint32 ticks)
 
 	GL.Identity();
 	_ds.Render((float)ticks, *_model1, *_model2, position);
+
+	// texture streaming decides what to load next from what the last frames sampled
+	int feedbackW, feedbackH;
+	if (_ds.ReadFeedback(_feedback, feedbackW, feedbackH)) {
+		_modelLoader.GetStreamer().ProcessFeedback(_feedback.data(), feedbackW, feedbackH);
+	}
 }
 
 bool MyApplication::OnQuit() 
 {
+	// the context is destroyed with the window once Run() returns
+	_ds.Shutdown();
 	return true;
 }
 
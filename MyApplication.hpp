@@ -62,11 +62,25 @@ public:
 protected:
 	opengl::GLProgram _p;
 	opengl::GLModel *_model1, *_model2;
+	opengl::GLAssetPack _assetPack; // declared before the loader, which reads from it until it's destroyed
+	bool _writeAssetPack = false;
+	bool _loadsFinished = false;
 	opengl::GLModelLoader _modelLoader;
 	DeferredShader _ds;
+	std::vector<unsigned int> _feedback;
 
 	const std::string SPONZA_FILE = ".\\models\\sponza\\sponza.obj";
 	const std::string LUCY_FILE = ".\\models\\lucy.obj";
+	// mesh caches, texture caches and shaders of the scene in one mapped file, written on the first run that finds none
+	const std::string ASSET_PACK_FILE = ".\\models\\scene.assetpack";
+	// processed meshes and textures keyed by content, shared by every model
+	const std::string CACHE_DIRECTORY = ".\\cache";
+	const uint64_t CACHE_CAPACITY = 2048ull * 1024 * 1024;
+	const bool ASYNC_LOADING = true; // stream models in after the first frame instead of loading them up front
+	const bool PROGRESSIVE_LOADING = true; // upload what the start camera sees first and wait only for that
+	const float UPLOAD_BUDGET_MS = 4.0f; // render thread time spent finishing uploads per frame
+	const size_t TEXTURE_BUDGET = 256 * 1024 * 1024; // resident bytes of streamed texture mips
+	const size_t GEOMETRY_BUDGET = 0; // pages the Lucy scan in from disk through GPU pools this big instead of loading it whole, off when zero
 	const float MOVE_SPEED = 0.002f;
 	const float TURN_SPEED = 0.002f;
 	const int MOUSE_X_LOCK = 150;
@@ -76,6 +90,7 @@ protected:
 	float verticalAngle = -0.35f;
 	glm::vec3 position = glm::vec3(0.0f, -0.7f, 4.5f);
 
+	glm::vec3 ViewDirection() const;
 	void Update(Uint32 ticks);
 	void Draw(Uint32 ticks);
 	bool OnEvent(const SDL_Event &e) { return false; }
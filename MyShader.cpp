@@ -5,7 +5,22 @@ using namespace opengl;
 
 bool MyShader::Create(const char *vertShader, const char *fragShader)
 {
-	if (!_program.Create(vertShader, fragShader)) {
+	return CreateAsync(vertShader, fragShader) && Wait();
+}
+
+bool MyShader::CreateAsync(const char *vertShader, const char *fragShader, const std::string &defines)
+{
+	return _program.CreateAsync(vertShader, fragShader, defines);
+}
+
+bool MyShader::IsPending() const
+{
+	return _program.IsPending();
+}
+
+bool MyShader::Wait()
+{
+	if (!_program.Wait()) {
 		return false;
 	}
 	_modelLoc = _program.GetUniform("ModelMatrix").GetLocation();
@@ -42,4 +57,9 @@ GLuint MyShader::Id() const
 opengl::GLUniform MyShader::Get(const char *uniformName)
 {
 	return _program.GetUniform(uniformName);
+}
+
+opengl::GLUniform MyShader::Get(uint32_t uniformId) const
+{
+	return _program.GetUniform(uniformId);
 }
\ No newline at end of file
@@ -7,11 +7,16 @@ class MyShader
 {
 public:
 	bool Create(const char *vertShader, const char *fragShader);
+	// See GLProgram::CreateAsync(), Wait() looks up the matrix uniforms once it's linked.
+	bool CreateAsync(const char *vertShader, const char *fragShader, const std::string &defines = std::string());
+	bool IsPending() const;
+	bool Wait();
 	void Bind() const;
 	void BindMVP() const;
 	opengl::GLProgram GetProgram();
 	GLuint Id() const;
 	opengl::GLUniform Get(const char *uniformName);
+	opengl::GLUniform Get(uint32_t uniformId) const;
 
 private:
 	opengl::GLProgram _program;
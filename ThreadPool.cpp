@@ -0,0 +1,150 @@
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace opengl {
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+	: _active(0), _stop(false)
+{
+	if (numThreads == 0) {
+		numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0) {
+			numThreads = 4;
+		}
+	}
+	for (unsigned int i = 0; i < numThreads; i++) {
+		_workers.push_back(std::thread(&ThreadPool::_WorkerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_taskReady.notify_all();
+	for (unsigned int i = 0; i < _workers.size(); i++) {
+		_workers[i].join();
+	}
+}
+
+unsigned int ThreadPool::NumThreads() const
+{
+	return (unsigned int)_workers.size();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push_back(std::move(task));
+	}
+	_taskReady.notify_one();
+}
+
+void ThreadPool::Submit(TaskGroup &group, std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(group._mutex);
+		group._pending++;
+	}
+	TaskGroup *owner = &group;
+	Submit([owner, task] {
+		task();
+		std::lock_guard<std::mutex> lock(owner->_mutex);
+		if (--owner->_pending == 0) {
+			owner->_done.notify_all();
+		}
+	});
+}
+
+void TaskGroup::Wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _pending == 0; });
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_tasksDone.wait(lock, [this] { return _tasks.empty() && _active == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &fn)
+{
+	if (count == 0) {
+		return;
+	}
+	// every participant pulls indices from a shared counter so uneven items balance out.
+	// Helpers that only get scheduled after the caller has finished the range are skipped,
+	// which keeps nested calls from waiting on tasks queued behind themselves.
+	struct Job
+	{
+		std::atomic<size_t> next;
+		std::mutex mutex;
+		std::condition_variable done;
+		size_t running;
+		bool closed;
+	};
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->next = 0;
+	job->running = 0;
+	job->closed = false;
+	const std::function<void(size_t)> *func = &fn;
+	size_t helpers = std::min<size_t>(_workers.size(), count - 1);
+	for (size_t i = 0; i < helpers; i++) {
+		Submit([job, func, count] {
+			{
+				std::lock_guard<std::mutex> lock(job->mutex);
+				if (job->closed) {
+					return;
+				}
+				job->running++;
+			}
+			for (size_t index = job->next++; index < count; index = job->next++) {
+				(*func)(index);
+			}
+			std::lock_guard<std::mutex> lock(job->mutex);
+			if (--job->running == 0) {
+				job->done.notify_one();
+			}
+		});
+	}
+	for (size_t index = job->next++; index < count; index = job->next++) {
+		fn(index);
+	}
+	std::unique_lock<std::mutex> lock(job->mutex);
+	job->closed = true;
+	job->done.wait(lock, [&job] { return job->running == 0; });
+}
+
+void ThreadPool::_WorkerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_taskReady.wait(lock, [this] { return _stop || !_tasks.empty(); });
+			if (_stop && _tasks.empty()) {
+				return;
+			}
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+			_active++;
+		}
+		task();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_active--;
+			if (_tasks.empty() && _active == 0) {
+				_tasksDone.notify_all();
+			}
+		}
+	}
+}
+
+} // namespace opengl
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+namespace opengl {
+
+// Counts the tasks one owner submitted to a shared ThreadPool, so the owner can wait for its own work
+// without waiting on everything else in the pool. Must outlive the tasks submitted with it.
+class TaskGroup
+{
+public:
+	TaskGroup() : _pending(0) {}
+	// Blocks until every task submitted with this group has finished.
+	void Wait();
+
+private:
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup &operator=(const TaskGroup &) = delete;
+	friend class ThreadPool;
+
+	std::mutex _mutex;
+	std::condition_variable _done;
+	size_t _pending;
+};
+
+// Fixed set of worker threads for CPU side loading work (decoding, parsing, mesh processing).
+// Tasks must not make GL calls since the workers have no context current.
+class ThreadPool
+{
+public:
+	// Zero uses one thread per hardware core.
+	explicit ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+	unsigned int NumThreads() const;
+	void Submit(std::function<void()> task);
+	// Counts the task in the group until it has finished, see TaskGroup::Wait().
+	void Submit(TaskGroup &group, std::function<void()> task);
+	// Blocks until every submitted task has finished, everyone else's included.
+	void Wait();
+	// Calls fn(i) for every i in [0, count) across the workers and the calling thread, then returns.
+	// Safe to call from inside a task.
+	void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	void _WorkerLoop();
+
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _taskReady;
+	std::condition_variable _tasksDone;
+	size_t _active;
+	bool _stop;
+};
+
+} // namespace opengl
+#endif // THREADPOOL_HPP
\ No newline at end of file
@@ -0,0 +1,18 @@
+@echo off
+rem Compiles every shader to the SPIR-V module GLProgram loads with GL_ARB_gl_spirv (pass1_gbuffer.frag.spv and so on).
+rem Run by the pre-build step. Needs glslangValidator from the Vulkan SDK, without it the GLSL sources are compiled at startup.
+setlocal
+cd /d "%~dp0"
+where glslangValidator >nul 2>nul
+if errorlevel 1 (
+	echo glslangValidator not found, shaders will be compiled from GLSL at startup.
+	exit /b 0
+)
+rem locations and bindings are assigned automatically, the program sets samplers and block bindings by name at runtime
+for %%f in (*.vert *.frag) do (
+	glslangValidator -G --auto-map-locations --auto-map-bindings -o "%%f.spv" "%%f" || (
+		echo Failed to compile %%f to SPIR-V, it will be compiled from GLSL.
+		del "%%f.spv" 2>nul
+	)
+)
+exit /b 0
\ No newline at end of file
@@ -1,13 +1,43 @@
 //original source: https://github.com/JoeyDeVries/LearnOpenGL/tree/master/src/5.advanced_lighting/8.2.deferred_shading_volumes
 #version 330 core
 
+// One source for every material, DeferredShader::GBufferShader() sets what the mesh has:
+// HAS_DIFFUSE, HAS_SPECULAR, HAS_NORMAL and PACKED_SPECULAR (specular baked into the diffuse alpha, TextureType::DiffuseSpecular).
+// WRITE_FEEDBACK is set when texture streaming is on, otherwise the G-buffer has no FeedbackBuffer attachment.
+// They're #defined true in GLSL and specialization constants in the SPIR-V module, either way the unused branches fold away.
+#ifdef GL_SPIRV
+layout (constant_id = 0) const bool HAS_DIFFUSE = false;
+layout (constant_id = 1) const bool HAS_SPECULAR = false;
+layout (constant_id = 2) const bool HAS_NORMAL = false;
+layout (constant_id = 3) const bool PACKED_SPECULAR = false;
+layout (constant_id = 4) const bool WRITE_FEEDBACK = false;
+#else
+#ifndef HAS_DIFFUSE
+#define HAS_DIFFUSE false
+#endif
+#ifndef HAS_SPECULAR
+#define HAS_SPECULAR false
+#endif
+#ifndef HAS_NORMAL
+#define HAS_NORMAL false
+#endif
+#ifndef PACKED_SPECULAR
+#define PACKED_SPECULAR false
+#endif
+#ifndef WRITE_FEEDBACK
+#define WRITE_FEEDBACK false
+#endif
+#endif
+
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
 uniform sampler2D texture_normal1;
+uniform uint FeedbackId;
 
 layout (location = 0) out vec3 PositionBuffer;
 layout (location = 1) out vec3 NormalBuffer;
 layout (location = 2) out vec4 DiffuseSpecBuffer;
+layout (location = 3) out uint FeedbackBuffer;
 
 in vec3 Position0;
 in vec2 TexCoord0;
@@ -18,7 +48,43 @@ in vec3 Bitangent0;
 void main()
 {    
 	PositionBuffer = Position0;
-	NormalBuffer = normalize(Normal0);
 
-	DiffuseSpecBuffer.rgba = vec4(0.8, 0.8, 0.8, 0.6);
+	if (HAS_NORMAL) {
+		vec3 Normal = normalize(Normal0);
+		vec3 Tangent = normalize(Tangent0);
+		vec3 Bitangent = normalize(Bitangent0);
+		// only x and y are stored in normal maps (BC5 or two channels), z follows from the unit length
+		vec3 NormalBump;
+		NormalBump.xy = texture(texture_normal1, TexCoord0).xy * 2.0 - 1.0;
+		NormalBump.z = sqrt(max(0.0, 1.0 - dot(NormalBump.xy, NormalBump.xy)));
+		mat3 tbnMatrix = mat3(Tangent, Bitangent, Normal);
+		NormalBuffer = normalize(tbnMatrix * NormalBump);
+	}
+	else {
+		NormalBuffer = normalize(Normal0);
+	}
+
+	if (HAS_DIFFUSE && PACKED_SPECULAR) {
+		DiffuseSpecBuffer = texture(texture_diffuse1, TexCoord0);
+	}
+	else if (HAS_DIFFUSE) {
+		DiffuseSpecBuffer.rgb = texture(texture_diffuse1, TexCoord0).rgb;
+		DiffuseSpecBuffer.a = HAS_SPECULAR ? texture(texture_specular1, TexCoord0).r : 0.0;
+	}
+	else {
+		DiffuseSpecBuffer.rgba = vec4(0.8, 0.8, 0.8, 0.6);
+	}
+
+	if (!WRITE_FEEDBACK) {
+		return;
+	}
+	if (HAS_DIFFUSE || HAS_NORMAL) {
+		// texture streaming feedback: which textures are sampled here and the log2 of the UV footprint
+		float footprint = max(length(dFdx(TexCoord0)), length(dFdy(TexCoord0)));
+		float lod = log2(max(footprint, 1e-9));
+		FeedbackBuffer = (FeedbackId << 12u) | uint(clamp((lod + 32.0) * 64.0, 0.0, 4095.0));
+	}
+	else {
+		FeedbackBuffer = 0u;
+	}
 }
\ No newline at end of file
@@ -1,16 +1,21 @@
 //original source: https://github.com/JoeyDeVries/LearnOpenGL/tree/master/src/5.advanced_lighting/8.2.deferred_shading_volumes
 #version 330 core
 
-uniform mat4 ModelMatrix;
-uniform mat4 ViewMatrix;
-uniform mat4 ProjectionMatrix;
-uniform mat3 NormalMatrix;
+// uploaded once per model and shared by every G-buffer program (DeferredShader::_transforms)
+layout (std140) uniform Transforms
+{
+	mat4 ModelMatrix;
+	mat4 ViewMatrix;
+	mat4 ProjectionMatrix;
+	mat3 NormalMatrix;
+};
 
 layout (location = 0) in vec3 Position;
 layout (location = 1) in vec3 Normal;
 layout (location = 2) in vec2 TexCoord;
-layout (location = 3) in vec3 Tangent;
-layout (location = 4) in vec3 Bitangent;
+layout (location = 3) in vec4 Tangent; // w is only set by glTF meshes, it defaults to 1
+layout (location = 4) in vec3 Bitangent; // zero for glTF meshes
+layout (location = 5) in vec3 InstanceOffset; // model space translation of an instanced copy, zero otherwise
 
 out vec3 Position0;
 out vec2 TexCoord0;
@@ -21,14 +26,16 @@ out vec3 Bitangent0;
 void main()
 {
 	// Transform position from model space to world space.
-	vec4 worldPosition = ModelMatrix * vec4(Position, 1.0);
+	vec4 worldPosition = ModelMatrix * vec4(Position + InstanceOffset, 1.0);
 	Position0 = worldPosition.xyz;
 	TexCoord0 = TexCoord;
 
 	// Normal, Tangent, Bitangent used to calculate TBN Matrix for normal mapping.
 	Normal0 = normalize(NormalMatrix * Normal);
-	Tangent0 = normalize(NormalMatrix * Tangent);
-	Bitangent0 = normalize(NormalMatrix * Bitangent);
+	// glTF stores the bitangent's handedness in Tangent.w instead of a bitangent
+	vec3 bitangent = dot(Bitangent, Bitangent) > 0.0 ? Bitangent : cross(Normal, Tangent.xyz) * Tangent.w;
+	Tangent0 = normalize(NormalMatrix * Tangent.xyz);
+	Bitangent0 = normalize(NormalMatrix * bitangent);
 
 	// Transform position from world space to projection/camera space.
 	// This allows forclipping and depth culling, and stores the depth value.
@@ -5,15 +5,25 @@ uniform sampler2D PositionBuffer;
 uniform sampler2D NormalBuffer;
 uniform sampler2D DiffuseSpecBuffer;
 
+// the floats fill the vec3s' padding, 32 bytes per light in std140 (DeferredShader's LightData)
 struct Light
 {
 	vec3 Position;
-	vec3 Color;
 	float Radius;
+	vec3 Color;
 	float Attenuation;
 };
-const int NUM_LIGHTS = 150;
-uniform Light lights[NUM_LIGHTS];
+// DeferredShader specializes the light count so the loop below has a constant trip count.
+// A specialization constant doesn't resize the block, the SPIR-V module's holds the default 150 whatever the count.
+#ifdef GL_SPIRV
+layout (constant_id = 0) const int NUM_LIGHTS = 150;
+#elif !defined(NUM_LIGHTS)
+#define NUM_LIGHTS 150
+#endif
+layout (std140) uniform Lights
+{
+	Light lights[NUM_LIGHTS];
+};
 const float AmbientLight = 0.01;
 uniform vec3 CamPosition;
 
@@ -1,10 +1,16 @@
 //original source: https://github.com/JoeyDeVries/LearnOpenGL/tree/master/src/5.advanced_lighting/8.2.deferred_shading_volumes
 #version 330 core
+#extension GL_ARB_separate_shader_objects : require
 
 layout (location = 0) in vec3 Position;
 layout (location = 1) in vec2 TexCoord;
 
 out vec2 TexCoord0;
+// linked on its own into a pipeline (GLProgramPipeline), which needs the built-in block redeclared
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
 
 void main()
 {